@@ -1,55 +1,56 @@
-// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
-
-using UnrealBuildTool;
-
-public class InventorySystem : ModuleRules
-{
-    public InventorySystem(ReadOnlyTargetRules Target) : base(Target)
-    {
-        PCHUsage = ModuleRules.PCHUsageMode.UseExplicitOrSharedPCHs;
-
-        PublicIncludePaths.AddRange(
-            new string[]
-            {
-                // ... add public include paths required here ...
-            }
-        );
-
-
-        PrivateIncludePaths.AddRange(
-            new string[]
-            {
-                // ... add other private include paths required here ...
-            }
-        );
-
-
-        PublicDependencyModuleNames.AddRange(
-            new string[]
-            {
-                "Core",
-                // ... add other public dependencies that you statically link with here ...
-            }
-        );
-
-
-        PrivateDependencyModuleNames.AddRange(
-            new string[]
-            {
-                "CoreUObject",
-                "Engine",
-                "Slate",
-                "SlateCore",
-                // ... add private dependencies that you statically link with here ...	
-            }
-        );
-
-
-        DynamicallyLoadedModuleNames.AddRange(
-            new string[]
-            {
-                // ... add any modules that your module loads dynamically here ...
-            }
-        );
-    }
+// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
+
+using UnrealBuildTool;
+
+public class InventorySystem : ModuleRules
+{
+    public InventorySystem(ReadOnlyTargetRules Target) : base(Target)
+    {
+        PCHUsage = ModuleRules.PCHUsageMode.UseExplicitOrSharedPCHs;
+
+        PublicIncludePaths.AddRange(
+            new string[]
+            {
+                // ... add public include paths required here ...
+            }
+        );
+
+
+        PrivateIncludePaths.AddRange(
+            new string[]
+            {
+                // ... add other private include paths required here ...
+            }
+        );
+
+
+        PublicDependencyModuleNames.AddRange(
+            new string[]
+            {
+                "Core",
+                "GameplayTags",
+                // ... add other public dependencies that you statically link with here ...
+            }
+        );
+
+
+        PrivateDependencyModuleNames.AddRange(
+            new string[]
+            {
+                "CoreUObject",
+                "Engine",
+                "Slate",
+                "SlateCore",
+                // ... add private dependencies that you statically link with here ...	
+            }
+        );
+
+
+        DynamicallyLoadedModuleNames.AddRange(
+            new string[]
+            {
+                // ... add any modules that your module loads dynamically here ...
+            }
+        );
+    }
 }
\ No newline at end of file
@@ -0,0 +1,32 @@
+// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
+
+#include "Crafting/CraftingTypes.h"
+#include "Engine/AssetManager.h"
+
+void UCraftingRecipe::resolveRequirements(TArray<FResolvedRecipeRequirement>& out_requirements) const
+{
+    check(IsInGameThread());
+    out_requirements.Reset(Requirements.Num());
+    for (auto&& requirement : Requirements)
+    {
+        if (requirement.Quantity > 0) out_requirements.Add({requirement.Item.Get(), requirement.Quantity});
+    }
+}
+
+TSharedPtr<FStreamableHandle> UCraftablesCollection::streamInCraftables(FStreamableDelegate on_loaded)
+{
+    INVENTORY_LLM_SCOPE();
+    TArray<FSoftObjectPath> stream_in_assets;
+    for (auto&& craftable : Craftables)
+    {
+        if (!craftable.IsNull()) stream_in_assets.Add(craftable.ToSoftObjectPath());
+    }
+    if (stream_in_assets.Num() == 0 || !UAssetManager::IsValid())
+    {
+        on_loaded.ExecuteIfBound();
+        return nullptr;
+    }
+    // Recipes already loaded complete right away. The new request keeps all of them loaded, replacing the previous one.
+    craftables_stream_handle = UAssetManager::GetStreamableManager().RequestAsyncLoad(stream_in_assets, on_loaded, FStreamableManager::AsyncLoadHighPriority);
+    return craftables_stream_handle;
+}
@@ -1,60 +1,301 @@
-// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
-
-#include "Crafting/CraftingUtils.h"
-
-TMap<UItemData*, FRecipesSet> UCraftingUtils::generateRecipesForItemMappings(UCraftablesCollection* craftables_collection)
-{
-    if (!IsValid(craftables_collection))
-    {
-        UE_LOG(LogInventorySystem, Error, TEXT("Invalid craftables collection."))
-        return {};
-    }
-    TMap<UItemData*, FRecipesSet> mappings;
-    for (auto&& craftable : craftables_collection->Craftables)
-    {
-        for (auto&& recipe_requirement : craftable->Requirements)
-        {
-            if (!mappings.Contains(recipe_requirement.Item)) mappings.Add(recipe_requirement.Item); // Add item keys we don't have yet.
-            mappings[recipe_requirement.Item].Recipes.Add(craftable);
-        }
-    }
-    return mappings;
-}
-
-TArray<UCraftingRecipe*> UCraftingUtils::getCraftableRecipesForAvailableItems(TMap<UItemData*, int32> available_items, UCraftablesCollection* craftables_collection)
-{
-    if (!IsValid(craftables_collection))
-    {
-        UE_LOG(LogInventorySystem, Error, TEXT("Invalid craftables collection."))
-        return {};
-    }
-
-    TArray<UCraftingRecipe*> available_recipes;
-    // For each recipe we want to check whether we have all necessary item requirements and quantity.
-    for (auto&& recipe : craftables_collection->Craftables)
-    {
-        bool bHasAllRequirements = true;
-        for (auto&& requirement : recipe->Requirements)
-        {
-            // Early out as soon as a requirement is not satisfied.
-            if (!available_items.Contains(requirement.Item) || requirement.Quantity > available_items[requirement.Item])
-            {
-                bHasAllRequirements = false;
-                break;
-            }
-        }
-        if (bHasAllRequirements) available_recipes.Add(recipe); // Add the recipe if we have everything needed for it
-    }
-
-    return available_recipes;
-}
-
-TMap<UItemData*, int32> UCraftingUtils::generateAvailableItemsFromResources(const FBagResources& in_resources)
-{
-    TMap<UItemData*, int32> available_items;
-    for (auto&& resource : in_resources.Data)
-    {
-        available_items.Add(resource.Key, resource.Value.ResourceQuantity);
-    }
-    return available_items;
-}
+// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
+
+#include "Crafting/CraftingUtils.h"
+#include "InventoryTraceRecorder.h"
+#include "Async/ParallelFor.h"
+#include "Async/TaskGraphInterfaces.h"
+#include "Engine/World.h"
+#include "GameFramework/Actor.h"
+#include "HAL/IConsoleManager.h"
+#include "Math/RandomStream.h"
+
+DECLARE_CYCLE_STAT(TEXT("Evaluate Craftables (Batch)"), STAT_CraftingEvaluateBatch, STATGROUP_InventorySystem);
+
+static TAutoConsoleVariable<int32> CVarCraftingBatchSingleThread(
+    TEXT("InventorySystem.Crafting.BatchSingleThread"),
+    0,
+    TEXT("When not 0, batch crafting evaluation runs on the calling thread only.\n")
+    TEXT("Compare with the parallel path through stat InventorySystem, limiting cores with -corelimit=N."));
+
+namespace
+{
+    /** Resolves the requirements of every loaded recipe of a collection, indexed by recipe position. Game thread only. */
+    void resolveCollection(UCraftablesCollection* craftables_collection, TArray<TArray<FResolvedRecipeRequirement>>& out_requirements, TBitArray<>& out_loaded)
+    {
+        int32 const recipe_count = craftables_collection->Craftables.Num();
+        out_requirements.SetNum(recipe_count);
+        out_loaded.Init(false, recipe_count);
+        for (int32 recipe_index = 0; recipe_index < recipe_count; ++recipe_index)
+        {
+            UCraftingRecipe* recipe = craftables_collection->getLoadedCraftable(recipe_index);
+            if (recipe == nullptr) continue;
+            recipe->resolveRequirements(out_requirements[recipe_index]);
+            out_loaded[recipe_index] = true;
+        }
+    }
+
+    /** Fills in the crafting state of a bag, get_max_crafts tells how many times a recipe can be crafted from its requirements. */
+    template <typename TGetMaxCrafts>
+    void evaluateCraftability(const TArray<TArray<FResolvedRecipeRequirement>>& recipe_requirements, const TBitArray<>& loaded_recipes, bool bComputeMaxCrafts,
+                              TGetMaxCrafts&& get_max_crafts, FBagCraftability& result)
+    {
+        int32 const recipe_count = recipe_requirements.Num();
+        result.CraftableBits.SetNumZeroed((recipe_count + 31) / 32);
+        if (bComputeMaxCrafts) result.MaxCrafts.SetNumZeroed(recipe_count);
+        for (int32 recipe_index = 0; recipe_index < recipe_count; ++recipe_index)
+        {
+            if (!loaded_recipes[recipe_index]) continue;
+            int32 const max_crafts = get_max_crafts(recipe_requirements[recipe_index]);
+            if (max_crafts > 0) result.CraftableBits[recipe_index / 32] |= static_cast<int32>(1u << (recipe_index % 32));
+            if (bComputeMaxCrafts) result.MaxCrafts[recipe_index] = max_crafts;
+        }
+    }
+
+    /** Runs a batch evaluation repeat_count times with the given BatchSingleThread value. @return Milliseconds per batch. */
+    double timeBatch(int32 const single_thread, int32 const repeat_count, TFunctionRef<void()> evaluate)
+    {
+        IConsoleVariable* single_thread_variable = CVarCraftingBatchSingleThread.AsVariable();
+        int32 const previous_value = single_thread_variable->GetInt();
+        single_thread_variable->Set(single_thread, ECVF_SetByCode);
+        double const start_time = FPlatformTime::Seconds();
+        for (int32 i = 0; i < repeat_count; ++i) evaluate();
+        double const time = (FPlatformTime::Seconds() - start_time) * 1000.0 / repeat_count;
+        single_thread_variable->Set(previous_value, ECVF_SetByCode);
+        return time;
+    }
+
+    /**
+     * Fills a batch of bags with random quantities of the items required by a collection's recipes,
+     * then logs the time batch evaluation takes on the calling thread and in parallel.
+     * Run with -corelimit=N to compare core counts.
+     */
+    void benchmarkCraftables(const TArray<FString>& args, UWorld* world)
+    {
+        UCraftablesCollection* craftables_collection = args.Num() > 0 ? LoadObject<UCraftablesCollection>(nullptr, *args[0]) : nullptr;
+        UBagProperties* properties = args.Num() > 1 ? LoadObject<UBagProperties>(nullptr, *args[1]) : nullptr;
+        if (world == nullptr || craftables_collection == nullptr || properties == nullptr)
+        {
+            UE_LOG(LogInventorySystem, Warning, TEXT("Usage: InventorySystem.Crafting.Benchmark <craftables collection path> <bag properties path> [bag count] [repeat count]"));
+            return;
+        }
+        int32 const bag_count = args.Num() > 2 ? FMath::Max(FCString::Atoi(*args[2]), 1) : 1000;
+        int32 const repeat_count = args.Num() > 3 ? FMath::Max(FCString::Atoi(*args[3]), 1) : 10;
+
+        // Benchmark only, loading everything up front is fine.
+        TArray<UItemData*> items;
+        TArray<int32> max_quantities;
+        for (auto&& craftable_ptr : craftables_collection->Craftables)
+        {
+            UCraftingRecipe* recipe = craftable_ptr.LoadSynchronous();
+            if (recipe == nullptr) continue;
+            for (auto&& requirement : recipe->Requirements)
+            {
+                UItemData* item_data = requirement.Item.LoadSynchronous();
+                if (item_data == nullptr) continue;
+                int32 const item_index = items.AddUnique(item_data);
+                if (item_index == max_quantities.Num()) max_quantities.Add(0);
+                max_quantities[item_index] = FMath::Max(max_quantities[item_index], requirement.Quantity * 3);
+            }
+        }
+        if (items.Num() == 0)
+        {
+            UE_LOG(LogInventorySystem, Warning, TEXT("No recipe requirement could be loaded from [%s]."), *craftables_collection->GetPathName());
+            return;
+        }
+
+        // Same contents on every run, so timings can be compared between runs.
+        FRandomStream random_stream(0);
+        TArray<AActor*> actors;
+        TArray<UInventoryBagComponent*> bags;
+        int32 added_items = 0;
+        actors.Reserve(bag_count);
+        bags.Reserve(bag_count);
+        for (int32 bag_index = 0; bag_index < bag_count; ++bag_index)
+        {
+            AActor* actor = world->SpawnActor<AActor>();
+            UInventoryBagComponent* bag = NewObject<UInventoryBagComponent>(actor);
+            bag->BagProperties = properties;
+            bag->RegisterComponent(); // Begins play right away, the world has already begun play.
+            for (int32 item_index = 0; item_index < items.Num(); ++item_index)
+            {
+                int32 const quantity = random_stream.RandRange(0, max_quantities[item_index]);
+                if (quantity > 0) added_items += bag->addItems(items[item_index], quantity);
+            }
+            actors.Add(actor);
+            bags.Add(bag);
+        }
+        if (added_items == 0)
+        {
+            UE_LOG(LogInventorySystem, Warning, TEXT("Can't add items to bags with properties [%s], make sure their limits are loaded."), *properties->GetPathName());
+        }
+        TArray<FInventoryBagSnapshot> snapshots;
+        snapshots.Reserve(bag_count);
+        for (UInventoryBagComponent* bag : bags) snapshots.Add(bag->takeSnapshot());
+
+        auto const evaluate_snapshots = [&]() { UCraftingUtils::evaluateCraftablesForSnapshots(snapshots, craftables_collection, true); };
+        auto const evaluate_bags = [&]() { UCraftingUtils::evaluateCraftablesForBags(bags, craftables_collection, true); };
+        double const single_thread_time = timeBatch(1, repeat_count, evaluate_snapshots);
+        double const parallel_time = timeBatch(0, repeat_count, evaluate_snapshots);
+        double const bags_time = timeBatch(0, repeat_count, evaluate_bags);
+        UE_LOG(LogInventorySystem, Display, TEXT("Evaluated [%d] recipes for [%d] bags ([%d] item types), [%d] worker threads:"),
+               craftables_collection->Craftables.Num(), bag_count, items.Num(), FTaskGraphInterface::Get().GetNumWorkerThreads());
+        UE_LOG(LogInventorySystem, Display, TEXT("  Snapshots, single thread: [%.3f] ms per batch, [%.3f] us per bag"), single_thread_time, single_thread_time * 1000.0 / bag_count);
+        UE_LOG(LogInventorySystem, Display, TEXT("  Snapshots, parallel: [%.3f] ms per batch, [%.3f] us per bag, [%.2f]x"),
+               parallel_time, parallel_time * 1000.0 / bag_count, parallel_time > 0.0 ? single_thread_time / parallel_time : 0.0);
+        UE_LOG(LogInventorySystem, Display, TEXT("  Bags, parallel: [%.3f] ms per batch, [%.3f] us per bag"), bags_time, bags_time * 1000.0 / bag_count);
+
+        for (AActor* actor : actors) actor->Destroy();
+    }
+}
+
+static FAutoConsoleCommandWithWorldAndArgs GInventoryCraftingBenchmarkCommand(
+    TEXT("InventorySystem.Crafting.Benchmark"),
+    TEXT("Fills bag count (default 1000) bags with random recipe requirements and logs the time batch crafting evaluation takes, on a single thread and in parallel."),
+    FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&benchmarkCraftables));
+
+TMap<TSoftObjectPtr<UItemData>, FRecipesSet> UCraftingUtils::generateRecipesForItemMappings(UCraftablesCollection* craftables_collection)
+{
+    INVENTORY_LLM_SCOPE();
+    if (!IsValid(craftables_collection))
+    {
+        UE_LOG(LogInventorySystem, Error, TEXT("Invalid craftables collection."))
+        return {};
+    }
+    TMap<TSoftObjectPtr<UItemData>, FRecipesSet> mappings;
+    for (auto&& craftable_ptr : craftables_collection->Craftables)
+    {
+        UCraftingRecipe* craftable = craftable_ptr.Get();
+        if (craftable == nullptr)
+        {
+            UE_LOG(LogInventorySystem, Warning, TEXT("Recipe [%s] not loaded, skipped from item mappings."), *craftable_ptr.ToString());
+            continue;
+        }
+        for (auto&& recipe_requirement : craftable->Requirements)
+        {
+            if (!mappings.Contains(recipe_requirement.Item)) mappings.Add(recipe_requirement.Item); // Add item keys we don't have yet.
+            mappings[recipe_requirement.Item].Recipes.Add(craftable);
+        }
+    }
+    return mappings;
+}
+
+TArray<UCraftingRecipe*> UCraftingUtils::getCraftableRecipesForAvailableItems(TMap<UItemData*, int32> available_items, UCraftablesCollection* craftables_collection)
+{
+    INVENTORY_LLM_SCOPE();
+    if (!IsValid(craftables_collection))
+    {
+        UE_LOG(LogInventorySystem, Error, TEXT("Invalid craftables collection."))
+        return {};
+    }
+
+    TArray<UCraftingRecipe*> available_recipes;
+    // For each recipe we want to check whether we have all necessary item requirements and quantity.
+    for (auto&& recipe_ptr : craftables_collection->Craftables)
+    {
+        UCraftingRecipe* recipe = recipe_ptr.Get();
+        if (recipe == nullptr) continue;
+        bool bHasAllRequirements = true;
+        for (auto&& requirement : recipe->Requirements)
+        {
+            // Early out as soon as a requirement is not satisfied. Items that aren't loaded can't be available.
+            const int32* available_quantity = available_items.Find(requirement.Item.Get());
+            if (available_quantity == nullptr || requirement.Quantity > *available_quantity)
+            {
+                bHasAllRequirements = false;
+                break;
+            }
+        }
+        if (bHasAllRequirements) available_recipes.Add(recipe); // Add the recipe if we have everything needed for it
+    }
+
+    return available_recipes;
+}
+
+TMap<UItemData*, int32> UCraftingUtils::generateAvailableItemsFromResources(const FBagResources& in_resources)
+{
+    INVENTORY_LLM_SCOPE();
+    TMap<UItemData*, int32> available_items;
+    for (auto&& resources_data : in_resources.Types)
+    {
+        available_items.Add(resources_data.ResourceData, resources_data.ResourceQuantity);
+    }
+    return available_items;
+}
+
+TArray<FBagCraftability> UCraftingUtils::evaluateCraftablesForBags(const TArray<UInventoryBagComponent*>& bags, UCraftablesCollection* craftables_collection, bool bComputeMaxCrafts)
+{
+    check(IsInGameThread());
+    if (FInventoryTraceRecorder::get().isRecording()) FInventoryTraceRecorder::get().recordEvaluateCraftables(craftables_collection, bags);
+    // Snapshots of unchanged bags are shared, so this is mostly pointer copies.
+    TArray<FInventoryBagSnapshot> snapshots;
+    snapshots.Reserve(bags.Num());
+    TArray<int32> store_bag_indices;
+    for (int32 bag_index = 0; bag_index < bags.Num(); ++bag_index)
+    {
+        UInventoryBagComponent* bag = bags[bag_index];
+        bool const bStoreBag = IsValid(bag) && bag->getStoreHandle().isSet();
+        if (bStoreBag) store_bag_indices.Add(bag_index);
+        snapshots.Add(IsValid(bag) && !bStoreBag ? bag->takeSnapshot() : FInventoryBagSnapshot{});
+    }
+    TArray<FBagCraftability> results = evaluateCraftablesForSnapshots(snapshots, craftables_collection, bComputeMaxCrafts);
+    if (store_bag_indices.Num() == 0 || results.Num() == 0) return results;
+
+    // World store bags can't be snapshotted, they are evaluated here through their quantities. Usually only a few of them.
+    TArray<TArray<FResolvedRecipeRequirement>> recipe_requirements;
+    TBitArray<> loaded_recipes;
+    resolveCollection(craftables_collection, recipe_requirements, loaded_recipes);
+    for (int32 const bag_index : store_bag_indices)
+    {
+        UInventoryBagComponent* bag = bags[bag_index];
+        evaluateCraftability(recipe_requirements, loaded_recipes, bComputeMaxCrafts, [bag](const TArray<FResolvedRecipeRequirement>& requirements)
+        {
+            int32 max_crafts = MAX_int32;
+            for (auto&& requirement : requirements)
+            {
+                max_crafts = FMath::Min(max_crafts, bag->getItemQuantity(const_cast<UItemData*>(requirement.Item)) / requirement.Quantity);
+                if (max_crafts == 0) break;
+            }
+            return max_crafts;
+        }, results[bag_index]);
+    }
+    return results;
+}
+
+TArray<FBagCraftability> UCraftingUtils::evaluateCraftablesForSnapshots(TArrayView<const FInventoryBagSnapshot> snapshots, UCraftablesCollection* craftables_collection, bool bComputeMaxCrafts)
+{
+    INVENTORY_LLM_SCOPE();
+    SCOPE_CYCLE_COUNTER(STAT_CraftingEvaluateBatch);
+    if (!IsValid(craftables_collection))
+    {
+        UE_LOG(LogInventorySystem, Error, TEXT("Invalid craftables collection."))
+        return {};
+    }
+
+    // Resolve recipes and their items here, workers only read plain pointers.
+    TArray<TArray<FResolvedRecipeRequirement>> recipe_requirements;
+    TBitArray<> loaded_recipes;
+    resolveCollection(craftables_collection, recipe_requirements, loaded_recipes);
+
+    TArray<FBagCraftability> results;
+    results.SetNum(snapshots.Num());
+    // Each bag only writes its own result, no synchronization needed.
+    ParallelFor(snapshots.Num(), [&](int32 const bag_index)
+    {
+        const FInventoryBagSnapshot& snapshot = snapshots[bag_index];
+        if (!snapshot.isValid()) return;
+        evaluateCraftability(recipe_requirements, loaded_recipes, bComputeMaxCrafts,
+                             [&snapshot](const TArray<FResolvedRecipeRequirement>& requirements) { return snapshot.getMaxCrafts(requirements); },
+                             results[bag_index]);
+    }, CVarCraftingBatchSingleThread.GetValueOnAnyThread() != 0);
+    return results;
+}
+
+TArray<int32> UCraftingUtils::getItemQuantityForBags(const TArray<UInventoryBagComponent*>& bags, UItemData* item_data)
+{
+    INVENTORY_LLM_SCOPE();
+    // A quantity is a single map lookup, not worth spreading across threads.
+    TArray<int32> quantities;
+    quantities.Reserve(bags.Num());
+    for (UInventoryBagComponent* bag : bags) quantities.Add(IsValid(bag) && IsValid(item_data) ? bag->getItemQuantity(item_data) : 0);
+    return quantities;
+}
@@ -1,700 +1,2108 @@
-﻿#include "InventoryBagComponent.h"
-#include "Item.h"
-#include "Engine/AssetManager.h"
-#include "Engine/World.h"
-#include "Kismet/GameplayStatics.h"
-
-/**
- * Provides a safe way to grab an item id from a pool,
- * automatically returning it to the pool if the transaction is not committed before leaving the scope.
- */
-struct FScopedItemPoolIdTransaction
-{
-    FScopedItemPoolIdTransaction(TArray<int32>& id_pool) : pool(id_pool)
-    {
-        bCommitted = false;
-        id = pool.Pop();
-    }
-
-    int32 Id() const { return id; }
-    void commit() { bCommitted = true; }
-    ~FScopedItemPoolIdTransaction() { if (!bCommitted) pool.Push(id); }
-
-private:
-
-    int32 id;
-    bool bCommitted;
-    TArray<int32>& pool;
-};
-
-UInventoryBagComponent::UInventoryBagComponent()
-{
-}
-
-FInventoryBagAddItemResult UInventoryBagComponent::addItemComponent(UItemComponent* item)
-{
-    // Safety, item already present and valid limits checks
-    if (!IsValid(item) || !isValidItemData(item->ItemData) || !hasAvailableIds() || !hasValidItemLimits(item->ItemData))
-    {
-        UE_LOG(LogInventorySystem, Display, TEXT("Can't add item [%s] to bag [%s]"), IsValid(item) ? *item->GetPathName() : TEXT("InvalidItem"), *GetPathName());
-        return {false, -1};
-    }
-
-    // We have a valid item and ID is available. We can try to add the item.
-    // If anything fails we should push back the ID we were going to use.
-    FScopedItemPoolIdTransaction id_transaction{item_ids_pool};
-    UItemData* item_data = item->ItemData;
-    if (!tryAddItem(item_data, id_transaction.Id(), item)) return {false, -1};
-
-    id_transaction.commit();
-    item_comp_to_id.Add(item, id_transaction.Id());
-    UE_LOG(LogInventorySystem, Display, TEXT("Item [%s] added to bag [%s]"), *item->GetPathName(), *GetPathName());
-    item->Execute_OnItemPickedUp(item, this);
-    OnInventoryBagUpdated.Broadcast(this);
-    return {true, id_transaction.Id()};
-}
-
-FInventoryBagRemoveItemResult UInventoryBagComponent::removeItemComponent(UItemComponent* item, bool bAllowActorSpawn)
-{
-    // Safety checks
-    if (!IsValid(item) || !isValidItemData(item->ItemData))
-    {
-        UE_LOG(LogInventorySystem, Display, TEXT("Can't remove item [%s] from bag [%s]"), IsValid(item) ? *item->GetPathName() : TEXT("InvalidItem"), *GetPathName());
-        return {false, -1};
-    }
-
-    int32* remove_id_ptr = item_comp_to_id.Find(item); // Find item id from component
-    if (remove_id_ptr == nullptr)
-    {
-        UE_LOG(LogInventorySystem, Display, TEXT("Can't remove item [%s] from bag [%s]. Item not found."), *item->GetPathName(), *GetPathName());
-        return {false, -1};
-    }
-    int32 remove_id = *remove_id_ptr;
-    UItemData* item_data = item->ItemData;
-    if (!tryRemoveItem(item_data, remove_id)) return {false};
-
-    // Recover the used id for later use, spawn wanted actor and trigger dropped event.
-    item_ids_pool.Push(remove_id);
-    item->Execute_OnItemDropped(item, this);
-    AActor* spawn_actor = nullptr;
-    if (bAllowActorSpawn && IsValid(item_data->OnDropSpawnedActor))
-    {
-        spawn_actor = GetWorld()->SpawnActor(item_data->OnDropSpawnedActor);
-        UItemComponent* actor_item_comp = Cast<UItemComponent>(spawn_actor->GetComponentByClass(UItemComponent::StaticClass()));
-        if (actor_item_comp != nullptr) actor_item_comp->OnItemDropped(this);
-    }
-    UE_LOG(LogInventorySystem, Display, TEXT("Item [%s] removed from bag [%s]"), *item->GetPathName(), *GetPathName());
-    OnInventoryBagUpdated.Broadcast(this);
-    return {true, remove_id, spawn_actor};
-}
-
-UItemComponent* UInventoryBagComponent::getItemComponentFromId(int32 id)
-{
-    UItemComponent* const* item_comp = item_comp_to_id.FindKey(id);
-    if (item_comp != nullptr)
-    {
-        // Item component might have been destroyed.
-        // Maybe the user added the item via item component and then destroyed the owning actor.
-        if (IsValid(*item_comp)) return *item_comp;
-
-        // Clear out NULL (deleted) components.
-        UE_LOG(LogInventorySystem, Warning,
-               TEXT(
-                   "You have removed an item that was registered as an item component but that does not exist anymore. That most likely means its owning actor was deleted. If you immediately delete an item actor on pickup consider just adding the item data to the bag."
-               ));
-        item_comp_to_id.Remove(*item_comp);
-    }
-    UE_LOG(LogInventorySystem, Display, TEXT("Can't find item with id [%d] in bag [%s]."), id, *GetPathName());
-    return nullptr;
-}
-
-FInventoryBagAddItemResult UInventoryBagComponent::addItem(UItemData* item_data)
-{
-    if (!isValidItemData(item_data) || !hasAvailableIds() || !hasValidItemLimits(item_data))
-    {
-        UE_LOG(LogInventorySystem, Display, TEXT("Can't add item [%s] to bag [%s]"), IsValid(item_data) ? *item_data->GetPathName() : TEXT("InvalidItem"), *GetPathName());
-        return {false, -1};
-    }
-
-    // We have a valid item and ID is available. We can try to add the item.
-    // If anything fails we should push back the ID we were going to use.
-    FScopedItemPoolIdTransaction id_transaction{item_ids_pool};
-    if (!tryAddItem(item_data, id_transaction.Id())) return {false, -1};
-
-    id_transaction.commit();
-    UE_LOG(LogInventorySystem, Display, TEXT("Item [%s] added to bag [%s]"), *item_data->GetPathName(), *GetPathName());
-    OnInventoryBagUpdated.Broadcast(this);
-    return {true, id_transaction.Id()};
-}
-
-FInventoryBagRemoveItemResult UInventoryBagComponent::removeItem(UItemData* item_data, bool bAllowActorSpawn)
-{
-    if (!isValidItemData(item_data))
-    {
-        UE_LOG(LogInventorySystem, Display, TEXT("Can't remove item [%s] from bag [%s]"), IsValid(item_data) ? *item_data->GetPathName() : TEXT("InvalidItem"), *GetPathName());
-        return {false};
-    }
-
-    int32 remove_id = -1; // Remove from last slot.
-    if (!tryRemoveItem(item_data, remove_id)) return {false};
-
-    // Recover the used id for later use, spawn wanted actor and trigger dropped event.
-    item_ids_pool.Push(remove_id);
-    // Find whether one of the registered item components has the id we want to remove.
-    UItemComponent* const* item_comp = item_comp_to_id.FindKey(remove_id);
-    if (item_comp != nullptr)
-    {
-        // Item component might have been destroyed.
-        // Maybe the user added the item via item component and then destroyed the owning actor.
-        if (IsValid(*item_comp))
-        {
-            (*item_comp)->Execute_OnItemDropped(*item_comp, this);
-        }
-        else
-        {
-            UE_LOG(LogInventorySystem, Warning,
-                   TEXT(
-                       "You have removed an item that was registered as an item component but that does not exist anymore. That most likely means its owning actor was deleted. If you immediately delete an item actor on pickup consider just adding the item data to the bag."
-                   ));
-        }
-        item_comp_to_id.Remove(*item_comp); // This will also clear out NULL (deleted) components.
-    }
-    AActor* spawn_actor = nullptr;
-    if (bAllowActorSpawn && IsValid(item_data->OnDropSpawnedActor))
-    {
-        spawn_actor = GetWorld()->SpawnActor(item_data->OnDropSpawnedActor);
-        UItemComponent* actor_item_comp = Cast<UItemComponent>(spawn_actor->GetComponentByClass(UItemComponent::StaticClass()));
-        if (actor_item_comp != nullptr) actor_item_comp->Execute_OnItemDropped(actor_item_comp, this);
-    }
-    UE_LOG(LogInventorySystem, Display, TEXT("Item [%s] removed from bag [%s]"), *item_data->GetPathName(), *GetPathName());
-    OnInventoryBagUpdated.Broadcast(this);
-    return {true, remove_id, spawn_actor};
-}
-
-int32 UInventoryBagComponent::getItemQuantity(UItemData* item_data)
-{
-    if (!isValidItemData(item_data))
-    {
-        UE_LOG(LogInventorySystem, Display, TEXT("Invalid item data."), IsValid(item_data) ? *item_data->GetPathName() : TEXT("InvalidItem"), *GetPathName());
-        return 0;
-    }
-
-    switch (item_data->Category)
-    {
-    case EItemCategory::Resource:
-        {
-            UResourceData* resource_data = Cast<UResourceData>(item_data);
-            if (resource_data == nullptr)
-            {
-                UE_LOG(LogInventorySystem, Error, TEXT("Invalid resource data type [%s]"), *GetPathName());
-                return false;
-            }
-            return Resources.Data.Contains(resource_data) ? Resources.Data[resource_data].ResourceQuantity : 0;
-        }
-    case EItemCategory::Tool:
-        {
-            UToolData* tool_data = Cast<UToolData>(item_data);
-            if (tool_data == nullptr)
-            {
-                UE_LOG(LogInventorySystem, Error, TEXT("Invalid tool data type [%s]"), *GetPathName());
-                return false;
-            }
-            return Tools.Data.Contains(tool_data) ? Tools.Data[tool_data].ToolQuantity : 0;
-        }
-    case EItemCategory::None: ;
-    default:
-        {
-            UE_LOG(LogInventorySystem, Warning, TEXT("Invalid item category [%s]"), *GetPathName());
-            return false;
-        }
-    }
-}
-
-bool UInventoryBagComponent::updateToolDurability(UToolComponent* tool, int32 const durability)
-{
-    if (!IsValid(tool) || !isValidItemData(tool->ItemData))
-    {
-        UE_LOG(LogInventorySystem, Display, TEXT("Invalid item [%s]"), IsValid(tool) ? *tool->GetPathName() : TEXT("InvalidTool"));
-        return false;
-    }
-
-    int32* tool_id_ptr = item_comp_to_id.Find(tool);
-    if (tool_id_ptr == nullptr)
-    {
-        UE_LOG(LogInventorySystem, Display, TEXT("Tool [%s] not found in bag [%s]."), *tool->GetPathName(), *GetPathName());
-        return false;
-    }
-    int32 const tool_id = *tool_id_ptr;
-    UToolData* tool_data = Cast<UToolData>(tool->ItemData);
-    if (tool_data == nullptr)
-    {
-        UE_LOG(LogInventorySystem, Error, TEXT("Invalid tool data type [%s]"), *tool->GetPathName());
-    }
-
-    check(Tools.Data.Contains(tool_data)); // Tools with valid ID should always be mapped.
-    // Search for the tool with matching ID.
-    // IMPROV: Maybe keep updated info to avoid searching by tool ID.
-    for (auto&& slot : Tools.Data[tool_data].Slots)
-    {
-        for (auto&& tool_info : slot.ToolsInfo)
-        {
-            if (tool_info.ToolId == tool_id)
-            {
-                tool_info.Durability = durability;
-                OnToolSlotUpdated.Broadcast(this, tool_data, slot.Id, slot);
-                return true;
-            }
-        }
-    }
-    checkNoEntry(); // Shouldn't be able to get here since if we have a tool_comp->id mapping the tool should be found in one of the slots
-    return false;
-}
-
-void UInventoryBagComponent::BeginPlay()
-{
-    Super::BeginPlay();
-    streamInLimits();
-
-    // Init tool id pool
-    item_ids_pool.AddUninitialized(BagProperties->MaxItemId);
-    for (int i = 0; i < item_ids_pool.Num(); ++i)
-    {
-        item_ids_pool[i] = i;
-    }
-    // Init slot id pool
-    slot_ids_pool.AddUninitialized(BagProperties->MaxToolsSlots + BagProperties->MaxResourceSlots);
-    for (int i = 0; i < slot_ids_pool.Num(); ++i)
-    {
-        slot_ids_pool[i] = i;
-    }
-}
-
-bool UInventoryBagComponent::tryAddItem(UItemData* item_data, int32 const id, UItemComponent* item_component /** = nullptr */)
-{
-    check(IsValid(item_data));
-
-    switch (item_data->Category)
-    {
-    case EItemCategory::Resource:
-        {
-            UResourceData* resource_data = Cast<UResourceData>(item_data);
-            if (resource_data == nullptr)
-            {
-                UE_LOG(LogInventorySystem, Error, TEXT("Trying to add resource with invalid resource data type to the bag [%s]"), *GetPathName());
-                return false;
-            }
-            return tryAddResource(resource_data, id);
-        }
-    case EItemCategory::Tool:
-        {
-            UToolData* tool_data = Cast<UToolData>(item_data);
-            int32 durability = tool_data->MaxDurability;
-            if (item_component != nullptr)
-            {
-                UToolComponent* tool_component = Cast<UToolComponent>(item_component);
-                if (tool_component == nullptr)
-                {
-                    UE_LOG(LogInventorySystem, Error, TEXT("Trying to add invalid tool to the bag [%s]"), *GetPathName());
-                    return false;
-                }
-                durability = tool_component->Durability;
-            }
-            if (tool_data == nullptr)
-            {
-                UE_LOG(LogInventorySystem, Error, TEXT("Trying to add tool with invalid tool data type to the bag [%s]"), *GetPathName());
-                return false;
-            }
-            return tryAddTool(tool_data, id, durability);
-        }
-    case EItemCategory::None: ;
-    default:
-        {
-            UE_LOG(LogInventorySystem, Warning, TEXT("Trying to add item with invalid category to the bag [%s]"), *GetPathName());
-            return false;
-        }
-    }
-}
-
-bool UInventoryBagComponent::tryRemoveItem(UItemData* item_data, int32& remove_id)
-{
-    check(IsValid(item_data));
-
-    // Remove tool or resource?
-    switch (item_data->Category)
-    {
-    case EItemCategory::Resource:
-        {
-            UResourceData* resource_data = Cast<UResourceData>(item_data);
-            if (resource_data == nullptr)
-            {
-                UE_LOG(LogInventorySystem, Error, TEXT("Trying to remove resource with invalid resource data type from the bag [%s]"), *GetPathName());
-                return false;
-            }
-            return tryRemoveResource(resource_data, remove_id);
-        }
-    case EItemCategory::Tool:
-        {
-            UToolData* tool_data = Cast<UToolData>(item_data);
-            if (tool_data == nullptr)
-            {
-                UE_LOG(LogInventorySystem, Error, TEXT("Trying to remove tool with invalid tool data type from the bag [%s]"), *GetPathName());
-                return false;
-            }
-            return tryRemoveTool(tool_data, remove_id);
-        }
-    case EItemCategory::None: ;
-    default:
-        {
-            UE_LOG(LogInventorySystem, Warning, TEXT("Trying to remove item with invalid category from the bag [%s]"), *GetPathName());
-            return false;
-        }
-    }
-}
-
-bool UInventoryBagComponent::tryAddResource(UResourceData* resource_data, int32 const id)
-{
-    checkf(BagProperties->Limits[resource_data].Get() != nullptr,
-           TEXT("%s should be loaded by now but it's not. Check why that happens. It should get loaded since hasValidLimits -called before tryAdd- loads the objects of the map."),
-           *resource_data->GetPathName());
-    UItemBagLimit const* const bag_limit = BagProperties->Limits.FindRef(resource_data).Get();
-    // 0 max quantity limit check should already be performed at this point.
-    check(bag_limit->MaxQuantity > 0 && bag_limit->MaxStackSize > 0);
-
-    // This will point to either newly added resources data or already present one.
-    // Just a cache to avoid a double find on the map.
-    FBagResourcesData* resources_data;
-
-    // Check if we already have data for this resource type.
-    // See if we can add another slot in case we need it.
-    if (!Resources.Data.Contains(resource_data))
-    {
-        if (Resources.UsedSlots >= BagProperties->MaxResourceSlots)
-        {
-            UE_LOG(LogInventorySystem, Verbose, TEXT("Can't add another resource slot. Max slots capacity reached for bag [%s]."), *GetPathName());
-            return false;
-        }
-        resources_data = &Resources.Data.Emplace(resource_data, FBagResourcesData());
-        UE_LOG(LogInventorySystem, Verbose, TEXT("Added new resource type [%s] to bag [%s]."), *resource_data->GetPathName(), *GetPathName());
-    }
-    else resources_data = Resources.Data.Find(resource_data);
-
-    // We can now treat both paths (newly added resource type and already present resource type) the same way.
-    if (resources_data->ResourceQuantity >= bag_limit->MaxQuantity)
-    {
-        UE_LOG(LogInventorySystem, Verbose, TEXT("Can't add resource. Max quantity capacity reached for bag [%s]."), *GetPathName());
-        return false;
-    }
-
-    // Find first slot with free space.
-    for (auto&& slot : resources_data->Slots)
-    {
-        if (slot.ResourceIds.Num() < bag_limit->MaxStackSize)
-        {
-            slot.ResourceIds.Add(id);
-            ++resources_data->ResourceQuantity;
-            OnResourceSlotUpdated.Broadcast(this, resource_data, slot.Id, slot);
-            return true;
-        }
-    }
-
-    // No free slot, try to create one if possible.
-    if (Resources.UsedSlots >= BagProperties->MaxResourceSlots)
-    {
-        UE_LOG(LogInventorySystem, Verbose, TEXT("Can't add another resource slot. Max slots capacity reached for bag [%s]."), *GetPathName());
-        return false;
-    }
-    // Add new slot and add item to it
-    FBagResourceSlot& new_slot = resources_data->Slots[resources_data->Slots.Add({slot_ids_pool.Pop()})];
-    new_slot.ResourceIds.Add(id);
-    ++Resources.UsedSlots;
-    UE_LOG(LogInventorySystem, Verbose, TEXT("Added new resource slot to bag [%s]."), *GetPathName());
-    ++resources_data->ResourceQuantity;
-    OnResourceSlotAdded.Broadcast(this, resource_data, new_slot.Id, new_slot);
-    return true;
-}
-
-bool UInventoryBagComponent::tryRemoveResource(UResourceData* resource_data, int32& remove_id)
-{
-    check(IsValid(resource_data) && remove_id >= -1);
-
-    FBagResourcesData* bag_resources_data_ptr = Resources.Data.Find(resource_data);
-    // We actually don't have this kind of resource type.
-    if (bag_resources_data_ptr == nullptr)
-    {
-        UE_LOG(LogInventorySystem, Display, TEXT("Can't remove item [%s] from bag [%s]. No resource of this type found."), *resource_data->GetPathName(), *GetPathName());
-        return false;
-    }
-
-    FBagResourcesData& bag_resources_data = *bag_resources_data_ptr;
-    check(bag_resources_data.ResourceQuantity > 0); // Since we remove any resource data mapping when the quantity reaches 0, this should be an error if hit.
-
-    FBagResourceSlot* selected_resource_slot = nullptr;
-    // Just remove the last item from the last slot
-    if (remove_id == -1)
-    {
-        selected_resource_slot = &bag_resources_data.Slots.Last();
-        check(selected_resource_slot->ResourceIds.Num() > 0); // We remove empty slots. Count as error if this happens.
-        remove_id = selected_resource_slot->ResourceIds.Pop();
-    }
-    else // Or search for the specified item ID in all the slots.
-    {
-        for (auto&& slot : bag_resources_data.Slots)
-        {
-            check(selected_resource_slot->ResourceIds.Num() > 0); // We remove empty slots. Count as error if this happens.
-            int const removed_count = slot.ResourceIds.Remove(remove_id);
-            check(removed_count <= 1); // Should only ever have unique ids
-            // Early out when we find the item.
-            if (removed_count > 0)
-            {
-                selected_resource_slot = &slot;
-                break;
-            }
-        }
-    }
-
-    // When searching for a specific ID we might not actually
-    // have it (ideally shouldn't happen), hence the slot could not be found.
-    if (selected_resource_slot == nullptr)
-    {
-        UE_LOG(LogInventorySystem, Display, TEXT("Can't remove item [%s] from bag [%s]. Resource with ID [%d] not found."), *resource_data->GetPathName(), *GetPathName(), remove_id);
-        return false;
-    }
-
-    // Check for empty slot and remove it
-    bool bSlotRemoved = false;
-    const int32 removed_slot_id = selected_resource_slot->Id; // Save the id in case we remove the slot data.
-    if (selected_resource_slot->ResourceIds.Num() == 0)
-    {
-        bag_resources_data.Slots.RemoveSingleSwap(*selected_resource_slot);
-        UE_LOG(LogInventorySystem, Verbose, TEXT("Removed one resource slot [type: %s] from bag [%s]."), *resource_data->GetPathName(), *GetPathName(), remove_id);
-        --Resources.UsedSlots;
-        slot_ids_pool.Push(removed_slot_id);
-        bSlotRemoved = true;
-    }
-    --bag_resources_data.ResourceQuantity;
-    // Remove mappings when we don't have any more resources of this type
-    if (bag_resources_data.ResourceQuantity == 0)
-    {
-        UE_LOG(LogInventorySystem, Verbose, TEXT("Removed resource mapping [type: %s] from bag [%s]."), *resource_data->GetPathName(), *GetPathName(), remove_id);
-        Resources.Data.Remove(resource_data);
-    }
-
-    if (bSlotRemoved) OnResourceSlotRemoved.Broadcast(this, resource_data, removed_slot_id, {removed_slot_id});
-    else OnResourceSlotUpdated.Broadcast(this, resource_data, selected_resource_slot->Id, *selected_resource_slot);
-    return true;
-}
-
-bool UInventoryBagComponent::tryAddTool(UToolData* tool_data, int32 const id, int32 const durability)
-{
-    checkf(BagProperties->Limits[tool_data].Get() != nullptr,
-           TEXT("%s should be loaded by now but it's not. Check why that happens. It should get loaded since hasValidLimits -called before tryAdd- loads the objects of the map."),
-           *tool_data->GetPathName());
-    UItemBagLimit const* const bag_limit = BagProperties->Limits.FindRef(tool_data).Get();
-    // 0 max quantity limit check should already be performed at this point.
-    check(bag_limit->MaxQuantity > 0 && bag_limit->MaxStackSize > 0);
-
-    // This will point to either newly added tools data or already present one.
-    // Just a cache to avoid a double find on the map.
-    FBagToolsData* tools_data;
-    // Check if we already have data for this tool type.
-    // See if we can add another slot in case we need it.
-    if (!Tools.Data.Contains(tool_data))
-    {
-        if (Tools.UsedSlots >= BagProperties->MaxResourceSlots)
-        {
-            UE_LOG(LogInventorySystem, Verbose, TEXT("Can't add another tool slot. Max slots capacity reached for bag [%s]."), *GetPathName());
-            return false;
-        }
-        tools_data = &Tools.Data.Emplace(tool_data, FBagToolsData());
-        UE_LOG(LogInventorySystem, Verbose, TEXT("Added new tool type [%s] to bag [%s]."), *tool_data->GetPathName(), *GetPathName());
-    }
-    else tools_data = Tools.Data.Find(tool_data);
-
-    // We can now treat both paths (newly added tool type and already present tool type) the same way.
-    if (tools_data->ToolQuantity >= bag_limit->MaxQuantity)
-    {
-        UE_LOG(LogInventorySystem, Verbose, TEXT("Can't add tool. Max quantity capacity reached for bag [%s]."), *GetPathName());
-        return false;
-    }
-
-    // Find first slot with free space.
-    for (auto&& slot : tools_data->Slots)
-    {
-        if (slot.ToolsInfo.Num() < bag_limit->MaxStackSize)
-        {
-            slot.ToolsInfo.Add({id, durability});
-            ++tools_data->ToolQuantity;
-            OnToolSlotUpdated.Broadcast(this, tool_data, slot.Id, slot);
-            return true;
-        }
-    }
-
-    // No free slot, try to create one if possible.
-    if (Tools.UsedSlots >= BagProperties->MaxResourceSlots)
-    {
-        UE_LOG(LogInventorySystem, Verbose, TEXT("Can't add another tool slot. Max slots capacity reached for bag [%s]."), *GetPathName());
-        return false;
-    }
-
-    // Add new slot and add item to it
-    FBagToolSlot& new_slot = tools_data->Slots[tools_data->Slots.Add({slot_ids_pool.Pop()})];
-    new_slot.ToolsInfo.Add({id, durability});
-    ++Tools.UsedSlots;
-    UE_LOG(LogInventorySystem, Verbose, TEXT("Added new tool slot to bag [%s]."), *GetPathName());
-    ++tools_data->ToolQuantity;
-    OnToolSlotAdded.Broadcast(this, tool_data, new_slot.Id, new_slot);
-    return true;
-}
-
-bool UInventoryBagComponent::tryRemoveTool(UToolData* tool_data, int32& remove_id)
-{
-    check(IsValid(tool_data) && remove_id >= -1);
-
-    FBagToolsData* bag_tools_data_ptr = Tools.Data.Find(tool_data);
-    // We actually don't have this kind of tool type.
-    if (bag_tools_data_ptr == nullptr)
-    {
-        UE_LOG(LogInventorySystem, Display, TEXT("Can't remove item [%s] from bag [%s]. No tool of this type found."), *tool_data->GetPathName(), *GetPathName());
-        return false;
-    }
-
-    FBagToolsData& bag_tools_data = *bag_tools_data_ptr;
-    check(bag_tools_data.ToolQuantity > 0); // Since we remove any tool data mapping when the quantity reaches 0, this should be an error if hit.
-
-    FBagToolSlot* selected_tool_slot = nullptr;
-    // Just remove the last item from the last slot
-    if (remove_id == -1)
-    {
-        selected_tool_slot = &bag_tools_data.Slots.Last();
-        check(selected_tool_slot->ToolsInfo.Num() > 0); // We remove empty slots. Count as error if this happens.
-        remove_id = selected_tool_slot->ToolsInfo.Pop().ToolId;
-    }
-    else // Or search for the specified item ID in all the slots.
-    {
-        for (auto&& slot : bag_tools_data.Slots)
-        {
-            check(slot.ToolsInfo.Num() > 0); // We remove empty slots. Count as error if this happens.
-            int const removed_count = slot.ToolsInfo.RemoveAll([remove_id](FBagToolInfo& tool_info) { return tool_info.ToolId == remove_id; });
-            check(removed_count <= 1); // Should only ever have unique ids
-            // Early out when we find the item.
-            if (removed_count > 0)
-            {
-                selected_tool_slot = &slot;
-                break;
-            }
-        }
-    }
-
-    // When searching for a specific ID we might not actually
-    // have it (ideally shouldn't happen), hence the slot could not be found.
-    if (selected_tool_slot == nullptr)
-    {
-        UE_LOG(LogInventorySystem, Display, TEXT("Can't remove item [%s] from bag [%s]. Tool with ID [%d] not found."), *tool_data->GetPathName(), *GetPathName(), remove_id);
-        return false;
-    }
-
-    // Check for empty slot and remove it
-    bool bSlotRemoved = false;
-    const int32 removed_slot_id = selected_tool_slot->Id; // Save the id in case we remove the slot data.
-    if (selected_tool_slot->ToolsInfo.Num() == 0)
-    {
-        bag_tools_data.Slots.RemoveSingleSwap(*selected_tool_slot);
-        UE_LOG(LogInventorySystem, Verbose, TEXT("Removed one tool slot [type: %s] from bag [%s]."), *tool_data->GetPathName(), *GetPathName(), remove_id);
-        --Tools.UsedSlots;
-        slot_ids_pool.Push(removed_slot_id);
-        bSlotRemoved = true;
-    }
-    --bag_tools_data.ToolQuantity;
-    // Remove mappings when we don't have any more resources of this type
-    if (bag_tools_data.ToolQuantity == 0)
-    {
-        UE_LOG(LogInventorySystem, Verbose, TEXT("Removed tool mapping [type: %s] from bag [%s]."), *tool_data->GetPathName(), *GetPathName(), remove_id);
-        Tools.Data.Remove(tool_data);
-    }
-
-    if (bSlotRemoved) OnToolSlotRemoved.Broadcast(this, tool_data, removed_slot_id, {removed_slot_id});
-    else OnToolSlotUpdated.Broadcast(this, tool_data, selected_tool_slot->Id, *selected_tool_slot);
-    return true;
-}
-
-bool UInventoryBagComponent::isValidItemData(UItemData* item_data) const
-{
-    if (!IsValid(item_data))
-    {
-        UE_LOG(LogInventorySystem, Error, TEXT("Invalid item data for bag [%s]"), *GetPathName());
-        return false;
-    }
-    return true;
-}
-
-bool UInventoryBagComponent::hasValidItemLimits(UItemData* item_data) const
-{
-    if (!IsValid(item_data))
-    {
-        UE_LOG(LogInventorySystem, Error, TEXT("Invalid bag limits [Bag: %s] for null/invalid item_data."), *GetPathName());
-        return false;
-    }
-    if (!BagProperties->Limits.Contains(item_data))
-    {
-        UE_LOG(LogInventorySystem, Error, TEXT("Invalid bag limits [Bag: %s] for item: %s"), *GetPathName(), *item_data->GetPathName());
-        return false;
-    }
-
-    // Check if we've completed loading.
-    checkf(limits_stream_handle.IsValid() && !limits_stream_handle->WasCanceled(), TEXT("Streaming handle should not be invalid since we start streaming in on beginplay."));
-    if (limits_stream_handle->IsLoadingInProgress()) limits_stream_handle->WaitUntilComplete();
-    checkf(IsValid(BagProperties->Limits[item_data].Get()), TEXT("Asset should be loaded by now."));
-
-    // You usually wouldn't have items with 0 max quantity.
-    if (BagProperties->Limits[item_data]->MaxQuantity <= 0)
-    {
-        UE_LOG(LogInventorySystem, Display, TEXT("Can't add item [%s] to bag [%s]. Max ResourceQuantity = 0"), *item_data->GetPathName(), *GetPathName());
-        return false;
-    }
-    return true;
-}
-
-bool UInventoryBagComponent::hasAvailableIds() const
-{
-    if (item_ids_pool.Num() == 0)
-    {
-        UE_LOG(LogInventorySystem, Display, TEXT("Trying to add item with no more available ids for the bag [%s]"), *GetPathName());
-        return false;
-    }
-    return true;
-}
-
-void UInventoryBagComponent::streamInLimits()
-{
-    if (!IsValid(BagProperties))
-    {
-        UE_LOG(LogInventorySystem, Error, TEXT("Invalid bag properties. [Bag: %s]"), *this->GetPathName());
-        return;
-    }
-    if (!UAssetManager::IsValid())
-    {
-        UE_LOG(LogInventorySystem, Error, TEXT("Asset manager unavailable, can't stream in required assets"));
-        return;
-    }
-
-    TArray<FSoftObjectPath> stream_in_assets;
-    for (auto&& limit : BagProperties->Limits)
-    {
-        stream_in_assets.Add(limit.Key.ToSoftObjectPath());
-        stream_in_assets.Add(limit.Value.ToSoftObjectPath());
-    }
-    if (stream_in_assets.Num() == 0)
-    {
-        UE_LOG(LogInventorySystem, Warning, TEXT("No assets found in bag properties limits to stream. [Bag: %s]"), *this->GetPathName());
-        return;
-    }
-
-    limits_stream_handle = UAssetManager::GetStreamableManager().RequestAsyncLoad(stream_in_assets,
-                                                                                  FStreamableDelegate::CreateUObject(this, &UInventoryBagComponent::handleLimitsStreamedInCompleted),
-                                                                                  FStreamableManager::AsyncLoadHighPriority);
-}
-
-void UInventoryBagComponent::handleLimitsStreamedInCompleted() const
-{
-    UE_LOG(LogInventorySystem, Log, TEXT("Completed loading of bag props limits objects. [Bag: %s]"), *this->GetPathName());
-}
+﻿#include "InventoryBagComponent.h"
+#include "Item.h"
+#include "InventoryTraceRecorder.h"
+#include "Engine/AssetManager.h"
+#include "Engine/World.h"
+#include "Kismet/GameplayStatics.h"
+#include "Misc/ScopeRWLock.h"
+
+DECLARE_CYCLE_STAT(TEXT("Add Item"), STAT_InventoryBagAddItem, STATGROUP_InventorySystem);
+DECLARE_CYCLE_STAT(TEXT("Add Items (Bulk)"), STAT_InventoryBagAddItems, STATGROUP_InventorySystem);
+DECLARE_CYCLE_STAT(TEXT("Remove Item"), STAT_InventoryBagRemoveItem, STATGROUP_InventorySystem);
+DECLARE_CYCLE_STAT(TEXT("Commit Transaction"), STAT_InventoryBagCommitTransaction, STATGROUP_InventorySystem);
+DECLARE_CYCLE_STAT(TEXT("Transfer Items"), STAT_InventoryBagTransfer, STATGROUP_InventorySystem);
+DECLARE_CYCLE_STAT(TEXT("Tool Durability (Bulk)"), STAT_InventoryBagToolDurability, STATGROUP_InventorySystem);
+
+namespace
+{
+    /**
+     * Computes how many slots a type gains (or loses) when removing items from its last slots and then adding items to it.
+     * Mirrors what tryRemove*(-1) and tryAdd* do one item at a time.
+     */
+    template <typename TSlot>
+    int32 computeSlotsDelta(const TArray<TSlot>& slots, int32 remove_quantity, int32 const add_quantity, int32 const max_stack_size)
+    {
+        // Removes pop from the last slot, dropping slots as they get empty.
+        int32 remaining_slots = slots.Num();
+        int32 last_slot_removed = 0;
+        while (remove_quantity > 0 && remaining_slots > 0)
+        {
+            int32 const last_count = slots[remaining_slots - 1].Num();
+            if (remove_quantity < last_count)
+            {
+                last_slot_removed = remove_quantity;
+                break;
+            }
+            remove_quantity -= last_count;
+            --remaining_slots;
+        }
+
+        // Adds fill any free space left in the remaining slots before creating new ones.
+        int32 free_space = 0;
+        for (int32 i = 0; i < remaining_slots; ++i)
+        {
+            int32 const count = slots[i].Num() - (i == remaining_slots - 1 ? last_slot_removed : 0);
+            free_space += FMath::Max(0, max_stack_size - count);
+        }
+        int32 const overflow = FMath::Max(0, add_quantity - free_space);
+        int32 const new_slots = (overflow + max_stack_size - 1) / max_stack_size;
+        return remaining_slots + new_slots - slots.Num();
+    }
+
+    TArray<int32>& getSlotItems(FBagResourceSlot& slot) { return slot.ResourceIds; }
+    TArray<FBagToolInfo>& getSlotItems(FBagToolSlot& slot) { return slot.ToolsInfo; }
+
+    /** Counts the heap allocation about to happen when adding one element to a full array. Should stay at 0 once a bag is warmed up. */
+    template <typename TArrayType>
+    void trackStorageGrowth(const TArrayType& array)
+    {
+        if (array.Num() == array.Max()) INC_DWORD_STAT(STAT_InventoryBagStorageAllocations);
+    }
+
+    /** Counts a heap allocation if func changed the memory held by container, for adds that may or may not grow it (maps, merged changes). */
+    template <typename TContainer>
+    void trackAllocatedSizeGrowth(const TContainer& container, TFunctionRef<void()> func)
+    {
+#if STATS
+        SIZE_T const allocated_size = container.GetAllocatedSize();
+        func();
+        if (container.GetAllocatedSize() != allocated_size) INC_DWORD_STAT(STAT_InventoryBagStorageAllocations);
+#else
+        func();
+#endif
+    }
+
+    /** Takes a recycled array if any, making sure it can hold min_capacity elements without growing. */
+    template <typename TElement>
+    TArray<TElement> takeRecycled(TArray<TArray<TElement>>& recycled, int32 const min_capacity)
+    {
+        TArray<TElement> array = recycled.Num() > 0 ? recycled.Pop(false) : TArray<TElement>();
+        if (array.Max() < min_capacity)
+        {
+            INC_DWORD_STAT(STAT_InventoryBagStorageAllocations);
+            array.Reserve(min_capacity);
+        }
+        return array;
+    }
+
+    /** Keeps an array that is no longer used, along with its allocation, for takeRecycled. */
+    template <typename TElement>
+    void recycle(TArray<TArray<TElement>>& recycled, TArray<TElement>& array)
+    {
+        array.Reset();
+        trackStorageGrowth(recycled);
+        recycled.Push(MoveTemp(array));
+    }
+
+    /**
+     * Fills partially filled slots with items taken from the last slot, popping the last slot once it's empty.
+     * Stops when at most one slot is left partially filled or after max_moves items have been moved.
+     * @return Number of items moved.
+     */
+    template <typename TSlot, typename TItem>
+    int32 compactSlots(TArray<TSlot>& slots, int32& first_free_slot, int32 const max_stack_size, int32 const max_moves, TArray<TArray<TItem>>& recycled_stacks,
+                       TFunctionRef<void(TSlot& slot, int32 old_count)> on_slot_updated,
+                       TFunctionRef<void(int32 slot_id, int32 old_count)> on_slot_removed)
+    {
+        int32 moves = 0;
+        while (moves < max_moves)
+        {
+            while (first_free_slot < slots.Num() && slots[first_free_slot].Num() >= max_stack_size) ++first_free_slot;
+            int32 const last_slot = slots.Num() - 1;
+            if (first_free_slot >= last_slot) break; // Only the last slot can be partially filled, we're done.
+
+            auto& to_items = getSlotItems(slots[first_free_slot]);
+            auto& from_items = getSlotItems(slots[last_slot]);
+            int32 const to_old_count = to_items.Num();
+            int32 const from_old_count = from_items.Num();
+            int32 const move_count = FMath::Min3(max_stack_size - to_old_count, from_old_count, max_moves - moves);
+            to_items.Append(from_items.GetData() + from_old_count - move_count, move_count);
+            from_items.SetNum(from_old_count - move_count, false);
+            moves += move_count;
+
+            on_slot_updated(slots[first_free_slot], to_old_count);
+            if (from_items.Num() > 0) on_slot_updated(slots[last_slot], from_old_count);
+            else
+            {
+                int32 const removed_slot_id = slots[last_slot].Id;
+                recycle(recycled_stacks, from_items);
+                slots.Pop(false);
+                on_slot_removed(removed_slot_id, from_old_count);
+            }
+        }
+        return moves;
+    }
+
+    /** Records the location of each slot of a type and appends their IDs to the slot order. */
+    template <typename TSlot>
+    void indexSlots(UItemData* item_data, const TArray<TSlot>& slots, TArray<FBagSlotLocation>& locations, TArray<int32>& order)
+    {
+        for (int32 slot_index = 0; slot_index < slots.Num(); ++slot_index)
+        {
+            int32 const slot_id = slots[slot_index].Id;
+            if (slot_id >= locations.Num()) locations.SetNum(slot_id + 1);
+            locations[slot_id] = {item_data, slot_index};
+            order.Add(slot_id);
+        }
+    }
+
+    /** Adds a slot just appended to the slots of its type to the slot locations and its sorted slot order. */
+    void indexAddedSlot(UItemData* item_data, int32 const slot_id, int32 const slot_index, TArray<FBagSlotLocation>& locations, TArray<int32>& order)
+    {
+        if (slot_id >= locations.Num()) locations.SetNum(slot_id + 1);
+        locations[slot_id] = {item_data, slot_index};
+        trackStorageGrowth(order);
+        order.Insert(slot_id, Algo::LowerBound(order, slot_id));
+    }
+
+    /** Drops a slot removed by swapping the last slot of its type into its place, which then gets its location patched. */
+    template <typename TSlot>
+    void unindexRemovedSlot(const TArray<TSlot>& slots, int32 const slot_id, TArray<FBagSlotLocation>& locations, TArray<int32>& order)
+    {
+        int32 const slot_index = locations[slot_id].SlotIndex;
+        locations[slot_id] = {};
+        order.RemoveAt(Algo::BinarySearch(order, slot_id), 1, false);
+        if (slots.IsValidIndex(slot_index)) locations[slots[slot_index].Id].SlotIndex = slot_index;
+    }
+
+    SIZE_T getSlotItemsAllocatedSize(const FBagResourceSlot& slot) { return slot.ResourceIds.GetAllocatedSize(); }
+    SIZE_T getSlotItemsAllocatedSize(const FBagToolSlot& slot) { return slot.ToolsInfo.GetAllocatedSize(); }
+
+    /** Memory held by the snapshot data of each type, skipping type and slot data already listed in counted. */
+    template <typename TKey, typename TValueRef>
+    SIZE_T getSnapshotTypesAllocatedSize(const TMap<TKey*, TValueRef>& types, TSet<const void*>& counted)
+    {
+        SIZE_T size = types.GetAllocatedSize();
+        for (auto&& type : types)
+        {
+            const auto& type_data = type.Value.Get();
+            if (counted.Contains(&type_data)) continue;
+            counted.Add(&type_data);
+            size += sizeof(type_data) + type_data.Slots.GetAllocatedSize();
+            for (auto&& slot : type_data.Slots)
+            {
+                if (counted.Contains(&slot.Get())) continue;
+                counted.Add(&slot.Get());
+                size += sizeof(slot.Get()) + getSlotItemsAllocatedSize(slot.Get());
+            }
+        }
+        return size;
+    }
+
+    /** Memory held by a snapshot, skipping the snapshot, type and slot data already listed in counted. */
+    SIZE_T getSnapshotAllocatedSize(const FInventoryBagSnapshotData* snapshot_data, TSet<const void*>& counted)
+    {
+        if (snapshot_data == nullptr || counted.Contains(snapshot_data)) return 0;
+        counted.Add(snapshot_data);
+        return sizeof(FInventoryBagSnapshotData) + snapshot_data->ResourceCategoryQuantities.GetAllocatedSize() + snapshot_data->ToolCategoryQuantities.GetAllocatedSize()
+            + getSnapshotTypesAllocatedSize(snapshot_data->Resources, counted) + getSnapshotTypesAllocatedSize(snapshot_data->Tools, counted);
+    }
+
+    /**
+     * Snapshots the slots of a type, sharing the ones not listed in dirty_slots with the previous snapshot of the type.
+     * Slot IDs changed since the previous snapshot are always dirty, so a clean ID found in it is the same, untouched slot.
+     */
+    template <typename TSlot>
+    TSharedRef<const TBagSnapshotSlots<TSlot>, ESPMode::ThreadSafe> snapshotSlots(const TArray<TSlot>& slots, int32 const quantity,
+                                                                                  const TBagSnapshotSlots<TSlot>* previous, const TSet<int32>& dirty_slots)
+    {
+        TSharedRef<TBagSnapshotSlots<TSlot>, ESPMode::ThreadSafe> snapshot_slots = MakeShared<TBagSnapshotSlots<TSlot>, ESPMode::ThreadSafe>();
+        snapshot_slots->Quantity = quantity;
+        snapshot_slots->Slots.Reserve(slots.Num());
+        for (int32 slot_index = 0; slot_index < slots.Num(); ++slot_index)
+        {
+            const TSlot& slot = slots[slot_index];
+            const TSharedRef<const TSlot, ESPMode::ThreadSafe>* shared_slot = nullptr;
+            if (previous != nullptr && !dirty_slots.Contains(slot.Id))
+            {
+                // Slots mostly keep their position, removals only swap the last slot in.
+                if (previous->Slots.IsValidIndex(slot_index) && previous->Slots[slot_index]->Id == slot.Id) shared_slot = &previous->Slots[slot_index];
+                else shared_slot = previous->Slots.FindByPredicate([&slot](const TSharedRef<const TSlot, ESPMode::ThreadSafe>& entry) { return entry->Id == slot.Id; });
+            }
+            if (shared_slot != nullptr) snapshot_slots->Slots.Add(*shared_slot);
+            else snapshot_slots->Slots.Add(MakeShared<TSlot, ESPMode::ThreadSafe>(slot));
+        }
+        return snapshot_slots;
+    }
+}
+
+/**
+ * Provides a safe way to grab an item id from a pool,
+ * automatically returning it to the pool if the transaction is not committed before leaving the scope.
+ */
+struct FScopedItemPoolIdTransaction
+{
+    FScopedItemPoolIdTransaction(TArray<int32>& id_pool) : pool(id_pool)
+    {
+        bCommitted = false;
+        id = pool.Pop();
+    }
+
+    int32 Id() const { return id; }
+    void commit() { bCommitted = true; }
+    ~FScopedItemPoolIdTransaction() { if (!bCommitted) pool.Push(id); }
+
+private:
+
+    int32 id;
+    bool bCommitted;
+    TArray<int32>& pool;
+};
+
+TOptional<FItemBagLimitValues> UBagProperties::resolveLimit(const UItemData* item_data) const
+{
+    INVENTORY_LLM_SCOPE();
+    if (item_data == nullptr) return {};
+    int32 const type_id = item_data->getTypeId();
+    if (resolved_limits.IsValidIndex(type_id) && resolved_limits[type_id].ItemData.Get() == item_data) return resolved_limits[type_id].Limit;
+
+    TOptional<FItemBagLimitValues> limit;
+    TSoftObjectPtr<UItemData> const item_key{const_cast<UItemData*>(item_data)};
+    if (const FItemBagLimitValues* item_limit = ItemLimits.Find(item_key)) limit = *item_limit;
+    else if (const TSoftObjectPtr<UItemBagLimit>* limit_asset = Limits.Find(item_key))
+    {
+        // Usually streamed in by now, see UInventoryBagComponent::streamInLimits.
+        if (UItemBagLimit const* item_limit_asset = limit_asset->LoadSynchronous()) limit = FItemBagLimitValues{item_limit_asset->MaxStackSize, item_limit_asset->MaxQuantity};
+    }
+    else if (const UResourceData* resource_data = Cast<UResourceData>(item_data))
+    {
+        if (const FItemBagLimitValues* category_limit = ResourceCategoryLimits.Find(resource_data->ResourceCategory)) limit = *category_limit;
+    }
+    else if (const UToolData* tool_data = Cast<UToolData>(item_data))
+    {
+        if (const FItemBagLimitValues* category_limit = ToolCategoryLimits.Find(tool_data->ToolCategory)) limit = *category_limit;
+    }
+    if (!limit.IsSet() && bUseDefaultLimit) limit = DefaultLimit;
+
+    if (type_id != INDEX_NONE)
+    {
+        if (type_id >= resolved_limits.Num()) resolved_limits.SetNum(type_id + 1);
+        resolved_limits[type_id] = {item_data, limit};
+    }
+    return limit;
+}
+
+#if WITH_EDITOR
+void UBagProperties::PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent)
+{
+    Super::PostEditChangeProperty(PropertyChangedEvent);
+    resetResolvedLimits();
+}
+#endif
+
+UInventoryBagComponent::UInventoryBagComponent()
+{
+}
+
+FInventoryBagAddItemResult UInventoryBagComponent::addItemComponent(UItemComponent* item)
+{
+    INVENTORY_LLM_SCOPE();
+    SCOPE_CYCLE_COUNTER(STAT_InventoryBagAddItem);
+    if (IsValid(item) && FInventoryTraceRecorder::get().isRecording()) FInventoryTraceRecorder::get().recordAddItemComponent(this, item);
+    if (isUnsupportedByStore(TEXT("addItemComponent"))) return {false, -1};
+    // Safety, item already present and valid limits checks
+    if (!IsValid(item) || !isValidItemData(item->ItemData) || !hasAvailableIds() || !hasValidItemLimits(item->ItemData))
+    {
+        UE_LOG(LogInventorySystem, Display, TEXT("Can't add item [%s] to bag [%s]"), IsValid(item) ? *item->GetPathName() : TEXT("InvalidItem"), *GetPathName());
+        return {false, -1};
+    }
+
+    UItemData* item_data = item->ItemData;
+    int32 const quantity = FMath::Max(IPickable::Execute_getPickableQuantity(item), 1);
+    FInventoryBagTransactionOp const quantity_op{item_data, quantity};
+    if (quantity > 1 && !canApplyTransaction(MakeArrayView(&quantity_op, 1)))
+    {
+        UE_LOG(LogInventorySystem, Display, TEXT("Can't add item [%s] to bag [%s]. Not enough room for its [%d] items."), *item->GetPathName(), *GetPathName(), quantity);
+        return {false, -1};
+    }
+
+    // We have a valid item and ID is available. We can try to add the item.
+    // If anything fails we should push back the ID we were going to use.
+    FScopedItemPoolIdTransaction id_transaction{item_ids_pool};
+    if (!tryAddItem(item_data, id_transaction.Id(), item)) return {false, -1};
+
+    id_transaction.commit();
+    item_comp_to_id.Add(item, id_transaction.Id());
+    if (quantity > 1)
+    {
+        // Merged resources: the component holds the first item, the others join as plain data. Room has been checked above.
+        FInventoryBagChangeSet changes;
+        {
+            TGuardValue<FInventoryBagChangeSet*> batch_guard{pending_changes, &changes};
+            for (int32 i = 1; i < quantity; ++i)
+            {
+                FScopedItemPoolIdTransaction extra_id_transaction{item_ids_pool};
+                verify(tryAddItem(item_data, extra_id_transaction.Id()));
+                extra_id_transaction.commit();
+            }
+        }
+        // Dropping the component later must not bring the extra items back with it.
+        if (UResourceComponent* resource = Cast<UResourceComponent>(item)) resource->Quantity = 1;
+        broadcastChangeSet(changes);
+    }
+    UE_LOG(LogInventorySystem, Display, TEXT("Item [%s] added to bag [%s]"), *item->GetPathName(), *GetPathName());
+    item->Execute_OnItemPickedUp(item, this);
+    broadcastBagUpdated();
+    return {true, id_transaction.Id()};
+}
+
+FInventoryBagRemoveItemResult UInventoryBagComponent::removeItemComponent(UItemComponent* item, bool bAllowActorSpawn)
+{
+    SCOPE_CYCLE_COUNTER(STAT_InventoryBagRemoveItem);
+    if (IsValid(item) && FInventoryTraceRecorder::get().isRecording()) FInventoryTraceRecorder::get().recordRemoveItemComponent(this, item);
+    // Safety checks
+    if (!IsValid(item) || !isValidItemData(item->ItemData))
+    {
+        UE_LOG(LogInventorySystem, Display, TEXT("Can't remove item [%s] from bag [%s]"), IsValid(item) ? *item->GetPathName() : TEXT("InvalidItem"), *GetPathName());
+        return {false, -1};
+    }
+
+    int32* remove_id_ptr = item_comp_to_id.Find(item); // Find item id from component
+    if (remove_id_ptr == nullptr)
+    {
+        UE_LOG(LogInventorySystem, Display, TEXT("Can't remove item [%s] from bag [%s]. Item not found."), *item->GetPathName(), *GetPathName());
+        return {false, -1};
+    }
+    int32 remove_id = *remove_id_ptr;
+    UItemData* item_data = item->ItemData;
+    FInventoryBagChangeSet* batch = beginRemoveBatch();
+    if (!tryRemoveItem(item_data, remove_id))
+    {
+        endRemoveBatch(batch, false);
+        return {false};
+    }
+
+    // Recover the used id for later use, spawn wanted actor and trigger dropped event.
+    releaseItemId(remove_id);
+    AActor* spawn_actor = bAllowActorSpawn ? spawnDropActor(item_data) : nullptr;
+    UE_LOG(LogInventorySystem, Display, TEXT("Item [%s] removed from bag [%s]"), *item->GetPathName(), *GetPathName());
+    endRemoveBatch(batch, true);
+    return {true, remove_id, spawn_actor};
+}
+
+UItemComponent* UInventoryBagComponent::getItemComponentFromId(int32 id)
+{
+    UItemComponent* const* item_comp = item_comp_to_id.FindKey(id);
+    if (item_comp != nullptr)
+    {
+        // Item component might have been destroyed.
+        // Maybe the user added the item via item component and then destroyed the owning actor.
+        if (IsValid(*item_comp)) return *item_comp;
+
+        // Clear out NULL (deleted) components.
+        UE_LOG(LogInventorySystem, Warning,
+               TEXT(
+                   "You have removed an item that was registered as an item component but that does not exist anymore. That most likely means its owning actor was deleted. If you immediately delete an item actor on pickup consider just adding the item data to the bag."
+               ));
+        item_comp_to_id.Remove(*item_comp);
+    }
+    UE_LOG(LogInventorySystem, Display, TEXT("Can't find item with id [%d] in bag [%s]."), id, *GetPathName());
+    return nullptr;
+}
+
+FInventoryBagAddItemResult UInventoryBagComponent::addItem(UItemData* item_data)
+{
+    SCOPE_CYCLE_COUNTER(STAT_InventoryBagAddItem);
+    if (FInventoryTraceRecorder::get().isRecording()) FInventoryTraceRecorder::get().recordAddItems(this, item_data, 1);
+    if (UInventoryWorldStore* store = getWorldStore())
+    {
+        // Store items have no individual IDs.
+        if (store->addItems(store_handle, item_data, 1) == 0) return {false, -1};
+        broadcastBagUpdated();
+        return {true, -1};
+    }
+    if (!isValidItemData(item_data) || !hasAvailableIds() || !hasValidItemLimits(item_data))
+    {
+        UE_LOG(LogInventorySystem, Display, TEXT("Can't add item [%s] to bag [%s]"), IsValid(item_data) ? *item_data->GetPathName() : TEXT("InvalidItem"), *GetPathName());
+        return {false, -1};
+    }
+
+    // We have a valid item and ID is available. We can try to add the item.
+    // If anything fails we should push back the ID we were going to use.
+    FScopedItemPoolIdTransaction id_transaction{item_ids_pool};
+    if (!tryAddItem(item_data, id_transaction.Id())) return {false, -1};
+
+    id_transaction.commit();
+    UE_LOG(LogInventorySystem, Display, TEXT("Item [%s] added to bag [%s]"), *item_data->GetPathName(), *GetPathName());
+    broadcastBagUpdated();
+    return {true, id_transaction.Id()};
+}
+
+int32 UInventoryBagComponent::addItems(UItemData* item_data, int32 count)
+{
+    SCOPE_CYCLE_COUNTER(STAT_InventoryBagAddItems);
+    if (FInventoryTraceRecorder::get().isRecording()) FInventoryTraceRecorder::get().recordAddItems(this, item_data, count);
+    if (UInventoryWorldStore* store = getWorldStore())
+    {
+        int32 const added = store->addItems(store_handle, item_data, count);
+        if (added > 0) broadcastBagUpdated();
+        return added;
+    }
+    if (!isValidItemData(item_data) || count <= 0 || !hasAvailableIds() || !hasValidItemLimits(item_data))
+    {
+        UE_LOG(LogInventorySystem, Display, TEXT("Can't add items [%s] to bag [%s]"), IsValid(item_data) ? *item_data->GetPathName() : TEXT("InvalidItem"), *GetPathName());
+        return 0;
+    }
+
+    FInventoryBagChangeSet changes;
+    int32 added = 0;
+    {
+        TGuardValue<FInventoryBagChangeSet*> batch_guard{pending_changes, &changes};
+        for (; added < count && item_ids_pool.Num() > 0; ++added)
+        {
+            FScopedItemPoolIdTransaction id_transaction{item_ids_pool};
+            if (!tryAddItem(item_data, id_transaction.Id())) break;
+            id_transaction.commit();
+        }
+    }
+    UE_LOG(LogInventorySystem, Display, TEXT("Added [%d/%d] items [%s] to bag [%s]"), added, count, *item_data->GetPathName(), *GetPathName());
+    broadcastChangeSet(changes);
+    return added;
+}
+
+int32 UInventoryBagComponent::addPickable(TScriptInterface<IPickable> pickable, bool& bAddedAll)
+{
+    bAddedAll = false;
+    UObject* pickable_object = pickable.GetObject();
+    if (!IsValid(pickable_object)) return 0;
+    int32 const quantity = FMath::Max(IPickable::Execute_getPickableQuantity(pickable_object), 1);
+    if (IPickable::Execute_getPickupBehavior(pickable_object) == EPickupBehavior::UseItemComponent)
+    {
+        bAddedAll = addItemComponent(IPickable::Execute_getItemComponent(pickable_object)).bAdded;
+        return bAddedAll ? quantity : 0;
+    }
+    int32 const added = addItems(IPickable::Execute_getItemData(pickable_object), quantity);
+    bAddedAll = added == quantity;
+    // Partially picked up resources keep what didn't fit.
+    UResourceComponent* resource = Cast<UResourceComponent>(IPickable::Execute_getItemComponent(pickable_object));
+    if (!bAddedAll && added > 0 && resource != nullptr) resource->Quantity -= added;
+    return added;
+}
+
+FInventoryBagRemoveItemResult UInventoryBagComponent::removeItem(UItemData* item_data, bool bAllowActorSpawn)
+{
+    SCOPE_CYCLE_COUNTER(STAT_InventoryBagRemoveItem);
+    if (FInventoryTraceRecorder::get().isRecording()) FInventoryTraceRecorder::get().recordRemoveItem(this, item_data);
+    if (!isValidItemData(item_data))
+    {
+        UE_LOG(LogInventorySystem, Display, TEXT("Can't remove item [%s] from bag [%s]"), IsValid(item_data) ? *item_data->GetPathName() : TEXT("InvalidItem"), *GetPathName());
+        return {false};
+    }
+
+    int32 remove_id = -1; // Remove from last slot.
+    FInventoryBagChangeSet* batch = nullptr;
+    if (UInventoryWorldStore* store = getWorldStore())
+    {
+        if (store->removeItems(store_handle, item_data, 1) == 0) return {false};
+    }
+    else
+    {
+        batch = beginRemoveBatch();
+        if (!tryRemoveItem(item_data, remove_id))
+        {
+            endRemoveBatch(batch, false);
+            return {false};
+        }
+        // Recover the used id for later use.
+        releaseItemId(remove_id);
+    }
+
+    // Spawn wanted actor and trigger dropped event.
+    AActor* spawn_actor = bAllowActorSpawn ? spawnDropActor(item_data) : nullptr;
+    UE_LOG(LogInventorySystem, Display, TEXT("Item [%s] removed from bag [%s]"), *item_data->GetPathName(), *GetPathName());
+    endRemoveBatch(batch, true);
+    return {true, remove_id, spawn_actor};
+}
+
+int32 UInventoryBagComponent::getItemQuantity(UItemData* item_data)
+{
+    if (!isValidItemData(item_data))
+    {
+        UE_LOG(LogInventorySystem, Display, TEXT("Invalid item data."), IsValid(item_data) ? *item_data->GetPathName() : TEXT("InvalidItem"), *GetPathName());
+        return 0;
+    }
+    if (UInventoryWorldStore* store = getWorldStore()) return store->getItemQuantity(store_handle, item_data);
+
+    switch (item_data->Category)
+    {
+    case EItemCategory::Resource:
+        {
+            UResourceData* resource_data = Cast<UResourceData>(item_data);
+            if (resource_data == nullptr)
+            {
+                UE_LOG(LogInventorySystem, Error, TEXT("Invalid resource data type [%s]"), *GetPathName());
+                return false;
+            }
+            const FBagResourcesData* resources_data = Resources.find(resource_data);
+            return resources_data != nullptr ? resources_data->ResourceQuantity : 0;
+        }
+    case EItemCategory::Tool:
+        {
+            UToolData* tool_data = Cast<UToolData>(item_data);
+            if (tool_data == nullptr)
+            {
+                UE_LOG(LogInventorySystem, Error, TEXT("Invalid tool data type [%s]"), *GetPathName());
+                return false;
+            }
+            const FBagToolsData* tools_data = Tools.find(tool_data);
+            return tools_data != nullptr ? tools_data->ToolQuantity : 0;
+        }
+    case EItemCategory::None: ;
+    default:
+        {
+            UE_LOG(LogInventorySystem, Warning, TEXT("Invalid item category [%s]"), *GetPathName());
+            return false;
+        }
+    }
+}
+
+int32 UInventoryBagComponent::getCategoryQuantity(EResourceCategory category) const
+{
+    if (UInventoryWorldStore* store = getWorldStore()) return store->getCategoryQuantity(store_handle, category);
+    int32 const category_index = static_cast<int32>(category);
+    return resource_category_quantities.IsValidIndex(category_index) ? resource_category_quantities[category_index] : 0;
+}
+
+int32 UInventoryBagComponent::getToolCategoryQuantity(EToolCategory category) const
+{
+    if (UInventoryWorldStore* store = getWorldStore()) return store->getToolCategoryQuantity(store_handle, category);
+    int32 const category_index = static_cast<int32>(category);
+    return tool_category_quantities.IsValidIndex(category_index) ? tool_category_quantities[category_index] : 0;
+}
+
+int32 UInventoryBagComponent::getQuantityWithTag(FGameplayTag tag) const
+{
+    if (UInventoryWorldStore* store = getWorldStore()) return store->getTagQuantity(store_handle, tag);
+    const FBagTagQuantity* tag_quantity = tag_quantities.Find(tag);
+    return tag_quantity != nullptr ? tag_quantity->Quantity : 0;
+}
+
+TArray<UItemData*> UInventoryBagComponent::getTypesWithTag(FGameplayTag tag) const
+{
+    if (UInventoryWorldStore* store = getWorldStore()) return store->getTypesWithTag(store_handle, tag);
+    return TArray<UItemData*>{findTypesWithTag(tag)};
+}
+
+TArrayView<UItemData* const> UInventoryBagComponent::findTypesWithTag(FGameplayTag tag) const
+{
+    const FBagTagQuantity* tag_quantity = tag_quantities.Find(tag);
+    return tag_quantity != nullptr ? TArrayView<UItemData* const>{tag_quantity->Types} : TArrayView<UItemData* const>{};
+}
+
+const FBagResourceSlot* UInventoryBagComponent::findResourceSlot(const UResourceData* resource_data, int32 slot_id) const
+{
+    UResourceData* slot_resource_data = nullptr;
+    const FBagResourceSlot* slot = findResourceSlotById(slot_id, &slot_resource_data);
+    return slot_resource_data == resource_data ? slot : nullptr;
+}
+
+const FBagToolSlot* UInventoryBagComponent::findToolSlot(const UToolData* tool_data, int32 slot_id) const
+{
+    UToolData* slot_tool_data = nullptr;
+    const FBagToolSlot* slot = findToolSlotById(slot_id, &slot_tool_data);
+    return slot_tool_data == tool_data ? slot : nullptr;
+}
+
+const FBagResourceSlot* UInventoryBagComponent::findResourceSlotById(int32 slot_id, UResourceData** out_resource_data /** = nullptr */) const
+{
+    updateSlotIndex();
+    if (!slot_locations.IsValidIndex(slot_id)) return nullptr;
+    UResourceData* resource_data = Cast<UResourceData>(slot_locations[slot_id].ItemData);
+    const FBagResourcesData* resources_data = Resources.find(resource_data);
+    if (resources_data == nullptr) return nullptr;
+    const FBagResourceSlot& slot = resources_data->Slots[slot_locations[slot_id].SlotIndex];
+    checkSlow(slot.Id == slot_id);
+    if (out_resource_data != nullptr) *out_resource_data = resource_data;
+    return &slot;
+}
+
+const FBagToolSlot* UInventoryBagComponent::findToolSlotById(int32 slot_id, UToolData** out_tool_data /** = nullptr */) const
+{
+    updateSlotIndex();
+    if (!slot_locations.IsValidIndex(slot_id)) return nullptr;
+    UToolData* tool_data = Cast<UToolData>(slot_locations[slot_id].ItemData);
+    const FBagToolsData* tools_data = Tools.find(tool_data);
+    if (tools_data == nullptr) return nullptr;
+    const FBagToolSlot& slot = tools_data->Slots[slot_locations[slot_id].SlotIndex];
+    checkSlow(slot.Id == slot_id);
+    if (out_tool_data != nullptr) *out_tool_data = tool_data;
+    return &slot;
+}
+
+void UInventoryBagComponent::visitResourceSlots(int32 offset, int32 count, TFunctionRef<void(UResourceData*, const FBagResourceSlot&)> visitor) const
+{
+    updateSlotIndex();
+    int32 const begin = FMath::Clamp(offset, 0, resource_slot_order.Num());
+    int32 const end = begin + FMath::Clamp(count, 0, resource_slot_order.Num() - begin);
+    for (int32 order_index = begin; order_index < end; ++order_index)
+    {
+        UResourceData* resource_data = nullptr;
+        const FBagResourceSlot* slot = findResourceSlotById(resource_slot_order[order_index], &resource_data);
+        check(slot != nullptr);
+        visitor(resource_data, *slot);
+    }
+}
+
+void UInventoryBagComponent::visitToolSlots(int32 offset, int32 count, TFunctionRef<void(UToolData*, const FBagToolSlot&)> visitor) const
+{
+    updateSlotIndex();
+    int32 const begin = FMath::Clamp(offset, 0, tool_slot_order.Num());
+    int32 const end = begin + FMath::Clamp(count, 0, tool_slot_order.Num() - begin);
+    for (int32 order_index = begin; order_index < end; ++order_index)
+    {
+        UToolData* tool_data = nullptr;
+        const FBagToolSlot* slot = findToolSlotById(tool_slot_order[order_index], &tool_data);
+        check(slot != nullptr);
+        visitor(tool_data, *slot);
+    }
+}
+
+TArray<FBagResourceSlotEntry> UInventoryBagComponent::getResourceSlots(int32 offset, int32 count) const
+{
+    TArray<FBagResourceSlotEntry> entries;
+    visitResourceSlots(offset, count, [&entries](UResourceData* resource_data, const FBagResourceSlot& slot)
+    {
+        entries.Add({resource_data, slot});
+    });
+    return entries;
+}
+
+TArray<FBagToolSlotEntry> UInventoryBagComponent::getToolSlots(int32 offset, int32 count) const
+{
+    TArray<FBagToolSlotEntry> entries;
+    visitToolSlots(offset, count, [this, &entries](UToolData* tool_data, const FBagToolSlot& slot)
+    {
+        refreshToolSlot(entries.Add_GetRef({tool_data, slot}).Slot);
+    });
+    return entries;
+}
+
+bool UInventoryBagComponent::getResourceSlotById(int32 slot_id, FBagResourceSlotEntry& out_entry) const
+{
+    const FBagResourceSlot* slot = findResourceSlotById(slot_id, &out_entry.ResourceData);
+    if (slot == nullptr) return false;
+    out_entry.Slot = *slot;
+    return true;
+}
+
+bool UInventoryBagComponent::getToolSlotById(int32 slot_id, FBagToolSlotEntry& out_entry) const
+{
+    const FBagToolSlot* slot = findToolSlotById(slot_id, &out_entry.ToolData);
+    if (slot == nullptr) return false;
+    out_entry.Slot = *slot;
+    refreshToolSlot(out_entry.Slot);
+    return true;
+}
+
+bool UInventoryBagComponent::updateToolDurability(UToolComponent* tool, int32 const durability)
+{
+    if (IsValid(tool) && FInventoryTraceRecorder::get().isRecording()) FInventoryTraceRecorder::get().recordUpdateToolDurability(this, tool, durability);
+    if (!IsValid(tool) || !isValidItemData(tool->ItemData))
+    {
+        UE_LOG(LogInventorySystem, Display, TEXT("Invalid item [%s]"), IsValid(tool) ? *tool->GetPathName() : TEXT("InvalidTool"));
+        return false;
+    }
+
+    int32* tool_id_ptr = item_comp_to_id.Find(tool);
+    if (tool_id_ptr == nullptr)
+    {
+        UE_LOG(LogInventorySystem, Display, TEXT("Tool [%s] not found in bag [%s]."), *tool->GetPathName(), *GetPathName());
+        return false;
+    }
+    int32 const tool_id = *tool_id_ptr;
+    UToolData* tool_data = Cast<UToolData>(tool->ItemData);
+    if (tool_data == nullptr)
+    {
+        UE_LOG(LogInventorySystem, Error, TEXT("Invalid tool data type [%s]"), *tool->GetPathName());
+        return false;
+    }
+
+    int32 const tool_index = tool_instances.find(tool_id);
+    check(tool_index != INDEX_NONE); // Tools with valid ID should always be stored.
+    tool_instances.Durabilities[tool_index] = durability;
+
+    // Only the slot holding the tool needs to be refreshed and notified, the rest of its type stays up to date.
+    int32 const slot_id = tool_instances.SlotIds[tool_index];
+    FBagToolSlot* slot = const_cast<FBagToolSlot*>(findToolSlotById(slot_id));
+    check(slot != nullptr);
+    refreshToolSlot(*slot);
+    notifyToolSlotChanged(tool_data, slot_id, slot->Num(), slot);
+    publishReadView();
+    return true;
+}
+
+int32 UInventoryBagComponent::getToolDurability(int32 tool_id) const
+{
+    int32 const tool_index = tool_instances.find(tool_id);
+    return tool_index != INDEX_NONE ? tool_instances.Durabilities[tool_index] : INDEX_NONE;
+}
+
+int32 UInventoryBagComponent::applyToolWear(EToolCategory category, int32 wear)
+{
+    SCOPE_CYCLE_COUNTER(STAT_InventoryBagToolDurability);
+    if (FInventoryTraceRecorder::get().isRecording()) FInventoryTraceRecorder::get().recordApplyToolWear(this, static_cast<int32>(category), wear);
+    int32 const worn = tool_instances.applyWear(static_cast<int32>(category), wear, stale_tool_slot_types);
+    if (worn > 0) notifyToolDurabilitiesChanged();
+    return worn;
+}
+
+int32 UInventoryBagComponent::applyToolWearToAll(int32 wear)
+{
+    SCOPE_CYCLE_COUNTER(STAT_InventoryBagToolDurability);
+    if (FInventoryTraceRecorder::get().isRecording()) FInventoryTraceRecorder::get().recordApplyToolWear(this, INDEX_NONE, wear);
+    int32 const worn = tool_instances.applyWear(INDEX_NONE, wear, stale_tool_slot_types);
+    if (worn > 0) notifyToolDurabilitiesChanged();
+    return worn;
+}
+
+int32 UInventoryBagComponent::repairAllTools()
+{
+    SCOPE_CYCLE_COUNTER(STAT_InventoryBagToolDurability);
+    if (FInventoryTraceRecorder::get().isRecording()) FInventoryTraceRecorder::get().recordRepairAllTools(this);
+    tool_instances.repairAll();
+    for (auto&& tools_data : Tools.Types) stale_tool_slot_types.Add(tools_data.ToolData);
+    if (tool_instances.num() > 0) notifyToolDurabilitiesChanged();
+    return tool_instances.num();
+}
+
+void UInventoryBagComponent::refreshToolSlots()
+{
+    for (UToolData* tool_data : stale_tool_slot_types)
+    {
+        FBagToolsData* tools_data = Tools.find(tool_data);
+        if (tools_data == nullptr) continue;
+        for (auto&& slot : tools_data->Slots)
+        {
+            refreshToolSlot(slot);
+            markSnapshotDirty(tool_data, slot.Id);
+        }
+    }
+    stale_tool_slot_types.Reset();
+}
+
+bool UInventoryBagComponent::applyTransaction(const TArray<FInventoryBagTransactionOp>& ops)
+{
+    return commitTransaction(ops);
+}
+
+bool UInventoryBagComponent::canApplyTransaction(TArrayView<const FInventoryBagTransactionOp> ops) const
+{
+    if (!IsValid(BagProperties))
+    {
+        UE_LOG(LogInventorySystem, Error, TEXT("Invalid bag properties. [Bag: %s]"), *GetPathName());
+        return false;
+    }
+
+    // Sum up removes and adds per type so that each type is validated once.
+    struct FTypeTotals
+    {
+        UItemData* ItemData;
+        int32 Removed;
+        int32 Added;
+    };
+    TArray<FTypeTotals, TInlineAllocator<8>> totals;
+    for (auto&& op : ops)
+    {
+        if (!isValidItemData(op.ItemData)) return false;
+        FTypeTotals* type_totals = totals.FindByPredicate([&op](const FTypeTotals& entry) { return entry.ItemData == op.ItemData; });
+        if (type_totals == nullptr) type_totals = &totals[totals.Add({op.ItemData, 0, 0})];
+        if (op.Quantity < 0) type_totals->Removed -= op.Quantity;
+        else type_totals->Added += op.Quantity;
+    }
+
+    int32 removed_total = 0;
+    int32 added_total = 0;
+    int32 resource_slots_delta = 0;
+    int32 tool_slots_delta = 0;
+    for (auto&& type_totals : totals)
+    {
+        int32 slots_delta = 0;
+        if (!canApplyQuantityChange(type_totals.ItemData, type_totals.Removed, type_totals.Added, slots_delta)) return false;
+        removed_total += type_totals.Removed;
+        added_total += type_totals.Added;
+        if (type_totals.ItemData->Category == EItemCategory::Resource) resource_slots_delta += slots_delta;
+        else tool_slots_delta += slots_delta;
+    }
+
+    // Removed items give their ids back before any add takes place.
+    if (added_total > item_ids_pool.Num() + removed_total)
+    {
+        UE_LOG(LogInventorySystem, Display, TEXT("Transaction needs more ids than available for the bag [%s]"), *GetPathName());
+        return false;
+    }
+    if (Resources.UsedSlots + resource_slots_delta > BagProperties->MaxResourceSlots || Tools.UsedSlots + tool_slots_delta > BagProperties->MaxToolsSlots)
+    {
+        UE_LOG(LogInventorySystem, Display, TEXT("Transaction needs more slots than available for the bag [%s]"), *GetPathName());
+        return false;
+    }
+    return true;
+}
+
+bool UInventoryBagComponent::commitTransaction(TArrayView<const FInventoryBagTransactionOp> ops)
+{
+    INVENTORY_LLM_SCOPE();
+    SCOPE_CYCLE_COUNTER(STAT_InventoryBagCommitTransaction);
+    if (FInventoryTraceRecorder::get().isRecording()) FInventoryTraceRecorder::get().recordCommitTransaction(this, ops);
+    if (isUnsupportedByStore(TEXT("commitTransaction"))) return false;
+    if (!canApplyTransaction(ops))
+    {
+        UE_LOG(LogInventorySystem, Display, TEXT("Can't apply transaction to bag [%s]"), *GetPathName());
+        return false;
+    }
+
+    // Everything has been validated up front, applying can't fail from here on.
+    FInventoryBagChangeSet changes;
+    {
+        TGuardValue<FInventoryBagChangeSet*> batch_guard{pending_changes, &changes};
+        // Removes first, so that their slots and ids can be reused by the adds.
+        for (auto&& op : ops)
+        {
+            for (int32 i = 0; i < -op.Quantity; ++i)
+            {
+                int32 remove_id = -1;
+                verify(tryRemoveItem(op.ItemData, remove_id));
+                releaseItemId(remove_id);
+            }
+        }
+        for (auto&& op : ops)
+        {
+            for (int32 i = 0; i < op.Quantity; ++i)
+            {
+                FScopedItemPoolIdTransaction id_transaction{item_ids_pool};
+                verify(tryAddItem(op.ItemData, id_transaction.Id()));
+                id_transaction.commit();
+            }
+        }
+    }
+    UE_LOG(LogInventorySystem, Display, TEXT("Applied transaction with [%d] operations to bag [%s]"), ops.Num(), *GetPathName());
+    broadcastChangeSet(changes);
+    return true;
+}
+
+bool UInventoryBagComponent::transferItems(UInventoryBagComponent* from, UInventoryBagComponent* to, UItemData* item_data, int32 count)
+{
+    INVENTORY_LLM_SCOPE();
+    SCOPE_CYCLE_COUNTER(STAT_InventoryBagTransfer);
+    if (IsValid(from) && IsValid(to) && FInventoryTraceRecorder::get().isRecording()) FInventoryTraceRecorder::get().recordTransferItems(from, to, item_data, count);
+    if (!IsValid(from) || !IsValid(to) || from == to || !from->isValidItemData(item_data) || count <= 0
+        || from->isUnsupportedByStore(TEXT("transferItems")) || to->isUnsupportedByStore(TEXT("transferItems")))
+    {
+        UE_LOG(LogInventorySystem, Display, TEXT("Can't transfer items [%s]. Invalid bags or quantity."), IsValid(item_data) ? *item_data->GetPathName() : TEXT("InvalidItem"));
+        return false;
+    }
+    int32 const available = from->getStoredQuantity(item_data);
+    if (available < count || !to->canReceiveItems(item_data, count))
+    {
+        UE_LOG(LogInventorySystem, Display, TEXT("Can't transfer [%d] items [%s] from bag [%s] to bag [%s]. [%d] available."),
+               count, *item_data->GetPathName(), *from->GetPathName(), *to->GetPathName(), available);
+        return false;
+    }
+
+    FInventoryBagChangeSet from_changes;
+    FInventoryBagChangeSet to_changes;
+    {
+        TGuardValue<FInventoryBagChangeSet*> from_batch_guard{from->pending_changes, &from_changes};
+        TGuardValue<FInventoryBagChangeSet*> to_batch_guard{to->pending_changes, &to_changes};
+        for (int32 i = 0; i < count; ++i) moveItem(from, to, item_data, -1);
+    }
+    UE_LOG(LogInventorySystem, Display, TEXT("Transferred [%d] items [%s] from bag [%s] to bag [%s]"), count, *item_data->GetPathName(), *from->GetPathName(), *to->GetPathName());
+    from->broadcastChangeSet(from_changes);
+    to->broadcastChangeSet(to_changes);
+    return true;
+}
+
+bool UInventoryBagComponent::transferSlot(UInventoryBagComponent* from, UInventoryBagComponent* to, int32 slot_id)
+{
+    INVENTORY_LLM_SCOPE();
+    SCOPE_CYCLE_COUNTER(STAT_InventoryBagTransfer);
+    if (IsValid(from) && IsValid(to) && FInventoryTraceRecorder::get().isRecording()) FInventoryTraceRecorder::get().recordTransferSlot(from, to, slot_id);
+    if (!IsValid(from) || !IsValid(to) || from == to || from->isUnsupportedByStore(TEXT("transferSlot")) || to->isUnsupportedByStore(TEXT("transferSlot")))
+    {
+        UE_LOG(LogInventorySystem, Display, TEXT("Can't transfer slot [%d]. Invalid bags."), slot_id);
+        return false;
+    }
+
+    // Grab the IDs held by the slot, they'll be removed one by one from the source bag.
+    UItemData* item_data = nullptr;
+    TArray<int32, TInlineAllocator<32>> slot_item_ids;
+    for (auto&& resources_data : from->Resources.Types)
+    {
+        const FBagResourceSlot* slot = resources_data.Slots.FindByPredicate([slot_id](const FBagResourceSlot& entry) { return entry.Id == slot_id; });
+        if (slot == nullptr) continue;
+        item_data = resources_data.ResourceData;
+        slot_item_ids.Append(slot->ResourceIds);
+        break;
+    }
+    for (auto&& tools_data : from->Tools.Types)
+    {
+        if (item_data != nullptr) break;
+        const FBagToolSlot* slot = tools_data.Slots.FindByPredicate([slot_id](const FBagToolSlot& entry) { return entry.Id == slot_id; });
+        if (slot == nullptr) continue;
+        item_data = tools_data.ToolData;
+        for (auto&& tool_info : slot->ToolsInfo) slot_item_ids.Add(tool_info.ToolId);
+    }
+    if (item_data == nullptr)
+    {
+        UE_LOG(LogInventorySystem, Display, TEXT("Can't transfer slot [%d] from bag [%s]. Slot not found."), slot_id, *from->GetPathName());
+        return false;
+    }
+    if (!to->canReceiveItems(item_data, slot_item_ids.Num()))
+    {
+        UE_LOG(LogInventorySystem, Display, TEXT("Can't transfer slot [%d] from bag [%s] to bag [%s]. Not enough space."), slot_id, *from->GetPathName(), *to->GetPathName());
+        return false;
+    }
+
+    FInventoryBagChangeSet from_changes;
+    FInventoryBagChangeSet to_changes;
+    {
+        TGuardValue<FInventoryBagChangeSet*> from_batch_guard{from->pending_changes, &from_changes};
+        TGuardValue<FInventoryBagChangeSet*> to_batch_guard{to->pending_changes, &to_changes};
+        // The whole slot goes away, refilling it from other stacks while it empties would just be churn.
+        TGuardValue<bool> compact_guard{from->bCompactStacksOnRemove, false};
+        for (int32 const item_id : slot_item_ids) moveItem(from, to, item_data, item_id);
+    }
+    UE_LOG(LogInventorySystem, Display, TEXT("Transferred slot [%d] with [%d] items [%s] from bag [%s] to bag [%s]"),
+           slot_id, slot_item_ids.Num(), *item_data->GetPathName(), *from->GetPathName(), *to->GetPathName());
+    from->broadcastChangeSet(from_changes);
+    to->broadcastChangeSet(to_changes);
+    return true;
+}
+
+bool UInventoryBagComponent::compactStacks(int32 max_moves)
+{
+    INVENTORY_LLM_SCOPE();
+    if (FInventoryTraceRecorder::get().isRecording()) FInventoryTraceRecorder::get().recordCompactStacks(this, max_moves);
+    if (!IsValid(BagProperties)) return false;
+    if (max_moves < 0) max_moves = MAX_int32;
+
+    FInventoryBagChangeSet changes;
+    int32 moves = 0;
+    {
+        TGuardValue<FInventoryBagChangeSet*> batch_guard{pending_changes, &changes};
+        // Compaction doesn't change quantities, so no type can be removed while iterating.
+        for (auto&& resources_data : Resources.Types)
+        {
+            if (moves >= max_moves) break;
+            moves += compactResourceSlots(resources_data.ResourceData, resources_data, max_moves - moves);
+        }
+        for (auto&& tools_data : Tools.Types)
+        {
+            if (moves >= max_moves) break;
+            moves += compactToolSlots(tools_data.ToolData, tools_data, max_moves - moves);
+        }
+    }
+    UE_LOG(LogInventorySystem, Verbose, TEXT("Compacted bag [%s]. Moved [%d] items, freed [%d] slots."), *GetPathName(), moves,
+           changes.Slots.FilterByPredicate([](const FInventoryBagSlotChange& change) { return change.NewCount == 0; }).Num());
+    broadcastChangeSet(changes);
+    return moves < max_moves;
+}
+
+FInventoryBagSnapshot UInventoryBagComponent::takeSnapshot()
+{
+    INVENTORY_LLM_SCOPE();
+    if (isUnsupportedByStore(TEXT("takeSnapshot"))) return {};
+    refreshToolSlots();
+    // Nothing changed since last time, the last snapshot is still accurate.
+    if (last_snapshot.IsValid() && snapshot_dirty_types.Num() == 0) return FInventoryBagSnapshot{last_snapshot};
+
+    TSharedRef<FInventoryBagSnapshotData, ESPMode::ThreadSafe> snapshot_data = last_snapshot.IsValid()
+                                                                                  ? MakeShared<FInventoryBagSnapshotData, ESPMode::ThreadSafe>(*last_snapshot)
+                                                                                  : MakeShared<FInventoryBagSnapshotData, ESPMode::ThreadSafe>();
+    snapshot_data->BagId = GetUniqueID();
+    snapshot_data->Version = ++snapshot_version;
+    snapshot_data->ResourceUsedSlots = Resources.UsedSlots;
+    snapshot_data->ToolUsedSlots = Tools.UsedSlots;
+    snapshot_data->ResourceCategoryQuantities = resource_category_quantities;
+    snapshot_data->ToolCategoryQuantities = tool_category_quantities;
+
+    // The first snapshot has to copy everything.
+    if (!last_snapshot.IsValid())
+    {
+        for (auto&& resources_data : Resources.Types) snapshot_dirty_types.Add(resources_data.ResourceData);
+        for (auto&& tools_data : Tools.Types) snapshot_dirty_types.Add(tools_data.ToolData);
+    }
+    // Rebuild only the types that changed, copying only their changed slots. Anything else keeps being shared with the previous snapshot.
+    for (UItemData* item_data : snapshot_dirty_types)
+    {
+        if (UResourceData* resource_data = Cast<UResourceData>(item_data))
+        {
+            const FBagResourcesData* resources_data = Resources.find(resource_data);
+            if (resources_data == nullptr)
+            {
+                snapshot_data->Resources.Remove(resource_data);
+                continue;
+            }
+            const FBagResourcesDataRef* previous = snapshot_data->Resources.Find(resource_data);
+            FBagResourcesDataRef resources = snapshotSlots(resources_data->Slots, resources_data->ResourceQuantity, previous != nullptr ? &previous->Get() : nullptr, snapshot_dirty_slots);
+            snapshot_data->Resources.Add(resource_data, MoveTemp(resources));
+        }
+        else if (UToolData* tool_data = Cast<UToolData>(item_data))
+        {
+            const FBagToolsData* tools_data = Tools.find(tool_data);
+            if (tools_data == nullptr)
+            {
+                snapshot_data->Tools.Remove(tool_data);
+                continue;
+            }
+            const FBagToolsDataRef* previous = snapshot_data->Tools.Find(tool_data);
+            FBagToolsDataRef tools = snapshotSlots(tools_data->Slots, tools_data->ToolQuantity, previous != nullptr ? &previous->Get() : nullptr, snapshot_dirty_slots);
+            snapshot_data->Tools.Add(tool_data, MoveTemp(tools));
+        }
+    }
+    snapshot_dirty_types.Reset();
+    snapshot_dirty_slots.Reset();
+
+    last_snapshot = snapshot_data;
+    return FInventoryBagSnapshot{last_snapshot};
+}
+
+bool UInventoryBagComponent::restoreSnapshot(const FInventoryBagSnapshot& snapshot)
+{
+    INVENTORY_LLM_SCOPE();
+    if (isUnsupportedByStore(TEXT("restoreSnapshot"))) return false;
+    // Replays start from empty bags and can't recreate the snapshot contents.
+    if (FInventoryTraceRecorder::get().isRecording()) FInventoryTraceRecorder::get().stopOnUnsupported(TEXT("restoreSnapshot"));
+    if (!snapshot.isValid() || snapshot.Data->BagId != GetUniqueID() || !IsValid(BagProperties))
+    {
+        UE_LOG(LogInventorySystem, Warning, TEXT("Can't restore snapshot. Invalid snapshot or snapshot not taken from bag [%s]."), *GetPathName());
+        return false;
+    }
+
+    const FInventoryBagSnapshotData& snapshot_data = *snapshot.Data;
+    // Rebuild bag contents and keep track of the ids in use to rebuild the pools.
+    TBitArray<> used_item_ids{false, BagProperties->MaxItemId};
+    TBitArray<> used_slot_ids{false, BagProperties->MaxToolsSlots + BagProperties->MaxResourceSlots};
+    Resources.reset();
+    for (auto&& resource : snapshot_data.Resources)
+    {
+        FBagResourcesData& resources_data = Resources.add(resource.Key);
+        resources_data.ResourceQuantity = resource.Value->Quantity;
+        resources_data.Slots.Reserve(resource.Value->Slots.Num());
+        for (auto&& slot : resource.Value->Slots)
+        {
+            resources_data.Slots.Add(*slot);
+            used_slot_ids[slot->Id] = true;
+            for (int32 const id : slot->ResourceIds) used_item_ids[id] = true;
+        }
+    }
+    Tools.reset();
+    tool_instances.reset(BagProperties->MaxItemId);
+    stale_tool_slot_types.Reset();
+    for (auto&& tool : snapshot_data.Tools)
+    {
+        FBagToolsData& tools_data = Tools.add(tool.Key);
+        tools_data.ToolQuantity = tool.Value->Quantity;
+        tools_data.Slots.Reserve(tool.Value->Slots.Num());
+        for (auto&& slot : tool.Value->Slots)
+        {
+            tools_data.Slots.Add(*slot);
+            used_slot_ids[slot->Id] = true;
+            for (auto&& tool_info : slot->ToolsInfo)
+            {
+                used_item_ids[tool_info.ToolId] = true;
+                tool_instances.add(tool_info.ToolId, tool.Key, tool_info.Durability, slot->Id);
+            }
+        }
+    }
+    Resources.UsedSlots = snapshot_data.ResourceUsedSlots;
+    Tools.UsedSlots = snapshot_data.ToolUsedSlots;
+
+    item_ids_pool.Reset();
+    for (int32 id = 0; id < used_item_ids.Num(); ++id) if (!used_item_ids[id]) item_ids_pool.Push(id);
+    slot_ids_pool.Reset();
+    for (int32 id = 0; id < used_slot_ids.Num(); ++id) if (!used_slot_ids[id]) slot_ids_pool.Push(id);
+    // Components whose items are not part of the snapshot don't belong to the bag anymore.
+    for (auto it = item_comp_to_id.CreateIterator(); it; ++it)
+    {
+        if (!used_item_ids[it.Value()]) it.RemoveCurrent();
+    }
+
+    rebuildQuantityTotals();
+    slot_index_dirty = true;
+    journal.invalidate();
+
+    // The bag now matches the snapshot exactly, so its per type data can be shared as is.
+    // It still gets a new version, the ones handed out since the snapshot was taken don't describe the bag anymore.
+    TSharedRef<FInventoryBagSnapshotData, ESPMode::ThreadSafe> restored_data = MakeShared<FInventoryBagSnapshotData, ESPMode::ThreadSafe>(snapshot_data);
+    restored_data->BagId = GetUniqueID();
+    restored_data->Version = ++snapshot_version;
+    last_snapshot = restored_data;
+    snapshot_dirty_types.Reset();
+    snapshot_dirty_slots.Reset();
+    UE_LOG(LogInventorySystem, Display, TEXT("Restored snapshot version [%d] for bag [%s]"), snapshot_data.Version, *GetPathName());
+    broadcastBagUpdated();
+    return true;
+}
+
+FInventoryBagChangeSet UInventoryBagComponent::diffSnapshots(const FInventoryBagSnapshot& from, const FInventoryBagSnapshot& to)
+{
+    return FInventoryBagSnapshot::diff(from, to);
+}
+
+FInventoryBagSnapshot UInventoryBagComponent::getReadView() const
+{
+    if (isUnsupportedByStore(TEXT("getReadView"))) return {};
+    FRWScopeLock read_lock(read_view_lock, SLT_ReadOnly);
+    return FInventoryBagSnapshot{read_view};
+}
+
+void UInventoryBagComponent::BeginPlay()
+{
+    INVENTORY_LLM_SCOPE();
+    Super::BeginPlay();
+    journal.setCapacity(JournalCapacity);
+    if (bUseWorldStore)
+    {
+        UInventoryWorldStore* store = UInventoryWorldStore::get(this);
+        if (store != nullptr)
+        {
+            // The store streams in limits and keeps the contents, nothing else to set up.
+            store_handle = store->createBag(BagProperties);
+            if (store_handle.isSet()) return;
+        }
+        UE_LOG(LogInventorySystem, Warning, TEXT("Can't use world inventory store for bag [%s]. Falling back to component storage."), *GetPathName());
+    }
+    streamInLimits();
+    // Type IDs aren't serialized, entries loaded with the component need them back before any lookup.
+    Resources.rebuild();
+    Tools.rebuild();
+
+    // Init tool id pool
+    item_ids_pool.AddUninitialized(BagProperties->MaxItemId);
+    for (int i = 0; i < item_ids_pool.Num(); ++i)
+    {
+        item_ids_pool[i] = i;
+    }
+    // Init slot id pool
+    slot_ids_pool.AddUninitialized(BagProperties->MaxToolsSlots + BagProperties->MaxResourceSlots);
+    for (int i = 0; i < slot_ids_pool.Num(); ++i)
+    {
+        slot_ids_pool[i] = i;
+    }
+    tool_instances.reset(BagProperties->MaxItemId);
+}
+
+void UInventoryBagComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+    if (FInventoryTraceRecorder::get().isRecording()) FInventoryTraceRecorder::get().recordDestroyBag(this);
+    if (UInventoryWorldStore* store = getWorldStore()) store->destroyBag(store_handle);
+    store_handle = {};
+    Super::EndPlay(EndPlayReason);
+}
+
+void UInventoryBagComponent::AddReferencedObjects(UObject* in_this, FReferenceCollector& collector)
+{
+    UInventoryBagComponent* bag = CastChecked<UInventoryBagComponent>(in_this);
+    // Types that left the bag are still mentioned here, they must not be unloaded while they can be handed out.
+    bag->journal.addReferencedObjects(collector, bag);
+    collector.AddReferencedObjects(bag->snapshot_dirty_types, bag);
+    if (bag->last_snapshot.IsValid()) bag->last_snapshot->addReferencedObjects(collector, bag);
+    if (bag->read_view.IsValid()) bag->read_view->addReferencedObjects(collector, bag);
+    Super::AddReferencedObjects(in_this, collector);
+}
+
+FInventoryBagMemoryUsage UInventoryBagComponent::getMemoryUsage() const
+{
+    FInventoryBagMemoryUsage usage;
+    usage.Object = GetClass()->GetStructureSize();
+    usage.IdPools = item_ids_pool.GetAllocatedSize() + slot_ids_pool.GetAllocatedSize();
+
+    usage.Types = Resources.Types.GetAllocatedSize() + Resources.getIndexAllocatedSize() + Tools.Types.GetAllocatedSize() + Tools.getIndexAllocatedSize()
+        + resource_category_quantities.GetAllocatedSize() + tool_category_quantities.GetAllocatedSize()
+        + snapshot_dirty_types.GetAllocatedSize() + stale_tool_slot_types.GetAllocatedSize() + tag_quantities.GetAllocatedSize();
+    for (auto&& tag_quantity : tag_quantities) usage.Types += tag_quantity.Value.Types.GetAllocatedSize();
+    for (auto&& resources_data : Resources.Types)
+    {
+        usage.Slots += resources_data.Slots.GetAllocatedSize();
+        for (auto&& slot : resources_data.Slots) usage.Slots += slot.ResourceIds.GetAllocatedSize();
+    }
+    for (auto&& tools_data : Tools.Types)
+    {
+        usage.Slots += tools_data.Slots.GetAllocatedSize();
+        for (auto&& slot : tools_data.Slots) usage.Slots += slot.ToolsInfo.GetAllocatedSize();
+    }
+    usage.Slots += tool_instances.getAllocatedSize() + slot_locations.GetAllocatedSize()
+        + resource_slot_order.GetAllocatedSize() + tool_slot_order.GetAllocatedSize();
+
+    usage.ItemComponents = item_comp_to_id.GetAllocatedSize();
+    if (limits_stream_handle.IsValid())
+    {
+        TArray<FSoftObjectPath> requested_assets;
+        limits_stream_handle->GetRequestedAssets(requested_assets);
+        usage.StreamHandles = sizeof(FStreamableHandle) + requested_assets.GetAllocatedSize();
+    }
+
+    // The read view is usually the last snapshot, and both share most per type data with older ones.
+    TSet<const void*> counted_snapshot_data;
+    usage.Snapshots = getSnapshotAllocatedSize(last_snapshot.Get(), counted_snapshot_data);
+    {
+        FRWScopeLock read_lock(read_view_lock, SLT_ReadOnly);
+        usage.Snapshots += getSnapshotAllocatedSize(read_view.Get(), counted_snapshot_data);
+    }
+
+    usage.Other = journal.getAllocatedSize() + recycled_resource_stacks.GetAllocatedSize() + recycled_tool_stacks.GetAllocatedSize()
+        + recycled_resource_slot_lists.GetAllocatedSize() + recycled_tool_slot_lists.GetAllocatedSize();
+    for (auto&& stack : recycled_resource_stacks) usage.Other += stack.GetAllocatedSize();
+    for (auto&& stack : recycled_tool_stacks) usage.Other += stack.GetAllocatedSize();
+    for (auto&& slots : recycled_resource_slot_lists) usage.Other += slots.GetAllocatedSize();
+    for (auto&& slots : recycled_tool_slot_lists) usage.Other += slots.GetAllocatedSize();
+    for (auto&& batch : remove_batches) usage.Other += sizeof(FInventoryBagChangeSet) + batch.Items.GetAllocatedSize() + batch.Slots.GetAllocatedSize();
+    return usage;
+}
+
+void UInventoryBagComponent::GetResourceSizeEx(FResourceSizeEx& CumulativeResourceSize)
+{
+    Super::GetResourceSizeEx(CumulativeResourceSize);
+    FInventoryBagMemoryUsage const usage = getMemoryUsage();
+    CumulativeResourceSize.AddDedicatedSystemMemoryBytes(usage.getTotal() - usage.Object);
+}
+
+bool UInventoryBagComponent::tryAddItem(UItemData* item_data, int32 const id, UItemComponent* item_component /** = nullptr */, int32 const durability /** = INDEX_NONE */)
+{
+    INVENTORY_LLM_SCOPE();
+    check(IsValid(item_data));
+    // Have the drop actor ready by the time the item gets removed.
+    item_data->streamInDropActor();
+
+    switch (item_data->Category)
+    {
+    case EItemCategory::Resource:
+        {
+            UResourceData* resource_data = Cast<UResourceData>(item_data);
+            if (resource_data == nullptr)
+            {
+                UE_LOG(LogInventorySystem, Error, TEXT("Trying to add resource with invalid resource data type to the bag [%s]"), *GetPathName());
+                return false;
+            }
+            return tryAddResource(resource_data, id);
+        }
+    case EItemCategory::Tool:
+        {
+            UToolData* tool_data = Cast<UToolData>(item_data);
+            if (tool_data == nullptr)
+            {
+                UE_LOG(LogInventorySystem, Error, TEXT("Trying to add tool with invalid tool data type to the bag [%s]"), *GetPathName());
+                return false;
+            }
+            int32 tool_durability = durability != INDEX_NONE ? durability : tool_data->MaxDurability;
+            if (item_component != nullptr && durability == INDEX_NONE)
+            {
+                UToolComponent* tool_component = Cast<UToolComponent>(item_component);
+                if (tool_component == nullptr)
+                {
+                    UE_LOG(LogInventorySystem, Error, TEXT("Trying to add invalid tool to the bag [%s]"), *GetPathName());
+                    return false;
+                }
+                // Components never registered have no durability yet and come in as new.
+                if (tool_component->Durability >= 0) tool_durability = tool_component->Durability;
+            }
+            return tryAddTool(tool_data, id, tool_durability);
+        }
+    case EItemCategory::None: ;
+    default:
+        {
+            UE_LOG(LogInventorySystem, Warning, TEXT("Trying to add item with invalid category to the bag [%s]"), *GetPathName());
+            return false;
+        }
+    }
+}
+
+bool UInventoryBagComponent::tryRemoveItem(UItemData* item_data, int32& remove_id, int32* out_durability /** = nullptr */)
+{
+    INVENTORY_LLM_SCOPE();
+    check(IsValid(item_data));
+
+    // Remove tool or resource?
+    switch (item_data->Category)
+    {
+    case EItemCategory::Resource:
+        {
+            UResourceData* resource_data = Cast<UResourceData>(item_data);
+            if (resource_data == nullptr)
+            {
+                UE_LOG(LogInventorySystem, Error, TEXT("Trying to remove resource with invalid resource data type from the bag [%s]"), *GetPathName());
+                return false;
+            }
+            return tryRemoveResource(resource_data, remove_id);
+        }
+    case EItemCategory::Tool:
+        {
+            UToolData* tool_data = Cast<UToolData>(item_data);
+            if (tool_data == nullptr)
+            {
+                UE_LOG(LogInventorySystem, Error, TEXT("Trying to remove tool with invalid tool data type from the bag [%s]"), *GetPathName());
+                return false;
+            }
+            return tryRemoveTool(tool_data, remove_id, out_durability);
+        }
+    case EItemCategory::None: ;
+    default:
+        {
+            UE_LOG(LogInventorySystem, Warning, TEXT("Trying to remove item with invalid category from the bag [%s]"), *GetPathName());
+            return false;
+        }
+    }
+}
+
+bool UInventoryBagComponent::tryAddResource(UResourceData* resource_data, int32 const id)
+{
+    TOptional<FItemBagLimitValues> const bag_limit = getItemLimit(resource_data);
+    checkf(bag_limit.IsSet(), TEXT("Missing limits for [%s], hasValidItemLimits should be called before adding."), *resource_data->GetPathName());
+    // 0 max quantity limit check should already be performed at this point.
+    check(bag_limit->MaxQuantity > 0 && bag_limit->MaxStackSize > 0);
+
+    // This will point to either newly added resources data or already present one.
+    // Just a cache to avoid a double find on the map.
+    FBagResourcesData* resources_data = Resources.find(resource_data);
+
+    // Check if we already have data for this resource type.
+    // See if we can add another slot in case we need it.
+    if (resources_data == nullptr)
+    {
+        if (Resources.UsedSlots >= BagProperties->MaxResourceSlots)
+        {
+            UE_LOG(LogInventorySystem, Verbose, TEXT("Can't add another resource slot. Max slots capacity reached for bag [%s]."), *GetPathName());
+            return false;
+        }
+        trackStorageGrowth(Resources.Types);
+        resources_data = &Resources.add(resource_data);
+        resources_data->Slots = takeRecycled(recycled_resource_slot_lists, 0);
+        UE_LOG(LogInventorySystem, Verbose, TEXT("Added new resource type [%s] to bag [%s]."), *resource_data->GetPathName(), *GetPathName());
+    }
+
+    // We can now treat both paths (newly added resource type and already present resource type) the same way.
+    if (resources_data->ResourceQuantity >= bag_limit->MaxQuantity)
+    {
+        UE_LOG(LogInventorySystem, Verbose, TEXT("Can't add resource. Max quantity capacity reached for bag [%s]."), *GetPathName());
+        return false;
+    }
+
+    // Find first slot with free space. Slots before the cursor are known to be full.
+    int32& first_free_slot = resources_data->FirstFreeSlot;
+    while (first_free_slot < resources_data->Slots.Num() && resources_data->Slots[first_free_slot].Num() >= bag_limit->MaxStackSize) ++first_free_slot;
+    if (first_free_slot < resources_data->Slots.Num())
+    {
+        FBagResourceSlot& slot = resources_data->Slots[first_free_slot];
+        trackStorageGrowth(slot.ResourceIds);
+        slot.ResourceIds.Add(id);
+        ++resources_data->ResourceQuantity;
+        notifyQuantityChanged(resource_data, resources_data->ResourceQuantity - 1, resources_data->ResourceQuantity);
+        notifyResourceSlotChanged(resource_data, slot.Id, slot.ResourceIds.Num() - 1, &slot);
+        return true;
+    }
+
+    // No free slot, try to create one if possible.
+    if (Resources.UsedSlots >= BagProperties->MaxResourceSlots)
+    {
+        UE_LOG(LogInventorySystem, Verbose, TEXT("Can't add another resource slot. Max slots capacity reached for bag [%s]."), *GetPathName());
+        return false;
+    }
+    // Add new slot and add item to it
+    // Stacks are recycled and sized for a full stack, so that they never grow.
+    trackStorageGrowth(resources_data->Slots);
+    int32 const new_slot_index = resources_data->Slots.Add({slot_ids_pool.Pop(), takeRecycled(recycled_resource_stacks, bag_limit->MaxStackSize)});
+    FBagResourceSlot& new_slot = resources_data->Slots[new_slot_index];
+    if (!slot_index_dirty) indexAddedSlot(resource_data, new_slot.Id, new_slot_index, slot_locations, resource_slot_order);
+    new_slot.ResourceIds.Add(id);
+    ++Resources.UsedSlots;
+    UE_LOG(LogInventorySystem, Verbose, TEXT("Added new resource slot to bag [%s]."), *GetPathName());
+    ++resources_data->ResourceQuantity;
+    notifyQuantityChanged(resource_data, resources_data->ResourceQuantity - 1, resources_data->ResourceQuantity);
+    notifyResourceSlotChanged(resource_data, new_slot.Id, 0, &new_slot);
+    return true;
+}
+
+bool UInventoryBagComponent::tryRemoveResource(UResourceData* resource_data, int32& remove_id)
+{
+    check(IsValid(resource_data) && remove_id >= -1);
+
+    FBagResourcesData* bag_resources_data_ptr = Resources.find(resource_data);
+    // We actually don't have this kind of resource type.
+    if (bag_resources_data_ptr == nullptr)
+    {
+        UE_LOG(LogInventorySystem, Display, TEXT("Can't remove item [%s] from bag [%s]. No resource of this type found."), *resource_data->GetPathName(), *GetPathName());
+        return false;
+    }
+
+    FBagResourcesData& bag_resources_data = *bag_resources_data_ptr;
+    check(bag_resources_data.ResourceQuantity > 0); // Since we remove any resource data mapping when the quantity reaches 0, this should be an error if hit.
+
+    FBagResourceSlot* selected_resource_slot = nullptr;
+    // Just remove the last item from the last slot
+    if (remove_id == -1)
+    {
+        selected_resource_slot = &bag_resources_data.Slots.Last();
+        check(selected_resource_slot->ResourceIds.Num() > 0); // We remove empty slots. Count as error if this happens.
+        remove_id = selected_resource_slot->ResourceIds.Pop();
+    }
+    else // Or search for the specified item ID in all the slots.
+    {
+        for (auto&& slot : bag_resources_data.Slots)
+        {
+            check(slot.ResourceIds.Num() > 0); // We remove empty slots. Count as error if this happens.
+            int const removed_count = slot.ResourceIds.Remove(remove_id);
+            check(removed_count <= 1); // Should only ever have unique ids
+            // Early out when we find the item.
+            if (removed_count > 0)
+            {
+                selected_resource_slot = &slot;
+                break;
+            }
+        }
+    }
+
+    // When searching for a specific ID we might not actually
+    // have it (ideally shouldn't happen), hence the slot could not be found.
+    if (selected_resource_slot == nullptr)
+    {
+        UE_LOG(LogInventorySystem, Display, TEXT("Can't remove item [%s] from bag [%s]. Resource with ID [%d] not found."), *resource_data->GetPathName(), *GetPathName(), remove_id);
+        return false;
+    }
+
+    // The slot has free space now. When removed, the last slot takes its place and might not be full either.
+    int32 const selected_slot_index = selected_resource_slot - bag_resources_data.Slots.GetData();
+    bag_resources_data.FirstFreeSlot = FMath::Min(bag_resources_data.FirstFreeSlot, selected_slot_index);
+
+    // Check for empty slot and remove it
+    bool bSlotRemoved = false;
+    const int32 removed_slot_id = selected_resource_slot->Id; // Save the id in case we remove the slot data.
+    if (selected_resource_slot->ResourceIds.Num() == 0)
+    {
+        recycle(recycled_resource_stacks, selected_resource_slot->ResourceIds);
+        bag_resources_data.Slots.RemoveAtSwap(selected_slot_index, 1, false);
+        if (!slot_index_dirty) unindexRemovedSlot(bag_resources_data.Slots, removed_slot_id, slot_locations, resource_slot_order);
+        UE_LOG(LogInventorySystem, Verbose, TEXT("Removed one resource slot [type: %s] from bag [%s]."), *resource_data->GetPathName(), *GetPathName());
+        --Resources.UsedSlots;
+        slot_ids_pool.Push(removed_slot_id);
+        bSlotRemoved = true;
+    }
+    int32 const old_slot_count = bSlotRemoved ? 1 : selected_resource_slot->ResourceIds.Num() + 1;
+    int32 const new_quantity = --bag_resources_data.ResourceQuantity;
+    // Remove mappings when we don't have any more resources of this type
+    if (new_quantity == 0)
+    {
+        UE_LOG(LogInventorySystem, Verbose, TEXT("Removed resource mapping [type: %s] from bag [%s]."), *resource_data->GetPathName(), *GetPathName());
+        recycle(recycled_resource_slot_lists, bag_resources_data.Slots);
+        Resources.remove(resource_data);
+    }
+
+    notifyQuantityChanged(resource_data, new_quantity + 1, new_quantity);
+    notifyResourceSlotChanged(resource_data, removed_slot_id, old_slot_count, bSlotRemoved ? nullptr : selected_resource_slot);
+    // Refill the hole from the last stack. For an already compacted type this moves at most one stack worth of items.
+    // Slot listeners might have added types and moved the type data around, look it up again.
+    if (bCompactStacksOnRemove && new_quantity > 0)
+    {
+        if (FBagResourcesData* resources_data = Resources.find(resource_data)) compactResourceSlots(resource_data, *resources_data, MAX_int32);
+    }
+    return true;
+}
+
+bool UInventoryBagComponent::tryAddTool(UToolData* tool_data, int32 const id, int32 const durability)
+{
+    TOptional<FItemBagLimitValues> const bag_limit = getItemLimit(tool_data);
+    checkf(bag_limit.IsSet(), TEXT("Missing limits for [%s], hasValidItemLimits should be called before adding."), *tool_data->GetPathName());
+    // 0 max quantity limit check should already be performed at this point.
+    check(bag_limit->MaxQuantity > 0 && bag_limit->MaxStackSize > 0);
+
+    // This will point to either newly added tools data or already present one.
+    // Just a cache to avoid a double find on the map.
+    FBagToolsData* tools_data = Tools.find(tool_data);
+    // Check if we already have data for this tool type.
+    // See if we can add another slot in case we need it.
+    if (tools_data == nullptr)
+    {
+        if (Tools.UsedSlots >= BagProperties->MaxToolsSlots)
+        {
+            UE_LOG(LogInventorySystem, Verbose, TEXT("Can't add another tool slot. Max slots capacity reached for bag [%s]."), *GetPathName());
+            return false;
+        }
+        trackStorageGrowth(Tools.Types);
+        tools_data = &Tools.add(tool_data);
+        tools_data->Slots = takeRecycled(recycled_tool_slot_lists, 0);
+        UE_LOG(LogInventorySystem, Verbose, TEXT("Added new tool type [%s] to bag [%s]."), *tool_data->GetPathName(), *GetPathName());
+    }
+
+    // We can now treat both paths (newly added tool type and already present tool type) the same way.
+    if (tools_data->ToolQuantity >= bag_limit->MaxQuantity)
+    {
+        UE_LOG(LogInventorySystem, Verbose, TEXT("Can't add tool. Max quantity capacity reached for bag [%s]."), *GetPathName());
+        return false;
+    }
+
+    // Find first slot with free space. Slots before the cursor are known to be full.
+    int32& first_free_slot = tools_data->FirstFreeSlot;
+    while (first_free_slot < tools_data->Slots.Num() && tools_data->Slots[first_free_slot].Num() >= bag_limit->MaxStackSize) ++first_free_slot;
+    if (first_free_slot < tools_data->Slots.Num())
+    {
+        FBagToolSlot& slot = tools_data->Slots[first_free_slot];
+        trackStorageGrowth(slot.ToolsInfo);
+        slot.ToolsInfo.Add({id, durability});
+        tool_instances.add(id, tool_data, durability, slot.Id);
+        ++tools_data->ToolQuantity;
+        notifyQuantityChanged(tool_data, tools_data->ToolQuantity - 1, tools_data->ToolQuantity);
+        notifyToolSlotChanged(tool_data, slot.Id, slot.ToolsInfo.Num() - 1, &slot);
+        return true;
+    }
+
+    // No free slot, try to create one if possible.
+    if (Tools.UsedSlots >= BagProperties->MaxToolsSlots)
+    {
+        UE_LOG(LogInventorySystem, Verbose, TEXT("Can't add another tool slot. Max slots capacity reached for bag [%s]."), *GetPathName());
+        return false;
+    }
+
+    // Add new slot and add item to it
+    // Stacks are recycled and sized for a full stack, so that they never grow.
+    trackStorageGrowth(tools_data->Slots);
+    int32 const new_slot_index = tools_data->Slots.Add({slot_ids_pool.Pop(), takeRecycled(recycled_tool_stacks, bag_limit->MaxStackSize)});
+    FBagToolSlot& new_slot = tools_data->Slots[new_slot_index];
+    if (!slot_index_dirty) indexAddedSlot(tool_data, new_slot.Id, new_slot_index, slot_locations, tool_slot_order);
+    new_slot.ToolsInfo.Add({id, durability});
+    tool_instances.add(id, tool_data, durability, new_slot.Id);
+    ++Tools.UsedSlots;
+    UE_LOG(LogInventorySystem, Verbose, TEXT("Added new tool slot to bag [%s]."), *GetPathName());
+    ++tools_data->ToolQuantity;
+    notifyQuantityChanged(tool_data, tools_data->ToolQuantity - 1, tools_data->ToolQuantity);
+    notifyToolSlotChanged(tool_data, new_slot.Id, 0, &new_slot);
+    return true;
+}
+
+bool UInventoryBagComponent::tryRemoveTool(UToolData* tool_data, int32& remove_id, int32* out_durability /** = nullptr */)
+{
+    check(IsValid(tool_data) && remove_id >= -1);
+
+    FBagToolsData* bag_tools_data_ptr = Tools.find(tool_data);
+    // We actually don't have this kind of tool type.
+    if (bag_tools_data_ptr == nullptr)
+    {
+        UE_LOG(LogInventorySystem, Display, TEXT("Can't remove item [%s] from bag [%s]. No tool of this type found."), *tool_data->GetPathName(), *GetPathName());
+        return false;
+    }
+
+    FBagToolsData& bag_tools_data = *bag_tools_data_ptr;
+    check(bag_tools_data.ToolQuantity > 0); // Since we remove any tool data mapping when the quantity reaches 0, this should be an error if hit.
+
+    FBagToolSlot* selected_tool_slot = nullptr;
+    // Just remove the last item from the last slot
+    if (remove_id == -1)
+    {
+        selected_tool_slot = &bag_tools_data.Slots.Last();
+        check(selected_tool_slot->ToolsInfo.Num() > 0); // We remove empty slots. Count as error if this happens.
+        remove_id = selected_tool_slot->ToolsInfo.Pop().ToolId;
+    }
+    else // Or search for the specified item ID in all the slots.
+    {
+        for (auto&& slot : bag_tools_data.Slots)
+        {
+            check(slot.ToolsInfo.Num() > 0); // We remove empty slots. Count as error if this happens.
+            int32 const tool_index = slot.ToolsInfo.IndexOfByPredicate([remove_id](const FBagToolInfo& tool_info) { return tool_info.ToolId == remove_id; });
+            // Early out when we find the item. Ids are unique so there can't be any other match.
+            if (tool_index != INDEX_NONE)
+            {
+                slot.ToolsInfo.RemoveAt(tool_index);
+                selected_tool_slot = &slot;
+                break;
+            }
+        }
+    }
+
+    // When searching for a specific ID we might not actually
+    // have it (ideally shouldn't happen), hence the slot could not be found.
+    if (selected_tool_slot == nullptr)
+    {
+        UE_LOG(LogInventorySystem, Display, TEXT("Can't remove item [%s] from bag [%s]. Tool with ID [%d] not found."), *tool_data->GetPathName(), *GetPathName(), remove_id);
+        return false;
+    }
+
+    int32 const removed_durability = tool_instances.remove(remove_id);
+    if (out_durability != nullptr) *out_durability = removed_durability;
+
+    // The slot has free space now. When removed, the last slot takes its place and might not be full either.
+    int32 const selected_slot_index = selected_tool_slot - bag_tools_data.Slots.GetData();
+    bag_tools_data.FirstFreeSlot = FMath::Min(bag_tools_data.FirstFreeSlot, selected_slot_index);
+
+    // Check for empty slot and remove it
+    bool bSlotRemoved = false;
+    const int32 removed_slot_id = selected_tool_slot->Id; // Save the id in case we remove the slot data.
+    if (selected_tool_slot->ToolsInfo.Num() == 0)
+    {
+        recycle(recycled_tool_stacks, selected_tool_slot->ToolsInfo);
+        bag_tools_data.Slots.RemoveAtSwap(selected_slot_index, 1, false);
+        if (!slot_index_dirty) unindexRemovedSlot(bag_tools_data.Slots, removed_slot_id, slot_locations, tool_slot_order);
+        UE_LOG(LogInventorySystem, Verbose, TEXT("Removed one tool slot [type: %s] from bag [%s]."), *tool_data->GetPathName(), *GetPathName());
+        --Tools.UsedSlots;
+        slot_ids_pool.Push(removed_slot_id);
+        bSlotRemoved = true;
+    }
+    int32 const old_slot_count = bSlotRemoved ? 1 : selected_tool_slot->ToolsInfo.Num() + 1;
+    int32 const new_quantity = --bag_tools_data.ToolQuantity;
+    // Remove mappings when we don't have any more resources of this type
+    if (new_quantity == 0)
+    {
+        UE_LOG(LogInventorySystem, Verbose, TEXT("Removed tool mapping [type: %s] from bag [%s]."), *tool_data->GetPathName(), *GetPathName());
+        recycle(recycled_tool_slot_lists, bag_tools_data.Slots);
+        Tools.remove(tool_data);
+    }
+
+    notifyQuantityChanged(tool_data, new_quantity + 1, new_quantity);
+    notifyToolSlotChanged(tool_data, removed_slot_id, old_slot_count, bSlotRemoved ? nullptr : selected_tool_slot);
+    // Refill the hole from the last stack. For an already compacted type this moves at most one stack worth of items.
+    // Slot listeners might have added types and moved the type data around, look it up again.
+    if (bCompactStacksOnRemove && new_quantity > 0)
+    {
+        if (FBagToolsData* tools_data = Tools.find(tool_data)) compactToolSlots(tool_data, *tools_data, MAX_int32);
+    }
+    return true;
+}
+
+bool UInventoryBagComponent::isValidItemData(UItemData* item_data) const
+{
+    if (!IsValid(item_data))
+    {
+        UE_LOG(LogInventorySystem, Error, TEXT("Invalid item data for bag [%s]"), *GetPathName());
+        return false;
+    }
+    return true;
+}
+
+bool UInventoryBagComponent::hasValidItemLimits(UItemData* item_data) const
+{
+    if (!IsValid(item_data))
+    {
+        UE_LOG(LogInventorySystem, Error, TEXT("Invalid bag limits [Bag: %s] for null/invalid item_data."), *GetPathName());
+        return false;
+    }
+    TOptional<FItemBagLimitValues> const bag_limit = getItemLimit(item_data);
+    if (!bag_limit.IsSet())
+    {
+        UE_LOG(LogInventorySystem, Error, TEXT("Invalid bag limits [Bag: %s] for item: %s"), *GetPathName(), *item_data->GetPathName());
+        return false;
+    }
+
+    // You usually wouldn't have items with 0 max quantity.
+    if (bag_limit->MaxQuantity <= 0)
+    {
+        UE_LOG(LogInventorySystem, Display, TEXT("Can't add item [%s] to bag [%s]. Max ResourceQuantity = 0"), *item_data->GetPathName(), *GetPathName());
+        return false;
+    }
+    return true;
+}
+
+AActor* UInventoryBagComponent::spawnDropActor(UItemData* item_data)
+{
+    UClass* drop_actor_class = item_data->loadDropActor();
+    if (drop_actor_class == nullptr) return nullptr;
+    AActor* spawn_actor = GetWorld()->SpawnActor(drop_actor_class);
+    if (spawn_actor == nullptr) return nullptr;
+    UItemComponent* actor_item_comp = Cast<UItemComponent>(spawn_actor->GetComponentByClass(UItemComponent::StaticClass()));
+    if (actor_item_comp != nullptr) actor_item_comp->Execute_OnItemDropped(actor_item_comp, this);
+    return spawn_actor;
+}
+
+UInventoryWorldStore* UInventoryBagComponent::getWorldStore() const
+{
+    return store_handle.isSet() ? UInventoryWorldStore::get(this) : nullptr;
+}
+
+bool UInventoryBagComponent::isUnsupportedByStore(const TCHAR* operation) const
+{
+    if (!store_handle.isSet()) return false;
+    UE_LOG(LogInventorySystem, Warning, TEXT("[%s] is not available for bag [%s], its contents are kept in the world inventory store."), operation, *GetPathName());
+    return true;
+}
+
+TOptional<FItemBagLimitValues> UInventoryBagComponent::getItemLimit(UItemData* item_data) const
+{
+    return BagProperties->resolveLimit(item_data);
+}
+
+int32 UInventoryBagComponent::getStoredQuantity(UItemData* item_data) const
+{
+    if (UResourceData* resource_data = Cast<UResourceData>(item_data))
+    {
+        const FBagResourcesData* resources_data = Resources.find(resource_data);
+        return resources_data != nullptr ? resources_data->ResourceQuantity : 0;
+    }
+    if (UToolData* tool_data = Cast<UToolData>(item_data))
+    {
+        const FBagToolsData* tools_data = Tools.find(tool_data);
+        return tools_data != nullptr ? tools_data->ToolQuantity : 0;
+    }
+    return 0;
+}
+
+bool UInventoryBagComponent::canApplyQuantityChange(UItemData* item_data, int32 const remove_quantity, int32 const add_quantity, int32& out_slots_delta) const
+{
+    check(IsValid(item_data) && remove_quantity >= 0 && add_quantity >= 0);
+    out_slots_delta = 0;
+
+    bool const bIsResource = item_data->Category == EItemCategory::Resource && item_data->IsA<UResourceData>();
+    bool const bIsTool = item_data->Category == EItemCategory::Tool && item_data->IsA<UToolData>();
+    if (!bIsResource && !bIsTool)
+    {
+        UE_LOG(LogInventorySystem, Warning, TEXT("Invalid item category or data type [%s] for bag [%s]"), *item_data->GetPathName(), *GetPathName());
+        return false;
+    }
+
+    int32 const quantity = getStoredQuantity(item_data);
+    if (remove_quantity > quantity)
+    {
+        UE_LOG(LogInventorySystem, Display, TEXT("Can't remove [%d] items [%s] from bag [%s]. Only [%d] available."), remove_quantity, *item_data->GetPathName(), *GetPathName(), quantity);
+        return false;
+    }
+
+    // Removing alone doesn't need limits, removed items only give back space.
+    int32 max_stack_size = 1;
+    if (add_quantity > 0)
+    {
+        if (!hasValidItemLimits(item_data)) return false;
+        TOptional<FItemBagLimitValues> const bag_limit = getItemLimit(item_data);
+        if (quantity - remove_quantity + add_quantity > bag_limit->MaxQuantity)
+        {
+            UE_LOG(LogInventorySystem, Display, TEXT("Can't add [%d] items [%s] to bag [%s]. Max quantity capacity reached."), add_quantity, *item_data->GetPathName(), *GetPathName());
+            return false;
+        }
+        max_stack_size = bag_limit->MaxStackSize;
+    }
+
+    if (bIsResource)
+    {
+        const FBagResourcesData* resources_data = Resources.find(Cast<UResourceData>(item_data));
+        out_slots_delta = resources_data != nullptr
+                              ? computeSlotsDelta(resources_data->Slots, remove_quantity, add_quantity, max_stack_size)
+                              : computeSlotsDelta(TArray<FBagResourceSlot>{}, 0, add_quantity, max_stack_size);
+    }
+    else
+    {
+        const FBagToolsData* tools_data = Tools.find(Cast<UToolData>(item_data));
+        out_slots_delta = tools_data != nullptr
+                              ? computeSlotsDelta(tools_data->Slots, remove_quantity, add_quantity, max_stack_size)
+                              : computeSlotsDelta(TArray<FBagToolSlot>{}, 0, add_quantity, max_stack_size);
+    }
+    return true;
+}
+
+bool UInventoryBagComponent::canReceiveItems(UItemData* item_data, int32 const count) const
+{
+    if (!IsValid(BagProperties) || item_ids_pool.Num() < count) return false;
+    int32 slots_delta = 0;
+    if (!canApplyQuantityChange(item_data, 0, count, slots_delta)) return false;
+    int32 const used_slots = item_data->Category == EItemCategory::Resource ? Resources.UsedSlots : Tools.UsedSlots;
+    int32 const max_slots = item_data->Category == EItemCategory::Resource ? BagProperties->MaxResourceSlots : BagProperties->MaxToolsSlots;
+    return used_slots + slots_delta <= max_slots;
+}
+
+void UInventoryBagComponent::moveItem(UInventoryBagComponent* from, UInventoryBagComponent* to, UItemData* item_data, int32 remove_id)
+{
+    int32 durability = INDEX_NONE;
+    verify(from->tryRemoveItem(item_data, remove_id, &durability));
+    from->item_ids_pool.Push(remove_id);
+
+    // Registered item components follow the item to its new bag, no drop or pickup takes place.
+    UItemComponent* item_comp = nullptr;
+    if (UItemComponent* const* item_comp_ptr = from->item_comp_to_id.FindKey(remove_id))
+    {
+        item_comp = *item_comp_ptr;
+        from->item_comp_to_id.Remove(item_comp);
+    }
+
+    FScopedItemPoolIdTransaction id_transaction{to->item_ids_pool};
+    verify(to->tryAddItem(item_data, id_transaction.Id(), nullptr, durability));
+    id_transaction.commit();
+    if (IsValid(item_comp))
+    {
+        to->item_comp_to_id.Add(item_comp, id_transaction.Id());
+        item_comp->OwningBag = to;
+    }
+}
+
+int32 UInventoryBagComponent::compactResourceSlots(UResourceData* resource_data, FBagResourcesData& resources_data, int32 const max_moves)
+{
+    TOptional<FItemBagLimitValues> const bag_limit = getItemLimit(resource_data);
+    if (!bag_limit.IsSet() || bag_limit->MaxStackSize <= 0) return 0;
+    return compactSlots<FBagResourceSlot>(resources_data.Slots, resources_data.FirstFreeSlot, bag_limit->MaxStackSize, max_moves, recycled_resource_stacks,
+                                          [this, resource_data](FBagResourceSlot& slot, int32 const old_count)
+                                          {
+                                              notifyResourceSlotChanged(resource_data, slot.Id, old_count, &slot);
+                                          },
+                                          [this, resource_data, &resources_data](int32 const slot_id, int32 const old_count)
+                                          {
+                                              if (!slot_index_dirty) unindexRemovedSlot(resources_data.Slots, slot_id, slot_locations, resource_slot_order);
+                                              --Resources.UsedSlots;
+                                              slot_ids_pool.Push(slot_id);
+                                              notifyResourceSlotChanged(resource_data, slot_id, old_count, nullptr);
+                                          });
+}
+
+int32 UInventoryBagComponent::compactToolSlots(UToolData* tool_data, FBagToolsData& tools_data, int32 const max_moves)
+{
+    TOptional<FItemBagLimitValues> const bag_limit = getItemLimit(tool_data);
+    if (!bag_limit.IsSet() || bag_limit->MaxStackSize <= 0) return 0;
+    return compactSlots<FBagToolSlot>(tools_data.Slots, tools_data.FirstFreeSlot, bag_limit->MaxStackSize, max_moves, recycled_tool_stacks,
+                                      [this, tool_data](FBagToolSlot& slot, int32 const old_count)
+                                      {
+                                          // Tools moved into the slot now belong to it.
+                                          for (auto&& tool_info : slot.ToolsInfo) tool_instances.SlotIds[tool_instances.find(tool_info.ToolId)] = slot.Id;
+                                          notifyToolSlotChanged(tool_data, slot.Id, old_count, &slot);
+                                      },
+                                      [this, tool_data, &tools_data](int32 const slot_id, int32 const old_count)
+                                      {
+                                          if (!slot_index_dirty) unindexRemovedSlot(tools_data.Slots, slot_id, slot_locations, tool_slot_order);
+                                          --Tools.UsedSlots;
+                                          slot_ids_pool.Push(slot_id);
+                                          notifyToolSlotChanged(tool_data, slot_id, old_count, nullptr);
+                                      });
+}
+
+void UInventoryBagComponent::releaseItemId(int32 const id)
+{
+    item_ids_pool.Push(id);
+    // Find whether one of the registered item components has the id we want to remove.
+    UItemComponent* const* item_comp = item_comp_to_id.FindKey(id);
+    if (item_comp == nullptr) return;
+
+    // Item component might have been destroyed.
+    // Maybe the user added the item via item component and then destroyed the owning actor.
+    if (IsValid(*item_comp))
+    {
+        (*item_comp)->Execute_OnItemDropped(*item_comp, this);
+    }
+    else
+    {
+        UE_LOG(LogInventorySystem, Warning,
+               TEXT(
+                   "You have removed an item that was registered as an item component but that does not exist anymore. That most likely means its owning actor was deleted. If you immediately delete an item actor on pickup consider just adding the item data to the bag."
+               ));
+    }
+    item_comp_to_id.Remove(*item_comp); // This will also clear out NULL (deleted) components.
+}
+
+void UInventoryBagComponent::markSnapshotDirty(UItemData* item_data, int32 const slot_id)
+{
+    // No snapshot taken yet, the first one copies everything anyway.
+    if (!last_snapshot.IsValid()) return;
+    snapshot_dirty_types.Add(item_data);
+    snapshot_dirty_slots.Add(slot_id);
+}
+
+void UInventoryBagComponent::notifyQuantityChanged(UItemData* item_data, int32 const old_quantity, int32 const new_quantity)
+{
+    INVENTORY_LLM_SCOPE();
+    journal.recordItemChange(item_data, old_quantity, new_quantity);
+    int32 const delta = new_quantity - old_quantity;
+    if (UResourceData* resource_data = Cast<UResourceData>(item_data))
+    {
+        int32 const category_index = static_cast<int32>(resource_data->ResourceCategory);
+        if (!resource_category_quantities.IsValidIndex(category_index)) resource_category_quantities.SetNumZeroed(category_index + 1);
+        resource_category_quantities[category_index] += delta;
+    }
+    else if (UToolData* tool_data = Cast<UToolData>(item_data))
+    {
+        int32 const category_index = static_cast<int32>(tool_data->ToolCategory);
+        if (!tool_category_quantities.IsValidIndex(category_index)) tool_category_quantities.SetNumZeroed(category_index + 1);
+        tool_category_quantities[category_index] += delta;
+    }
+    for (const FGameplayTag& tag : item_data->getTagsWithParents())
+    {
+        FBagTagQuantity* tag_quantity_ptr = nullptr;
+        trackAllocatedSizeGrowth(tag_quantities, [&]() { tag_quantity_ptr = &tag_quantities.FindOrAdd(tag); });
+        FBagTagQuantity& tag_quantity = *tag_quantity_ptr;
+        tag_quantity.Quantity += delta;
+        if (old_quantity == 0 && new_quantity > 0)
+        {
+            trackStorageGrowth(tag_quantity.Types);
+            tag_quantity.Types.Add(item_data);
+        }
+        else if (old_quantity > 0 && new_quantity == 0) tag_quantity.Types.Remove(item_data);
+        // Tags no held type has anymore are dropped, bags only index what they hold.
+        if (tag_quantity.Types.Num() == 0) tag_quantities.Remove(tag);
+    }
+
+    if (pending_changes != nullptr)
+    {
+        trackAllocatedSizeGrowth(pending_changes->Items, [&]() { pending_changes->addItemChange(item_data, old_quantity, new_quantity); });
+    }
+}
+
+void UInventoryBagComponent::rebuildQuantityTotals()
+{
+    resource_category_quantities.Reset();
+    tool_category_quantities.Reset();
+    tag_quantities.Reset();
+    TGuardValue<FInventoryBagChangeSet*> no_batch_guard{pending_changes, nullptr};
+    for (auto&& resources_data : Resources.Types) notifyQuantityChanged(resources_data.ResourceData, 0, resources_data.ResourceQuantity);
+    for (auto&& tools_data : Tools.Types) notifyQuantityChanged(tools_data.ToolData, 0, tools_data.ToolQuantity);
+}
+
+void UInventoryBagComponent::notifyResourceSlotChanged(UResourceData* resource_data, int32 const slot_id, int32 const old_count, const FBagResourceSlot* slot)
+{
+    INVENTORY_LLM_SCOPE();
+    markSnapshotDirty(resource_data, slot_id);
+    journal.recordSlotChange(resource_data, slot_id, old_count, slot != nullptr ? slot->Num() : 0);
+    if (pending_changes != nullptr)
+    {
+        trackAllocatedSizeGrowth(pending_changes->Slots, [&]() { pending_changes->addSlotChange(resource_data, slot_id, old_count, slot != nullptr ? slot->Num() : 0); });
+        return;
+    }
+    if (OnSlotChangedNative.IsBound()) OnSlotChangedNative.Broadcast(this, {resource_data, slot_id, old_count, slot != nullptr ? slot->Num() : 0});
+    // Check for listeners first, broadcasting copies the slot even with nothing bound.
+    if (slot == nullptr)
+    {
+        if (OnResourceSlotRemoved.IsBound()) OnResourceSlotRemoved.Broadcast(this, resource_data, slot_id, {slot_id});
+    }
+    else if (old_count == 0)
+    {
+        if (OnResourceSlotAdded.IsBound()) OnResourceSlotAdded.Broadcast(this, resource_data, slot_id, *slot);
+    }
+    else if (OnResourceSlotUpdated.IsBound()) OnResourceSlotUpdated.Broadcast(this, resource_data, slot_id, *slot);
+}
+
+void UInventoryBagComponent::notifyToolSlotChanged(UToolData* tool_data, int32 const slot_id, int32 const old_count, FBagToolSlot* slot)
+{
+    INVENTORY_LLM_SCOPE();
+    markSnapshotDirty(tool_data, slot_id);
+    int32 const new_count = slot != nullptr ? slot->Num() : 0;
+    // Durability updates leave the count as is, they aren't journaled and don't use up its capacity.
+    if (new_count != old_count) journal.recordSlotChange(tool_data, slot_id, old_count, new_count);
+    if (pending_changes != nullptr)
+    {
+        trackAllocatedSizeGrowth(pending_changes->Slots, [&]() { pending_changes->addSlotChange(tool_data, slot_id, old_count, slot != nullptr ? slot->Num() : 0); });
+        return;
+    }
+    if (slot != nullptr) refreshToolSlot(*slot);
+    if (OnSlotChangedNative.IsBound()) OnSlotChangedNative.Broadcast(this, {tool_data, slot_id, old_count, slot != nullptr ? slot->Num() : 0});
+    if (slot == nullptr)
+    {
+        if (OnToolSlotRemoved.IsBound()) OnToolSlotRemoved.Broadcast(this, tool_data, slot_id, {slot_id});
+    }
+    else if (old_count == 0)
+    {
+        if (OnToolSlotAdded.IsBound()) OnToolSlotAdded.Broadcast(this, tool_data, slot_id, *slot);
+    }
+    else if (OnToolSlotUpdated.IsBound()) OnToolSlotUpdated.Broadcast(this, tool_data, slot_id, *slot);
+}
+
+void UInventoryBagComponent::refreshToolSlot(FBagToolSlot& slot) const
+{
+    for (auto&& tool_info : slot.ToolsInfo) tool_info.Durability = tool_instances.Durabilities[tool_instances.find(tool_info.ToolId)];
+}
+
+void UInventoryBagComponent::updateSlotIndex() const
+{
+    INVENTORY_LLM_SCOPE();
+    if (!slot_index_dirty) return;
+    slot_locations.Reset();
+    resource_slot_order.Reset();
+    tool_slot_order.Reset();
+    for (auto&& resources_data : Resources.Types) indexSlots(resources_data.ResourceData, resources_data.Slots, slot_locations, resource_slot_order);
+    for (auto&& tools_data : Tools.Types) indexSlots(tools_data.ToolData, tools_data.Slots, slot_locations, tool_slot_order);
+    resource_slot_order.Sort();
+    tool_slot_order.Sort();
+    slot_index_dirty = false;
+}
+
+void UInventoryBagComponent::notifyToolDurabilitiesChanged()
+{
+    // Slots get marked dirty for snapshots once their durability is actually copied, see refreshToolSlots.
+    publishReadView();
+    // Servers decaying tools with nothing bound never pay for copying durability back into the slots.
+    if (!OnInventoryBagUpdated.IsBound()) return;
+    refreshToolSlots();
+    OnInventoryBagUpdated.Broadcast(this);
+}
+
+void UInventoryBagComponent::broadcastChangeSet(FInventoryBagChangeSet& changes)
+{
+    changes.removeNoOps();
+    if (changes.isEmpty()) return;
+    refreshToolSlots();
+    if (OnSlotChangedNative.IsBound())
+    {
+        for (auto&& slot_change : changes.Slots) OnSlotChangedNative.Broadcast(this, slot_change);
+    }
+    OnInventoryBagChangeSet.Broadcast(this, changes);
+    broadcastBagUpdated();
+}
+
+FInventoryBagChangeSet* UInventoryBagComponent::beginRemoveBatch()
+{
+    if (!bCompactStacksOnRemove || pending_changes != nullptr) return nullptr;
+    if (remove_batch_depth == remove_batches.Num())
+    {
+        INC_DWORD_STAT(STAT_InventoryBagStorageAllocations);
+        remove_batches.Add(new FInventoryBagChangeSet());
+    }
+    FInventoryBagChangeSet* batch = &remove_batches[remove_batch_depth++];
+    pending_changes = batch;
+    return batch;
+}
+
+void UInventoryBagComponent::endRemoveBatch(FInventoryBagChangeSet* batch, bool bBroadcast)
+{
+    if (batch == nullptr)
+    {
+        if (bBroadcast) broadcastBagUpdated();
+        return;
+    }
+    check(pending_changes == batch);
+    pending_changes = nullptr;
+    // Listeners removing items from the bag get the next batch, this one stays untouched until broadcast is over.
+    if (bBroadcast) broadcastChangeSet(*batch);
+    batch->Items.Reset();
+    batch->Slots.Reset();
+    --remove_batch_depth;
+}
+
+void UInventoryBagComponent::broadcastBagUpdated()
+{
+    publishReadView();
+    OnInventoryBagUpdated.Broadcast(this);
+}
+
+void UInventoryBagComponent::publishReadView()
+{
+    INVENTORY_LLM_SCOPE();
+    if (!bPublishReadView) return;
+    FInventoryBagSnapshot const snapshot = takeSnapshot();
+    FRWScopeLock write_lock(read_view_lock, SLT_Write);
+    read_view = snapshot.Data;
+}
+
+bool UInventoryBagComponent::hasAvailableIds() const
+{
+    if (item_ids_pool.Num() == 0)
+    {
+        UE_LOG(LogInventorySystem, Display, TEXT("Trying to add item with no more available ids for the bag [%s]"), *GetPathName());
+        return false;
+    }
+    return true;
+}
+
+void UInventoryBagComponent::streamInLimits()
+{
+    INVENTORY_LLM_SCOPE();
+    if (!IsValid(BagProperties))
+    {
+        UE_LOG(LogInventorySystem, Error, TEXT("Invalid bag properties. [Bag: %s]"), *this->GetPathName());
+        return;
+    }
+    if (!UAssetManager::IsValid())
+    {
+        UE_LOG(LogInventorySystem, Error, TEXT("Asset manager unavailable, can't stream in required assets"));
+        return;
+    }
+
+    // Only limit assets need to be loaded, item data are matched by path and get loaded by whoever adds them.
+    TArray<FSoftObjectPath> stream_in_assets;
+    for (auto&& limit : BagProperties->Limits) stream_in_assets.Add(limit.Value.ToSoftObjectPath());
+    if (stream_in_assets.Num() == 0) return;
+
+    limits_stream_handle = UAssetManager::GetStreamableManager().RequestAsyncLoad(stream_in_assets,
+                                                                                  FStreamableDelegate::CreateUObject(this, &UInventoryBagComponent::handleLimitsStreamedInCompleted),
+                                                                                  FStreamableManager::AsyncLoadHighPriority);
+}
+
+void UInventoryBagComponent::handleLimitsStreamedInCompleted() const
+{
+    UE_LOG(LogInventorySystem, Log, TEXT("Completed loading of bag props limits objects. [Bag: %s]"), *this->GetPathName());
+}
@@ -0,0 +1,53 @@
+// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
+
+#include "InventoryBagJournal.h"
+
+void FInventoryBagJournal::setCapacity(int32 in_capacity)
+{
+    capacity = FMath::Max(in_capacity, 0);
+    entries.Empty();
+    invalidate();
+}
+
+bool FInventoryBagJournal::getChangesSince(int64 sequence, FInventoryBagChangeSet& out_changes) const
+{
+    out_changes.Items.Reset();
+    out_changes.Slots.Reset();
+    // Either too far behind or ahead of the bag (e.g. a sequence taken from a previous instance of it).
+    if (sequence < first_sequence - 1 || sequence > last_sequence) return false;
+
+    for (int64 entry_sequence = sequence + 1; entry_sequence <= last_sequence; ++entry_sequence)
+    {
+        const FInventoryBagJournalEntry& entry = entries[entry_sequence % capacity];
+        if (entry.SlotId == INDEX_NONE) out_changes.addItemChange(entry.ItemData, entry.OldCount, entry.NewCount);
+        else out_changes.addSlotChange(entry.ItemData, entry.SlotId, entry.OldCount, entry.NewCount);
+    }
+    out_changes.removeNoOps();
+    return true;
+}
+
+void FInventoryBagJournal::addReferencedObjects(FReferenceCollector& collector, const UObject* referencing_object)
+{
+    if (capacity == 0) return;
+    for (int64 entry_sequence = first_sequence; entry_sequence <= last_sequence; ++entry_sequence)
+    {
+        collector.AddReferencedObject(entries[entry_sequence % capacity].ItemData, referencing_object);
+    }
+}
+
+void FInventoryBagJournal::record(const FInventoryBagJournalEntry& entry)
+{
+    ++last_sequence;
+    if (capacity == 0)
+    {
+        invalidate();
+        return;
+    }
+    if (entries.Num() == 0)
+    {
+        INC_DWORD_STAT(STAT_InventoryBagStorageAllocations);
+        entries.SetNumUninitialized(capacity);
+    }
+    entries[last_sequence % capacity] = entry;
+    first_sequence = FMath::Max(first_sequence, last_sequence - capacity + 1);
+}
@@ -0,0 +1,166 @@
+// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
+
+#include "InventoryBagSnapshot.h"
+
+namespace
+{
+    /** Finds a slot by ID, checking hint_index first as slots mostly keep their position between snapshots. */
+    template <typename TSlot>
+    const TSharedRef<const TSlot, ESPMode::ThreadSafe>* findSlot(const TArray<TSharedRef<const TSlot, ESPMode::ThreadSafe>>& slots, int32 const slot_id, int32 const hint_index)
+    {
+        if (slots.IsValidIndex(hint_index) && slots[hint_index]->Id == slot_id) return &slots[hint_index];
+        for (auto&& slot : slots) if (slot->Id == slot_id) return &slot;
+        return nullptr;
+    }
+
+    /** Appends the changes for a single type. Either side can be null when the type is missing from that snapshot. */
+    template <typename TTypeData>
+    void diffType(UItemData* item_data, const TTypeData* from, const TTypeData* to, FInventoryBagChangeSet& out_changes)
+    {
+        if (from == to) return; // Still sharing the same data, nothing changed.
+
+        int32 const old_quantity = from != nullptr ? from->Quantity : 0;
+        int32 const new_quantity = to != nullptr ? to->Quantity : 0;
+        if (old_quantity != new_quantity) out_changes.Items.Add({item_data, old_quantity, new_quantity});
+
+        // Slots present in the new data are either updated or added.
+        if (to != nullptr)
+        {
+            for (int32 slot_index = 0; slot_index < to->Slots.Num(); ++slot_index)
+            {
+                auto&& slot = to->Slots[slot_index];
+                auto* from_slot = from != nullptr ? findSlot(from->Slots, slot->Id, slot_index) : nullptr;
+                if (from_slot != nullptr && *from_slot == slot) continue; // Still shared, unchanged.
+                int32 const old_count = from_slot != nullptr ? (*from_slot)->Num() : 0;
+                if (old_count != slot->Num()) out_changes.Slots.Add({item_data, slot->Id, old_count, slot->Num()});
+            }
+        }
+        // Slots only present in the old data have been removed.
+        if (from != nullptr)
+        {
+            for (int32 slot_index = 0; slot_index < from->Slots.Num(); ++slot_index)
+            {
+                auto&& slot = from->Slots[slot_index];
+                if (to == nullptr || findSlot(to->Slots, slot->Id, slot_index) == nullptr) out_changes.Slots.Add({item_data, slot->Id, slot->Num(), 0});
+            }
+        }
+    }
+
+    template <typename TKey, typename TValueRef>
+    void diffTypes(const TMap<TKey*, TValueRef>& from, const TMap<TKey*, TValueRef>& to, FInventoryBagChangeSet& out_changes)
+    {
+        for (auto&& type : to)
+        {
+            const TValueRef* from_data = from.Find(type.Key);
+            diffType<typename TValueRef::ElementType>(type.Key, from_data != nullptr ? &from_data->Get() : nullptr, &type.Value.Get(), out_changes);
+        }
+        for (auto&& type : from)
+        {
+            if (!to.Contains(type.Key)) diffType<typename TValueRef::ElementType>(type.Key, &type.Value.Get(), nullptr, out_changes);
+        }
+    }
+}
+
+void FInventoryBagSnapshotData::addReferencedObjects(FReferenceCollector& collector, const UObject* referencing_object) const
+{
+    // Keys are never nulled out: shared data can't be written, and item data are assets that don't get marked pending kill.
+    for (auto&& resources_data : Resources)
+    {
+        UObject* resource_data = resources_data.Key;
+        collector.AddReferencedObject(resource_data, referencing_object);
+    }
+    for (auto&& tools_data : Tools)
+    {
+        UObject* tool_data = tools_data.Key;
+        collector.AddReferencedObject(tool_data, referencing_object);
+    }
+}
+
+void FInventoryBagSnapshot::AddStructReferencedObjects(FReferenceCollector& collector) const
+{
+    if (Data.IsValid()) Data->addReferencedObjects(collector);
+}
+
+int32 FInventoryBagSnapshot::getItemQuantity(const UItemData* item_data) const
+{
+    if (!Data.IsValid() || item_data == nullptr) return 0;
+    switch (item_data->Category)
+    {
+    case EItemCategory::Resource:
+        {
+            const FBagSnapshotResources* resources = findResources(Cast<UResourceData>(item_data));
+            return resources != nullptr ? resources->Quantity : 0;
+        }
+    case EItemCategory::Tool:
+        {
+            const FBagSnapshotTools* tools = findTools(Cast<UToolData>(item_data));
+            return tools != nullptr ? tools->Quantity : 0;
+        }
+    default:
+        return 0;
+    }
+}
+
+const FBagSnapshotResources* FInventoryBagSnapshot::findResources(const UResourceData* resource_data) const
+{
+    if (!Data.IsValid()) return nullptr;
+    const FBagResourcesDataRef* resources_data = Data->Resources.Find(const_cast<UResourceData*>(resource_data));
+    return resources_data != nullptr ? &resources_data->Get() : nullptr;
+}
+
+const FBagSnapshotTools* FInventoryBagSnapshot::findTools(const UToolData* tool_data) const
+{
+    if (!Data.IsValid()) return nullptr;
+    const FBagToolsDataRef* tools_data = Data->Tools.Find(const_cast<UToolData*>(tool_data));
+    return tools_data != nullptr ? &tools_data->Get() : nullptr;
+}
+
+int32 FInventoryBagSnapshot::getCategoryQuantity(EResourceCategory category) const
+{
+    int32 const category_index = static_cast<int32>(category);
+    return Data.IsValid() && Data->ResourceCategoryQuantities.IsValidIndex(category_index) ? Data->ResourceCategoryQuantities[category_index] : 0;
+}
+
+int32 FInventoryBagSnapshot::getToolCategoryQuantity(EToolCategory category) const
+{
+    int32 const category_index = static_cast<int32>(category);
+    return Data.IsValid() && Data->ToolCategoryQuantities.IsValidIndex(category_index) ? Data->ToolCategoryQuantities[category_index] : 0;
+}
+
+int32 FInventoryBagSnapshot::getMaxCrafts(TArrayView<const FResolvedRecipeRequirement> requirements) const
+{
+    if (!Data.IsValid()) return 0;
+    int32 max_crafts = MAX_int32;
+    for (auto&& requirement : requirements)
+    {
+        max_crafts = FMath::Min(max_crafts, getItemQuantity(requirement.Item) / requirement.Quantity);
+        if (max_crafts == 0) break; // Early out as soon as a requirement is not satisfied.
+    }
+    return max_crafts;
+}
+
+int32 FInventoryBagSnapshot::getMaxCrafts(const UCraftingRecipe* recipe) const
+{
+    if (!Data.IsValid() || recipe == nullptr) return 0;
+    TArray<FResolvedRecipeRequirement> requirements;
+    recipe->resolveRequirements(requirements);
+    return getMaxCrafts(requirements);
+}
+
+FInventoryBagChangeSet FInventoryBagSnapshot::diff(const FInventoryBagSnapshot& from, const FInventoryBagSnapshot& to)
+{
+    FInventoryBagChangeSet changes;
+    if (from.Data == to.Data) return changes;
+
+    static const FInventoryBagSnapshotData empty_data;
+    const FInventoryBagSnapshotData& from_data = from.Data.IsValid() ? *from.Data : empty_data;
+    const FInventoryBagSnapshotData& to_data = to.Data.IsValid() ? *to.Data : empty_data;
+    if (from.Data.IsValid() && to.Data.IsValid() && from_data.BagId != to_data.BagId)
+    {
+        UE_LOG(LogInventorySystem, Warning, TEXT("Diffing snapshots taken from two different bags. Slot changes will not be meaningful."));
+    }
+
+    diffTypes(from_data.Resources, to_data.Resources, changes);
+    diffTypes(from_data.Tools, to_data.Tools, changes);
+    return changes;
+}
@@ -0,0 +1,226 @@
+// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
+
+#include "InventoryBagTypes.h"
+#include "Algo/Sort.h"
+
+namespace
+{
+    int32 getTypeId(const UItemData* item_data) { return item_data != nullptr ? item_data->getTypeId() : INDEX_NONE; }
+}
+
+FBagResourcesData* FBagResources::find(const UResourceData* resource_data)
+{
+    int32 const type_index = index.find(Types, getTypeId(resource_data));
+    return type_index != INDEX_NONE ? &Types[type_index] : nullptr;
+}
+
+const FBagResourcesData* FBagResources::find(const UResourceData* resource_data) const
+{
+    int32 const type_index = index.find(Types, getTypeId(resource_data));
+    return type_index != INDEX_NONE ? &Types[type_index] : nullptr;
+}
+
+FBagResourcesData& FBagResources::add(UResourceData* resource_data)
+{
+    FBagResourcesData resources_data;
+    resources_data.ResourceData = resource_data;
+    return add(resources_data);
+}
+
+FBagResourcesData& FBagResources::add(const FBagResourcesData& resources_data)
+{
+    check(resources_data.ResourceData != nullptr && !contains(resources_data.ResourceData));
+    FBagResourcesData entry = resources_data;
+    entry.TypeId = resources_data.ResourceData->getTypeId();
+    return index.insert(Types, MoveTemp(entry));
+}
+
+void FBagResources::remove(const UResourceData* resource_data)
+{
+    int32 const type_index = index.find(Types, getTypeId(resource_data));
+    if (type_index != INDEX_NONE) index.removeAt(Types, type_index);
+}
+
+void FBagResources::reset()
+{
+    Types.Reset();
+    index.rebuild(Types);
+}
+
+void FBagResources::rebuild()
+{
+    Types.RemoveAll([](const FBagResourcesData& entry) { return entry.ResourceData == nullptr; });
+    for (auto&& entry : Types) entry.TypeId = entry.ResourceData->getTypeId();
+    Algo::SortBy(Types, &FBagResourcesData::TypeId);
+    index.rebuild(Types);
+}
+
+FBagToolsData* FBagTools::find(const UToolData* tool_data)
+{
+    int32 const type_index = index.find(Types, getTypeId(tool_data));
+    return type_index != INDEX_NONE ? &Types[type_index] : nullptr;
+}
+
+const FBagToolsData* FBagTools::find(const UToolData* tool_data) const
+{
+    int32 const type_index = index.find(Types, getTypeId(tool_data));
+    return type_index != INDEX_NONE ? &Types[type_index] : nullptr;
+}
+
+FBagToolsData& FBagTools::add(UToolData* tool_data)
+{
+    FBagToolsData tools_data;
+    tools_data.ToolData = tool_data;
+    return add(tools_data);
+}
+
+FBagToolsData& FBagTools::add(const FBagToolsData& tools_data)
+{
+    check(tools_data.ToolData != nullptr && !contains(tools_data.ToolData));
+    FBagToolsData entry = tools_data;
+    entry.TypeId = tools_data.ToolData->getTypeId();
+    return index.insert(Types, MoveTemp(entry));
+}
+
+void FBagTools::remove(const UToolData* tool_data)
+{
+    int32 const type_index = index.find(Types, getTypeId(tool_data));
+    if (type_index != INDEX_NONE) index.removeAt(Types, type_index);
+}
+
+void FBagTools::reset()
+{
+    Types.Reset();
+    index.rebuild(Types);
+}
+
+void FBagTools::rebuild()
+{
+    Types.RemoveAll([](const FBagToolsData& entry) { return entry.ToolData == nullptr; });
+    for (auto&& entry : Types) entry.TypeId = entry.ToolData->getTypeId();
+    Algo::SortBy(Types, &FBagToolsData::TypeId);
+    index.rebuild(Types);
+}
+
+void FInventoryBagChangeSet::addItemChange(UItemData* item_data, int32 const old_quantity, int32 const new_quantity)
+{
+    for (auto&& change : Items)
+    {
+        if (change.ItemData == item_data)
+        {
+            change.NewQuantity = new_quantity;
+            return;
+        }
+    }
+    Items.Add({item_data, old_quantity, new_quantity});
+}
+
+void FInventoryBagChangeSet::addSlotChange(UItemData* item_data, int32 const slot_id, int32 const old_count, int32 const new_count)
+{
+    // Slot ids can be reused by a different type once freed, so match on both.
+    for (auto&& change : Slots)
+    {
+        if (change.SlotId == slot_id && change.ItemData == item_data)
+        {
+            change.NewCount = new_count;
+            return;
+        }
+    }
+    Slots.Add({item_data, slot_id, old_count, new_count});
+}
+
+void FInventoryBagChangeSet::removeNoOps()
+{
+    Items.RemoveAll([](const FInventoryBagItemChange& change) { return change.OldQuantity == change.NewQuantity; });
+    Slots.RemoveAll([](const FInventoryBagSlotChange& change) { return change.OldCount == change.NewCount; });
+}
+
+void FBagToolInstances::reset(int32 const max_item_id)
+{
+    Ids.Reset();
+    Durabilities.Reset();
+    MaxDurabilities.Reset();
+    Categories.Reset();
+    SlotIds.Reset();
+    Types.Reset();
+    IndexById.Init(INDEX_NONE, max_item_id);
+}
+
+void FBagToolInstances::add(int32 const id, UToolData* tool_data, int32 const durability, int32 const slot_id)
+{
+    check(IndexById.IsValidIndex(id) && IndexById[id] == INDEX_NONE);
+    IndexById[id] = Ids.Add(id);
+    Durabilities.Add(durability);
+    MaxDurabilities.Add(tool_data->MaxDurability);
+    Categories.Add(static_cast<int32>(tool_data->ToolCategory));
+    SlotIds.Add(slot_id);
+    Types.Add(tool_data);
+}
+
+int32 FBagToolInstances::remove(int32 const id)
+{
+    int32 const index = find(id);
+    check(index != INDEX_NONE);
+    int32 const durability = Durabilities[index];
+
+    // The last instance takes the place of the removed one.
+    int32 const last_index = Ids.Num() - 1;
+    if (index != last_index) IndexById[Ids[last_index]] = index;
+    Ids.RemoveAtSwap(index, 1, false);
+    Durabilities.RemoveAtSwap(index, 1, false);
+    MaxDurabilities.RemoveAtSwap(index, 1, false);
+    Categories.RemoveAtSwap(index, 1, false);
+    SlotIds.RemoveAtSwap(index, 1, false);
+    Types.RemoveAtSwap(index, 1, false);
+    IndexById[id] = INDEX_NONE;
+    return durability;
+}
+
+SIZE_T FBagToolInstances::getAllocatedSize() const
+{
+    return Ids.GetAllocatedSize() + Durabilities.GetAllocatedSize() + MaxDurabilities.GetAllocatedSize() + Categories.GetAllocatedSize()
+        + SlotIds.GetAllocatedSize() + Types.GetAllocatedSize() + IndexById.GetAllocatedSize();
+}
+
+int32 FBagToolInstances::applyWear(int32 const category, int32 const wear, TSet<UToolData*>& out_worn_types)
+{
+    int32 const count = Ids.Num();
+    int32* const durabilities = Durabilities.GetData();
+    const int32* const categories = Categories.GetData();
+    bool const bAnyCategory = category == INDEX_NONE;
+
+    int32 i = 0;
+#if PLATFORM_ENABLE_VECTORINTRINSICS
+    VectorRegisterInt const wear_vector = VectorIntSet1(wear);
+    VectorRegisterInt const category_vector = VectorIntSet1(category);
+    for (; i + 4 <= count; i += 4)
+    {
+        VectorRegisterInt const durability = VectorIntLoad(durabilities + i);
+        VectorRegisterInt const worn = VectorIntMax(VectorIntSubtract(durability, wear_vector), GlobalVectorConstants::IntZero);
+        VectorRegisterInt const result = bAnyCategory ? worn : VectorIntSelect(VectorIntCompareEQ(VectorIntLoad(categories + i), category_vector), worn, durability);
+        VectorIntStore(result, durabilities + i);
+    }
+#endif
+    // Remaining instances, or all of them without vector intrinsics.
+    for (; i < count; ++i)
+    {
+        if (bAnyCategory || categories[i] == category) durabilities[i] = FMath::Max(durabilities[i] - wear, 0);
+    }
+
+    // Tools of a type tend to be added together, skip hashing runs of the same type.
+    UToolData* previous_type = nullptr;
+    int32 matches = 0;
+    for (i = 0; i < count; ++i)
+    {
+        if (!bAnyCategory && categories[i] != category) continue;
+        ++matches;
+        if (Types[i] != previous_type) out_worn_types.Add(Types[i]);
+        previous_type = Types[i];
+    }
+    return matches;
+}
+
+void FBagToolInstances::repairAll()
+{
+    if (Durabilities.Num() > 0) FMemory::Memcpy(Durabilities.GetData(), MaxDurabilities.GetData(), Durabilities.Num() * sizeof(int32));
+}
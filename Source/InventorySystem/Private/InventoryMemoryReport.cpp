@@ -0,0 +1,77 @@
+// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
+
+#include "InventoryMemoryReport.h"
+#include "InventoryWorldStore.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "UObject/UObjectIterator.h"
+
+namespace
+{
+    void logMemoryReport(const TArray<FString>& args, UWorld* world)
+    {
+        int32 const top_count = args.Num() > 0 ? FCString::Atoi(*args[0]) : 10;
+        FInventoryMemoryReport::gather(world).log(top_count);
+    }
+
+    void logUsageLine(const TCHAR* name, SIZE_T const bytes, int32 const num_bags)
+    {
+        UE_LOG(LogInventorySystem, Display, TEXT("  %-16s [%llu] bytes, [%llu] bytes per bag"),
+               name, static_cast<uint64>(bytes), static_cast<uint64>(num_bags > 0 ? bytes / num_bags : 0));
+    }
+}
+
+static FAutoConsoleCommandWithWorldAndArgs GInventoryMemoryReportCommand(
+    TEXT("InventorySystem.MemoryReport"),
+    TEXT("Logs the memory used by every bag in the world, split by ID pools, slots, types, item components, stream handles and snapshots. Arg: number of largest bags to list (default 10)."),
+    FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&logMemoryReport));
+
+FInventoryMemoryReport FInventoryMemoryReport::gather(UWorld* world)
+{
+    FInventoryMemoryReport report;
+    for (TObjectIterator<UInventoryBagComponent> it; it; ++it)
+    {
+        if (it->GetWorld() != world || it->IsTemplate()) continue;
+        FBagEntry& entry = report.Bags.AddDefaulted_GetRef();
+        entry.BagName = it->GetPathName(world);
+        entry.Usage = it->getMemoryUsage();
+        report.Total += entry.Usage;
+    }
+    report.Bags.Sort([](const FBagEntry& lhs, const FBagEntry& rhs) { return lhs.Usage.getTotal() > rhs.Usage.getTotal(); });
+
+    if (UInventoryWorldStore* store = world != nullptr ? world->GetSubsystem<UInventoryWorldStore>() : nullptr)
+    {
+        report.StoreBags = store->getNumBags();
+        report.StoreBytes = store->getAllocatedSize();
+    }
+    return report;
+}
+
+void FInventoryMemoryReport::log(int32 top_count) const
+{
+    int32 const num_bags = Bags.Num();
+    UE_LOG(LogInventorySystem, Display, TEXT("Bag components: [%d] bags, [%llu] bytes, [%llu] bytes per bag"),
+           num_bags, static_cast<uint64>(Total.getTotal()), static_cast<uint64>(num_bags > 0 ? Total.getTotal() / num_bags : 0));
+    logUsageLine(TEXT("Object"), Total.Object, num_bags);
+    logUsageLine(TEXT("ID pools"), Total.IdPools, num_bags);
+    logUsageLine(TEXT("Slots"), Total.Slots, num_bags);
+    logUsageLine(TEXT("Types"), Total.Types, num_bags);
+    logUsageLine(TEXT("Item components"), Total.ItemComponents, num_bags);
+    logUsageLine(TEXT("Stream handles"), Total.StreamHandles, num_bags);
+    logUsageLine(TEXT("Snapshots"), Total.Snapshots, num_bags);
+    logUsageLine(TEXT("Other"), Total.Other, num_bags);
+    UE_LOG(LogInventorySystem, Display, TEXT("World store: [%d] bags, [%llu] bytes, [%llu] bytes per bag"),
+           StoreBags, static_cast<uint64>(StoreBytes), static_cast<uint64>(StoreBags > 0 ? StoreBytes / StoreBags : 0));
+
+    int32 const num_listed = FMath::Min(FMath::Max(top_count, 0), num_bags);
+    if (num_listed == 0) return;
+    UE_LOG(LogInventorySystem, Display, TEXT("Largest [%d] bags (total / ID pools / slots / types / item components / stream handles / snapshots / other):"), num_listed);
+    for (int32 i = 0; i < num_listed; ++i)
+    {
+        const FInventoryBagMemoryUsage& usage = Bags[i].Usage;
+        UE_LOG(LogInventorySystem, Display, TEXT("  [%llu] / [%llu] / [%llu] / [%llu] / [%llu] / [%llu] / [%llu] / [%llu] %s"),
+               static_cast<uint64>(usage.getTotal()), static_cast<uint64>(usage.IdPools), static_cast<uint64>(usage.Slots), static_cast<uint64>(usage.Types),
+               static_cast<uint64>(usage.ItemComponents), static_cast<uint64>(usage.StreamHandles),
+               static_cast<uint64>(usage.Snapshots), static_cast<uint64>(usage.Other), *Bags[i].BagName);
+    }
+}
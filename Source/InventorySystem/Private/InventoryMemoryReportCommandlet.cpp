@@ -0,0 +1,51 @@
+// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
+
+#include "InventoryMemoryReportCommandlet.h"
+#include "InventoryMemoryReport.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+
+UInventoryMemoryReportCommandlet::UInventoryMemoryReportCommandlet()
+{
+    IsClient = false;
+    IsServer = true;
+    IsEditor = false;
+    LogToConsole = true;
+}
+
+int32 UInventoryMemoryReportCommandlet::Main(const FString& Params)
+{
+    FString map_name;
+    if (!FParse::Value(*Params, TEXT("Map="), map_name))
+    {
+        UE_LOG(LogInventorySystem, Error, TEXT("Usage: -run=InventoryMemoryReport -Map=<map package> [-Top=<largest bags to list>]"));
+        return 1;
+    }
+    int32 top_count = 10;
+    FParse::Value(*Params, TEXT("Top="), top_count);
+
+    UPackage* package = LoadPackage(nullptr, *map_name, LOAD_None);
+    UWorld* world = package != nullptr ? UWorld::FindWorldInPackage(package) : nullptr;
+    if (world == nullptr)
+    {
+        UE_LOG(LogInventorySystem, Error, TEXT("Can't load map [%s]"), *map_name);
+        return 1;
+    }
+
+    // Bags only allocate most of their storage once they begin play.
+    world->WorldType = EWorldType::Game;
+    world->AddToRoot();
+    FWorldContext& world_context = GEngine->CreateNewWorldContext(EWorldType::Game);
+    world_context.SetCurrentWorld(world);
+    world->InitWorld();
+    world->InitializeActorsForPlay(FURL());
+    world->BeginPlay();
+
+    FInventoryMemoryReport::gather(world).log(top_count);
+
+    GEngine->DestroyWorldContext(world);
+    world->DestroyWorld(false);
+    world->RemoveFromRoot();
+    CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+    return 0;
+}
@@ -1,20 +1,30 @@
-// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
-
-#include "InventorySystem.h"
-
-#define LOCTEXT_NAMESPACE "FInventorySystemModule"
-
-void FInventorySystemModule::StartupModule()
-{
-    // This code will execute after your module is loaded into memory; the exact timing is specified in the .uplugin file per-module
-}
-
-void FInventorySystemModule::ShutdownModule()
-{
-    // This function may be called during shutdown to clean up your module.  For modules that support dynamic reloading,
-    // we call this function before unloading the module.
-}
-
-#undef LOCTEXT_NAMESPACE
-
-IMPLEMENT_MODULE(FInventorySystemModule, InventorySystem)
+// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
+
+#include "InventorySystem.h"
+#include "InventorySystemCommon.h"
+
+#if ENABLE_LOW_LEVEL_MEM_TRACKER
+DECLARE_LLM_MEMORY_STAT(TEXT("InventorySystem"), STAT_InventorySystemLLM, STATGROUP_LLMFULL);
+DECLARE_LLM_MEMORY_STAT(TEXT("InventorySystem"), STAT_InventorySystemSummaryLLM, STATGROUP_LLM);
+#endif
+
+#define LOCTEXT_NAMESPACE "FInventorySystemModule"
+
+void FInventorySystemModule::StartupModule()
+{
+    // This code will execute after your module is loaded into memory; the exact timing is specified in the .uplugin file per-module
+#if ENABLE_LOW_LEVEL_MEM_TRACKER
+    FLowLevelMemTracker::Get().RegisterProjectTag(static_cast<int32>(INVENTORY_LLM_TAG), TEXT("InventorySystem"),
+                                                  GET_STATFNAME(STAT_InventorySystemLLM), GET_STATFNAME(STAT_InventorySystemSummaryLLM));
+#endif
+}
+
+void FInventorySystemModule::ShutdownModule()
+{
+    // This function may be called during shutdown to clean up your module.  For modules that support dynamic reloading,
+    // we call this function before unloading the module.
+}
+
+#undef LOCTEXT_NAMESPACE
+
+IMPLEMENT_MODULE(FInventorySystemModule, InventorySystem)
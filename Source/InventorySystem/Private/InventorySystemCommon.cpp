@@ -1,8 +1,9 @@
-// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
-
-#pragma once
-
-#include "InventorySystemCommon.h"
-#include "Logging/LogMacros.h"
-
-DEFINE_LOG_CATEGORY(LogInventorySystem);
+// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
+
+#pragma once
+
+#include "InventorySystemCommon.h"
+#include "Logging/LogMacros.h"
+
+DEFINE_LOG_CATEGORY(LogInventorySystem);
+DEFINE_STAT(STAT_InventoryBagStorageAllocations);
@@ -0,0 +1,375 @@
+// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
+
+#include "InventoryTraceRecorder.h"
+#include "InventoryBagComponent.h"
+#include "InventoryWorldStore.h"
+#include "Crafting/CraftingTypes.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/CoreDelegates.h"
+#include "Misc/DateTime.h"
+#include "Misc/Paths.h"
+#include "Serialization/MemoryWriter.h"
+
+namespace
+{
+    /** Buffered records are written out once they reach this size. */
+    constexpr int32 FlushThreshold = 64 * 1024;
+
+    /** Item, or single tool, a bag held when first met by a trace. */
+    struct FSeedItem
+    {
+        const UItemData* ItemData;
+        int32 Count;
+        /** Registered component, null for items added without one. */
+        const UItemComponent* Item;
+        int32 Durability;
+    };
+
+    void startTrace(const TArray<FString>& args)
+    {
+        FString const file_path = args.Num() > 0
+                                      ? args[0]
+                                      : FPaths::ProfilingDir() / TEXT("Inventory") / FString::Printf(TEXT("%s.invtrace"), *FDateTime::Now().ToString());
+        FInventoryTraceRecorder::get().start(file_path);
+    }
+}
+
+static FAutoConsoleCommand GInventoryTraceStartCommand(
+    TEXT("InventorySystem.Trace.Start"),
+    TEXT("Starts recording bag operations to the given trace file, or to a new file in the profiling folder. Replay with -run=InventoryTraceReplay."),
+    FConsoleCommandWithArgsDelegate::CreateStatic(&startTrace));
+
+static FAutoConsoleCommand GInventoryTraceStopCommand(
+    TEXT("InventorySystem.Trace.Stop"),
+    TEXT("Stops recording bag operations."),
+    FConsoleCommandDelegate::CreateLambda([]() { FInventoryTraceRecorder::get().stop(); }));
+
+FInventoryTraceRecorder& FInventoryTraceRecorder::get()
+{
+    static FInventoryTraceRecorder recorder;
+    return recorder;
+}
+
+bool FInventoryTraceRecorder::start(const FString& file_path)
+{
+    INVENTORY_LLM_SCOPE();
+    check(IsInGameThread());
+    stop();
+    writer.Reset(IFileManager::Get().CreateFileWriter(*file_path));
+    if (!writer.IsValid())
+    {
+        UE_LOG(LogInventorySystem, Error, TEXT("Can't open inventory trace file [%s]"), *file_path);
+        return false;
+    }
+    uint32 magic = Magic;
+    uint32 version = Version;
+    *writer << magic << version;
+    last_record_cycles = FPlatformTime::Cycles64();
+    // Buffered records would be lost if the game exits while recording.
+    pre_exit_handle = FCoreDelegates::OnPreExit.AddRaw(this, &FInventoryTraceRecorder::stop);
+    UE_LOG(LogInventorySystem, Display, TEXT("Recording inventory trace to [%s]"), *file_path);
+    return true;
+}
+
+void FInventoryTraceRecorder::stop()
+{
+    if (!writer.IsValid()) return;
+    FCoreDelegates::OnPreExit.Remove(pre_exit_handle);
+    pre_exit_handle.Reset();
+    flush();
+    writer->Close();
+    writer.Reset();
+    buffer.Empty();
+    object_indices.Empty();
+    bag_ids.Empty();
+    component_ids.Empty();
+    next_bag_id = 0;
+    next_component_id = 0;
+    UE_LOG(LogInventorySystem, Display, TEXT("Stopped recording inventory trace"));
+}
+
+void FInventoryTraceRecorder::recordAddItems(const UInventoryBagComponent* bag, const UItemData* item_data, int32 count)
+{
+    uint32 const bag_id = getBagId(bag);
+    uint32 const item_index = getObjectIndex(item_data);
+    beginRecord(EInventoryTraceOp::AddItems);
+    writePacked(bag_id);
+    writePacked(item_index);
+    writePacked(count);
+}
+
+void FInventoryTraceRecorder::recordRemoveItem(const UInventoryBagComponent* bag, const UItemData* item_data)
+{
+    uint32 const bag_id = getBagId(bag);
+    uint32 const item_index = getObjectIndex(item_data);
+    beginRecord(EInventoryTraceOp::RemoveItem);
+    writePacked(bag_id);
+    writePacked(item_index);
+}
+
+void FInventoryTraceRecorder::recordAddItemComponent(const UInventoryBagComponent* bag, const UItemComponent* item)
+{
+    uint32 const bag_id = getBagId(bag);
+    uint32 const item_index = getObjectIndex(item->ItemData);
+    const UToolComponent* tool = Cast<UToolComponent>(item);
+    beginRecord(EInventoryTraceOp::AddItemComponent);
+    writePacked(bag_id);
+    writePacked(item_index);
+    writePacked(getComponentId(item));
+    writeInt(tool != nullptr ? tool->Durability : 0);
+}
+
+void FInventoryTraceRecorder::recordRemoveItemComponent(const UInventoryBagComponent* bag, const UItemComponent* item)
+{
+    uint32 const bag_id = getBagId(bag);
+    uint32 const component_id = getComponentId(item);
+    beginRecord(EInventoryTraceOp::RemoveItemComponent);
+    writePacked(bag_id);
+    writePacked(component_id);
+}
+
+void FInventoryTraceRecorder::recordUpdateToolDurability(const UInventoryBagComponent* bag, const UToolComponent* tool, int32 durability)
+{
+    uint32 const bag_id = getBagId(bag);
+    uint32 const component_id = getComponentId(tool);
+    beginRecord(EInventoryTraceOp::UpdateToolDurability);
+    writePacked(bag_id);
+    writePacked(component_id);
+    writeInt(durability);
+}
+
+void FInventoryTraceRecorder::recordEvaluateCraftables(const UCraftablesCollection* craftables_collection, const TArray<UInventoryBagComponent*>& bags)
+{
+    uint32 const collection_index = getObjectIndex(craftables_collection);
+    TArray<uint32, TInlineAllocator<16>> bag_ids;
+    for (const UInventoryBagComponent* bag : bags)
+    {
+        if (IsValid(bag)) bag_ids.Add(getBagId(bag));
+    }
+    beginRecord(EInventoryTraceOp::EvaluateCraftables);
+    writePacked(collection_index);
+    writePacked(bag_ids.Num());
+    for (uint32 const bag_id : bag_ids) writePacked(bag_id);
+}
+
+void FInventoryTraceRecorder::recordDestroyBag(const UInventoryBagComponent* bag)
+{
+    uint32 bag_id;
+    if (!bag_ids.RemoveAndCopyValue(FObjectKey{bag}, bag_id)) return; // Never met, nothing to tell the replay.
+    beginRecord(EInventoryTraceOp::DestroyBag);
+    writePacked(bag_id);
+}
+
+void FInventoryTraceRecorder::recordCommitTransaction(const UInventoryBagComponent* bag, TArrayView<const FInventoryBagTransactionOp> ops)
+{
+    uint32 const bag_id = getBagId(bag);
+    TArray<uint32, TInlineAllocator<8>> item_indices;
+    for (auto&& op : ops) item_indices.Add(getObjectIndex(op.ItemData));
+    beginRecord(EInventoryTraceOp::CommitTransaction);
+    writePacked(bag_id);
+    writePacked(ops.Num());
+    for (int32 op_index = 0; op_index < ops.Num(); ++op_index)
+    {
+        writePacked(item_indices[op_index]);
+        writeInt(ops[op_index].Quantity);
+    }
+}
+
+void FInventoryTraceRecorder::recordTransferItems(const UInventoryBagComponent* from, const UInventoryBagComponent* to, const UItemData* item_data, int32 count)
+{
+    uint32 const from_id = getBagId(from);
+    uint32 const to_id = getBagId(to);
+    uint32 const item_index = getObjectIndex(item_data);
+    beginRecord(EInventoryTraceOp::TransferItems);
+    writePacked(from_id);
+    writePacked(to_id);
+    writePacked(item_index);
+    writeInt(count);
+}
+
+void FInventoryTraceRecorder::recordTransferSlot(const UInventoryBagComponent* from, const UInventoryBagComponent* to, int32 slot_id)
+{
+    uint32 const from_id = getBagId(from);
+    uint32 const to_id = getBagId(to);
+    beginRecord(EInventoryTraceOp::TransferSlot);
+    writePacked(from_id);
+    writePacked(to_id);
+    writeInt(slot_id);
+}
+
+void FInventoryTraceRecorder::recordApplyToolWear(const UInventoryBagComponent* bag, int32 category, int32 wear)
+{
+    uint32 const bag_id = getBagId(bag);
+    beginRecord(EInventoryTraceOp::ApplyToolWear);
+    writePacked(bag_id);
+    writeInt(category);
+    writeInt(wear);
+}
+
+void FInventoryTraceRecorder::recordRepairAllTools(const UInventoryBagComponent* bag)
+{
+    uint32 const bag_id = getBagId(bag);
+    beginRecord(EInventoryTraceOp::RepairAllTools);
+    writePacked(bag_id);
+}
+
+void FInventoryTraceRecorder::recordCompactStacks(const UInventoryBagComponent* bag, int32 max_moves)
+{
+    uint32 const bag_id = getBagId(bag);
+    beginRecord(EInventoryTraceOp::CompactStacks);
+    writePacked(bag_id);
+    writeInt(max_moves);
+}
+
+void FInventoryTraceRecorder::stopOnUnsupported(const TCHAR* operation)
+{
+    UE_LOG(LogInventorySystem, Warning, TEXT("[%s] can't be replayed from an inventory trace, stopping the recording so that the trace stays accurate."), operation);
+    stop();
+}
+
+void FInventoryTraceRecorder::beginRecord(EInventoryTraceOp op)
+{
+    uint64 const now_cycles = FPlatformTime::Cycles64();
+    uint32 const elapsed_us = static_cast<uint32>(FMath::Min(FPlatformTime::ToSeconds64(now_cycles - last_record_cycles) * 1000000.0, static_cast<double>(MAX_uint32)));
+    last_record_cycles = now_cycles;
+    writePacked(static_cast<uint32>(op));
+    writePacked(elapsed_us);
+}
+
+uint32 FInventoryTraceRecorder::getBagId(const UInventoryBagComponent* bag)
+{
+    INVENTORY_LLM_SCOPE();
+    if (const uint32* bag_id = bag_ids.Find(FObjectKey{bag})) return *bag_id;
+    uint32 const bag_id = next_bag_id++;
+    bag_ids.Add(FObjectKey{bag}, bag_id);
+    uint32 const properties_index = getObjectIndex(bag->BagProperties);
+    beginRecord(EInventoryTraceOp::DefineBag);
+    writePacked(bag_id);
+    writePacked(properties_index);
+    recordBagContents(bag, bag_id);
+    return bag_id;
+}
+
+void FInventoryTraceRecorder::recordBagContents(const UInventoryBagComponent* bag, uint32 bag_id)
+{
+    INVENTORY_LLM_SCOPE();
+    TArray<FSeedItem> seed_items;
+    if (bag->getStoreHandle().isSet())
+    {
+        const UInventoryWorldStore* store = UInventoryWorldStore::get(bag);
+        const FStoredBag* stored_bag = store != nullptr ? store->findBag(bag->getStoreHandle()) : nullptr;
+        if (stored_bag != nullptr)
+        {
+            for (auto&& type : stored_bag->Types)
+            {
+                if (!type.ItemData->IsA<UToolData>()) seed_items.Add({type.ItemData, type.Quantity, nullptr, 0});
+            }
+            for (auto&& tool : stored_bag->Tools) seed_items.Add({tool.ToolData, 1, nullptr, tool.Durability});
+        }
+    }
+    else
+    {
+        // Items added through a component are seeded with it, so that later operations on the component find it.
+        TMap<int32, const UItemComponent*> id_to_item;
+        for (auto&& registered : bag->getItemComponents())
+        {
+            if (IsValid(registered.Key)) id_to_item.Add(registered.Value, registered.Key);
+        }
+        for (auto&& resources_data : bag->Resources.Types)
+        {
+            int32 plain_count = 0;
+            for (auto&& slot : resources_data.Slots)
+            {
+                for (int32 const resource_id : slot.ResourceIds)
+                {
+                    if (const UItemComponent* item = id_to_item.FindRef(resource_id)) seed_items.Add({resources_data.ResourceData, 1, item, 0});
+                    else ++plain_count;
+                }
+            }
+            if (plain_count > 0) seed_items.Add({resources_data.ResourceData, plain_count, nullptr, 0});
+        }
+        for (auto&& tools_data : bag->Tools.Types)
+        {
+            for (auto&& slot : tools_data.Slots)
+            {
+                for (auto&& tool_info : slot.ToolsInfo)
+                {
+                    seed_items.Add({tools_data.ToolData, 1, id_to_item.FindRef(tool_info.ToolId), bag->getToolDurability(tool_info.ToolId)});
+                }
+            }
+        }
+    }
+    if (seed_items.Num() == 0) return;
+
+    // Objects have to be defined before the seed records start.
+    TArray<uint32> item_indices;
+    item_indices.Reserve(seed_items.Num());
+    for (const FSeedItem& seed_item : seed_items) item_indices.Add(getObjectIndex(seed_item.ItemData));
+    beginRecord(EInventoryTraceOp::SeedBag);
+    writePacked(bag_id);
+    writePacked(seed_items.Num());
+    for (int32 seed_index = 0; seed_index < seed_items.Num(); ++seed_index)
+    {
+        const FSeedItem& seed_item = seed_items[seed_index];
+        // Tools are replayed through a component, it's the only way to add one with a given durability.
+        if (seed_item.Item == nullptr && !seed_item.ItemData->IsA<UToolData>())
+        {
+            beginRecord(EInventoryTraceOp::AddItems);
+            writePacked(bag_id);
+            writePacked(item_indices[seed_index]);
+            writePacked(seed_item.Count);
+            continue;
+        }
+        beginRecord(EInventoryTraceOp::AddItemComponent);
+        writePacked(bag_id);
+        writePacked(item_indices[seed_index]);
+        writePacked(seed_item.Item != nullptr ? getComponentId(seed_item.Item) : next_component_id++);
+        writeInt(seed_item.Durability);
+    }
+}
+
+uint32 FInventoryTraceRecorder::getComponentId(const UItemComponent* item)
+{
+    INVENTORY_LLM_SCOPE();
+    if (const uint32* component_id = component_ids.Find(FObjectKey{item})) return *component_id;
+    return component_ids.Add(FObjectKey{item}, next_component_id++);
+}
+
+uint32 FInventoryTraceRecorder::getObjectIndex(const UObject* object)
+{
+    INVENTORY_LLM_SCOPE();
+    if (const uint32* object_index = object_indices.Find(FObjectKey{object})) return *object_index;
+    uint32 const object_index = object_indices.Add(FObjectKey{object}, object_indices.Num());
+    FString path = object != nullptr ? object->GetPathName() : FString();
+    beginRecord(EInventoryTraceOp::DefineObject);
+    writePacked(object_index);
+    FMemoryWriter buffer_writer{buffer};
+    buffer_writer.Seek(buffer.Num());
+    buffer_writer << path;
+    return object_index;
+}
+
+void FInventoryTraceRecorder::writePacked(uint32 value)
+{
+    INVENTORY_LLM_SCOPE();
+    FMemoryWriter buffer_writer{buffer};
+    buffer_writer.Seek(buffer.Num());
+    buffer_writer.SerializeIntPacked(value);
+    if (buffer.Num() >= FlushThreshold) flush();
+}
+
+void FInventoryTraceRecorder::writeInt(int32 value)
+{
+    INVENTORY_LLM_SCOPE();
+    FMemoryWriter buffer_writer{buffer};
+    buffer_writer.Seek(buffer.Num());
+    buffer_writer << value;
+}
+
+void FInventoryTraceRecorder::flush()
+{
+    if (!writer.IsValid() || buffer.Num() == 0) return;
+    writer->Serialize(buffer.GetData(), buffer.Num());
+    buffer.Reset();
+}
@@ -0,0 +1,401 @@
+// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
+
+#include "InventoryTraceReplayCommandlet.h"
+#include "InventoryBagComponent.h"
+#include "InventoryTraceRecorder.h"
+#include "Crafting/CraftingUtils.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "GameFramework/Actor.h"
+#include "HAL/FileManager.h"
+
+namespace
+{
+    /** A decoded trace record, with its objects already resolved so that replaying it only measures the operation. */
+    struct FReplayOp
+    {
+        EInventoryTraceOp Op;
+        UInventoryBagComponent* Bag = nullptr;
+        /** Target bag of transfers. */
+        UInventoryBagComponent* ToBag = nullptr;
+        UItemData* ItemData = nullptr;
+        UItemComponent* Item = nullptr;
+        int32 Value = 0;
+        /** Tool category of ApplyToolWear. */
+        int32 Category = INDEX_NONE;
+        UCraftablesCollection* Craftables = nullptr;
+        TArray<UInventoryBagComponent*> Bags;
+        TArray<FInventoryBagTransactionOp> TransactionOps;
+        /** Restores what the bag held when the trace first met it, replayed but not measured. */
+        bool bSeed = false;
+    };
+
+    struct FReplayState
+    {
+        UWorld* World = nullptr;
+        TArray<UObject*> Objects;
+        TMap<uint32, UInventoryBagComponent*> Bags;
+        TMap<uint32, UItemComponent*> Items;
+        TArray<FReplayOp> Ops;
+    };
+
+    const TCHAR* getOpName(EInventoryTraceOp op)
+    {
+        switch (op)
+        {
+        case EInventoryTraceOp::AddItems: return TEXT("AddItems");
+        case EInventoryTraceOp::RemoveItem: return TEXT("RemoveItem");
+        case EInventoryTraceOp::AddItemComponent: return TEXT("AddItemComponent");
+        case EInventoryTraceOp::RemoveItemComponent: return TEXT("RemoveItemComponent");
+        case EInventoryTraceOp::UpdateToolDurability: return TEXT("UpdateToolDurability");
+        case EInventoryTraceOp::EvaluateCraftables: return TEXT("EvaluateCraftables");
+        case EInventoryTraceOp::CommitTransaction: return TEXT("CommitTransaction");
+        case EInventoryTraceOp::TransferItems: return TEXT("TransferItems");
+        case EInventoryTraceOp::TransferSlot: return TEXT("TransferSlot");
+        case EInventoryTraceOp::ApplyToolWear: return TEXT("ApplyToolWear");
+        case EInventoryTraceOp::RepairAllTools: return TEXT("RepairAllTools");
+        case EInventoryTraceOp::CompactStacks: return TEXT("CompactStacks");
+        default: return TEXT("Unknown");
+        }
+    }
+
+    uint32 readPacked(FArchive& reader)
+    {
+        uint32 value = 0;
+        reader.SerializeIntPacked(value);
+        return value;
+    }
+
+    int32 readInt(FArchive& reader)
+    {
+        int32 value = 0;
+        reader << value;
+        return value;
+    }
+
+    UObject* findObject(const FReplayState& state, uint32 const object_index)
+    {
+        return state.Objects.IsValidIndex(object_index) ? state.Objects[object_index] : nullptr;
+    }
+
+    UInventoryBagComponent* createBag(FReplayState& state, UBagProperties* properties)
+    {
+        AActor* actor = state.World->SpawnActor<AActor>();
+        UInventoryBagComponent* bag = NewObject<UInventoryBagComponent>(actor);
+        bag->BagProperties = properties;
+        bag->RegisterComponent(); // Begins play right away, the world has already begun play.
+        return bag;
+    }
+
+    /** Item components are created the first time they're met, as the actors they were recorded on don't exist here. */
+    UItemComponent* findOrCreateItem(FReplayState& state, uint32 const component_id, UItemData* item_data, int32 const durability)
+    {
+        if (UItemComponent* const* item = state.Items.Find(component_id)) return *item;
+        UItemComponent* item;
+        if (item_data != nullptr && item_data->IsA<UToolData>())
+        {
+            UToolComponent* tool = NewObject<UToolComponent>(state.World);
+            tool->Durability = durability;
+            item = tool;
+        }
+        else item = NewObject<UItemComponent>(state.World);
+        item->ItemData = item_data;
+        state.Items.Add(component_id, item);
+        return item;
+    }
+
+    bool loadTrace(const FString& trace_path, FReplayState& state)
+    {
+        TUniquePtr<FArchive> reader{IFileManager::Get().CreateFileReader(*trace_path)};
+        if (!reader.IsValid())
+        {
+            UE_LOG(LogInventorySystem, Error, TEXT("Can't open inventory trace [%s]"), *trace_path);
+            return false;
+        }
+        uint32 magic = 0;
+        uint32 version = 0;
+        *reader << magic << version;
+        if (magic != FInventoryTraceRecorder::Magic || version != FInventoryTraceRecorder::Version)
+        {
+            UE_LOG(LogInventorySystem, Error, TEXT("[%s] is not an inventory trace or was recorded with an unsupported version [%u]"), *trace_path, version);
+            return false;
+        }
+
+        uint32 seed_records = 0;
+        while (!reader->AtEnd() && !reader->IsError())
+        {
+            EInventoryTraceOp const op = static_cast<EInventoryTraceOp>(readPacked(*reader));
+            readPacked(*reader); // Elapsed time, replay runs as fast as possible.
+            int32 const op_count = state.Ops.Num();
+            switch (op)
+            {
+            case EInventoryTraceOp::DefineObject:
+                {
+                    uint32 const object_index = readPacked(*reader);
+                    FString path;
+                    *reader << path;
+                    if (object_index >= static_cast<uint32>(state.Objects.Num())) state.Objects.SetNumZeroed(object_index + 1);
+                    state.Objects[object_index] = path.IsEmpty() ? nullptr : StaticLoadObject(UObject::StaticClass(), nullptr, *path);
+                    if (!path.IsEmpty() && state.Objects[object_index] == nullptr) UE_LOG(LogInventorySystem, Warning, TEXT("Can't load traced object [%s]"), *path);
+                    break;
+                }
+            case EInventoryTraceOp::DefineBag:
+                {
+                    uint32 const bag_id = readPacked(*reader);
+                    UBagProperties* properties = Cast<UBagProperties>(findObject(state, readPacked(*reader)));
+                    state.Bags.Add(bag_id, createBag(state, properties));
+                    break;
+                }
+            case EInventoryTraceOp::AddItems:
+            case EInventoryTraceOp::RemoveItem:
+                {
+                    FReplayOp& replay_op = state.Ops.AddDefaulted_GetRef();
+                    replay_op.Op = op;
+                    replay_op.Bag = state.Bags.FindRef(readPacked(*reader));
+                    replay_op.ItemData = Cast<UItemData>(findObject(state, readPacked(*reader)));
+                    replay_op.Value = op == EInventoryTraceOp::AddItems ? readPacked(*reader) : 1;
+                    break;
+                }
+            case EInventoryTraceOp::AddItemComponent:
+                {
+                    FReplayOp& replay_op = state.Ops.AddDefaulted_GetRef();
+                    replay_op.Op = op;
+                    replay_op.Bag = state.Bags.FindRef(readPacked(*reader));
+                    UItemData* item_data = Cast<UItemData>(findObject(state, readPacked(*reader)));
+                    uint32 const component_id = readPacked(*reader);
+                    int32 durability = 0;
+                    *reader << durability;
+                    replay_op.Item = findOrCreateItem(state, component_id, item_data, durability);
+                    break;
+                }
+            case EInventoryTraceOp::RemoveItemComponent:
+            case EInventoryTraceOp::UpdateToolDurability:
+                {
+                    FReplayOp& replay_op = state.Ops.AddDefaulted_GetRef();
+                    replay_op.Op = op;
+                    replay_op.Bag = state.Bags.FindRef(readPacked(*reader));
+                    replay_op.Item = state.Items.FindRef(readPacked(*reader));
+                    if (op == EInventoryTraceOp::UpdateToolDurability) *reader << replay_op.Value;
+                    break;
+                }
+            case EInventoryTraceOp::SeedBag:
+                {
+                    readPacked(*reader); // Bag ID, the seed records name it too.
+                    seed_records = readPacked(*reader);
+                    break;
+                }
+            case EInventoryTraceOp::DestroyBag:
+                {
+                    // Ops are resolved up front, the bag only has to stop being found under this ID.
+                    state.Bags.Remove(readPacked(*reader));
+                    break;
+                }
+            case EInventoryTraceOp::CommitTransaction:
+                {
+                    FReplayOp& replay_op = state.Ops.AddDefaulted_GetRef();
+                    replay_op.Op = op;
+                    replay_op.Bag = state.Bags.FindRef(readPacked(*reader));
+                    uint32 const op_count = readPacked(*reader);
+                    for (uint32 i = 0; i < op_count; ++i)
+                    {
+                        FInventoryBagTransactionOp& transaction_op = replay_op.TransactionOps.AddDefaulted_GetRef();
+                        transaction_op.ItemData = Cast<UItemData>(findObject(state, readPacked(*reader)));
+                        transaction_op.Quantity = readInt(*reader);
+                    }
+                    break;
+                }
+            case EInventoryTraceOp::TransferItems:
+            case EInventoryTraceOp::TransferSlot:
+                {
+                    FReplayOp& replay_op = state.Ops.AddDefaulted_GetRef();
+                    replay_op.Op = op;
+                    replay_op.Bag = state.Bags.FindRef(readPacked(*reader));
+                    replay_op.ToBag = state.Bags.FindRef(readPacked(*reader));
+                    if (op == EInventoryTraceOp::TransferItems) replay_op.ItemData = Cast<UItemData>(findObject(state, readPacked(*reader)));
+                    replay_op.Value = readInt(*reader);
+                    break;
+                }
+            case EInventoryTraceOp::ApplyToolWear:
+            case EInventoryTraceOp::RepairAllTools:
+            case EInventoryTraceOp::CompactStacks:
+                {
+                    FReplayOp& replay_op = state.Ops.AddDefaulted_GetRef();
+                    replay_op.Op = op;
+                    replay_op.Bag = state.Bags.FindRef(readPacked(*reader));
+                    if (op == EInventoryTraceOp::ApplyToolWear) replay_op.Category = readInt(*reader);
+                    if (op != EInventoryTraceOp::RepairAllTools) replay_op.Value = readInt(*reader);
+                    break;
+                }
+            case EInventoryTraceOp::EvaluateCraftables:
+                {
+                    FReplayOp& replay_op = state.Ops.AddDefaulted_GetRef();
+                    replay_op.Op = op;
+                    replay_op.Craftables = Cast<UCraftablesCollection>(findObject(state, readPacked(*reader)));
+                    uint32 const bag_count = readPacked(*reader);
+                    for (uint32 i = 0; i < bag_count; ++i) replay_op.Bags.Add(state.Bags.FindRef(readPacked(*reader)));
+                    if (replay_op.Craftables != nullptr)
+                    {
+                        TSharedPtr<FStreamableHandle> handle = replay_op.Craftables->streamInCraftables();
+                        if (handle.IsValid()) handle->WaitUntilComplete();
+                    }
+                    break;
+                }
+            default:
+                UE_LOG(LogInventorySystem, Error, TEXT("Unknown op [%d] in inventory trace [%s]"), static_cast<int32>(op), *trace_path);
+                return false;
+            }
+            if (seed_records > 0 && state.Ops.Num() > op_count)
+            {
+                state.Ops.Last().bSeed = true;
+                --seed_records;
+            }
+        }
+        return !reader->IsError();
+    }
+
+    void replayOp(const FReplayOp& replay_op)
+    {
+        switch (replay_op.Op)
+        {
+        case EInventoryTraceOp::AddItems:
+            if (replay_op.Value == 1) replay_op.Bag->addItem(replay_op.ItemData);
+            else replay_op.Bag->addItems(replay_op.ItemData, replay_op.Value);
+            break;
+        case EInventoryTraceOp::RemoveItem:
+            replay_op.Bag->removeItem(replay_op.ItemData, false);
+            break;
+        case EInventoryTraceOp::AddItemComponent:
+            replay_op.Bag->addItemComponent(replay_op.Item);
+            break;
+        case EInventoryTraceOp::RemoveItemComponent:
+            replay_op.Bag->removeItemComponent(replay_op.Item, false);
+            break;
+        case EInventoryTraceOp::UpdateToolDurability:
+            replay_op.Bag->updateToolDurability(Cast<UToolComponent>(replay_op.Item), replay_op.Value);
+            break;
+        case EInventoryTraceOp::EvaluateCraftables:
+            UCraftingUtils::evaluateCraftablesForBags(replay_op.Bags, replay_op.Craftables);
+            break;
+        case EInventoryTraceOp::CommitTransaction:
+            replay_op.Bag->commitTransaction(replay_op.TransactionOps);
+            break;
+        case EInventoryTraceOp::TransferItems:
+            UInventoryBagComponent::transferItems(replay_op.Bag, replay_op.ToBag, replay_op.ItemData, replay_op.Value);
+            break;
+        case EInventoryTraceOp::TransferSlot:
+            UInventoryBagComponent::transferSlot(replay_op.Bag, replay_op.ToBag, replay_op.Value);
+            break;
+        case EInventoryTraceOp::ApplyToolWear:
+            if (replay_op.Category == INDEX_NONE) replay_op.Bag->applyToolWearToAll(replay_op.Value);
+            else replay_op.Bag->applyToolWear(static_cast<EToolCategory>(replay_op.Category), replay_op.Value);
+            break;
+        case EInventoryTraceOp::RepairAllTools:
+            replay_op.Bag->repairAllTools();
+            break;
+        case EInventoryTraceOp::CompactStacks:
+            replay_op.Bag->compactStacks(replay_op.Value);
+            break;
+        default:
+            break;
+        }
+    }
+
+    /** Ops whose bag or item couldn't be resolved are skipped, they'd only measure the failure path. */
+    bool canReplay(const FReplayOp& replay_op)
+    {
+        switch (replay_op.Op)
+        {
+        case EInventoryTraceOp::EvaluateCraftables:
+            return true;
+        case EInventoryTraceOp::AddItems:
+        case EInventoryTraceOp::RemoveItem:
+        case EInventoryTraceOp::AddItemComponent:
+        case EInventoryTraceOp::RemoveItemComponent:
+        case EInventoryTraceOp::UpdateToolDurability:
+            return replay_op.Bag != nullptr && (replay_op.ItemData != nullptr || replay_op.Item != nullptr);
+        case EInventoryTraceOp::TransferItems:
+            return replay_op.Bag != nullptr && replay_op.ToBag != nullptr && replay_op.ItemData != nullptr;
+        case EInventoryTraceOp::TransferSlot:
+            return replay_op.Bag != nullptr && replay_op.ToBag != nullptr;
+        default:
+            return replay_op.Bag != nullptr;
+        }
+    }
+
+    double getPercentile(const TArray<uint64>& sorted_cycles, double const percentile)
+    {
+        int32 const index = FMath::Clamp(FMath::CeilToInt(percentile * sorted_cycles.Num()) - 1, 0, sorted_cycles.Num() - 1);
+        return FPlatformTime::ToSeconds64(sorted_cycles[index]) * 1000000.0;
+    }
+}
+
+UInventoryTraceReplayCommandlet::UInventoryTraceReplayCommandlet()
+{
+    IsClient = false;
+    IsServer = false;
+    IsEditor = false;
+    LogToConsole = true;
+}
+
+int32 UInventoryTraceReplayCommandlet::Main(const FString& Params)
+{
+    FString trace_path;
+    if (!FParse::Value(*Params, TEXT("Trace="), trace_path))
+    {
+        UE_LOG(LogInventorySystem, Error, TEXT("Usage: -run=InventoryTraceReplay -Trace=<trace file> [-Repeat=<times>]"));
+        return 1;
+    }
+    int32 repeat = 1;
+    FParse::Value(*Params, TEXT("Repeat="), repeat);
+
+    TMap<EInventoryTraceOp, TArray<uint64>> op_cycles;
+    uint64 total_cycles = 0;
+    int32 total_ops = 0;
+    for (int32 iteration = 0; iteration < FMath::Max(repeat, 1); ++iteration)
+    {
+        // Every repetition starts from empty bags, the way the trace was recorded.
+        FReplayState state;
+        state.World = UWorld::CreateWorld(EWorldType::Game, false);
+        FWorldContext& world_context = GEngine->CreateNewWorldContext(EWorldType::Game);
+        world_context.SetCurrentWorld(state.World);
+        state.World->InitializeActorsForPlay(FURL());
+        state.World->BeginPlay();
+
+        bool const bLoaded = loadTrace(trace_path, state);
+        if (bLoaded)
+        {
+            for (const FReplayOp& replay_op : state.Ops)
+            {
+                if (!canReplay(replay_op)) continue;
+                if (replay_op.bSeed)
+                {
+                    replayOp(replay_op);
+                    continue;
+                }
+                uint64 const start_cycles = FPlatformTime::Cycles64();
+                replayOp(replay_op);
+                uint64 const cycles = FPlatformTime::Cycles64() - start_cycles;
+                op_cycles.FindOrAdd(replay_op.Op).Add(cycles);
+                total_cycles += cycles;
+                ++total_ops;
+            }
+        }
+
+        GEngine->DestroyWorldContext(state.World);
+        state.World->DestroyWorld(false);
+        CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+        if (!bLoaded) return 1;
+    }
+
+    double const total_seconds = FPlatformTime::ToSeconds64(total_cycles);
+    UE_LOG(LogInventorySystem, Display, TEXT("Replayed [%d] ops from [%s] in [%.3f] ms: [%.0f] ops/s"),
+           total_ops, *trace_path, total_seconds * 1000.0, total_seconds > 0.0 ? total_ops / total_seconds : 0.0);
+    for (auto&& entry : op_cycles)
+    {
+        TArray<uint64>& cycles = entry.Value;
+        cycles.Sort();
+        UE_LOG(LogInventorySystem, Display, TEXT("  %-22s count [%d] p50 [%.2f] us p90 [%.2f] us p99 [%.2f] us max [%.2f] us"),
+               getOpName(entry.Key), cycles.Num(), getPercentile(cycles, 0.5), getPercentile(cycles, 0.9), getPercentile(cycles, 0.99), getPercentile(cycles, 1.0));
+    }
+    return 0;
+}
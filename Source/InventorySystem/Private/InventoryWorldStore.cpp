@@ -0,0 +1,315 @@
+// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
+
+#include "InventoryWorldStore.h"
+#include "InventoryBagComponent.h"
+#include "Engine/AssetManager.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "UObject/UObjectIterator.h"
+
+DECLARE_CYCLE_STAT(TEXT("Store Add Items"), STAT_InventoryStoreAddItems, STATGROUP_InventorySystem);
+DECLARE_CYCLE_STAT(TEXT("Store Remove Items"), STAT_InventoryStoreRemoveItems, STATGROUP_InventorySystem);
+
+static FAutoConsoleCommandWithWorld GInventoryMemoryPerBagCommand(
+    TEXT("InventorySystem.MemoryPerBag"),
+    TEXT("Logs the average memory used by a bag in the world inventory store and by a bag component."),
+    FConsoleCommandWithWorldDelegate::CreateStatic(&UInventoryWorldStore::logMemoryPerBag));
+
+namespace
+{
+    /** Slots needed by a compacted type holding quantity items. */
+    int32 getSlotsForQuantity(int32 const quantity, int32 const max_stack_size)
+    {
+        return (quantity + max_stack_size - 1) / max_stack_size;
+    }
+
+    SIZE_T getBagAllocatedSize(const FStoredBag& bag)
+    {
+        return sizeof(FStoredBag) + bag.Types.GetAllocatedSize() + bag.Tools.GetAllocatedSize();
+    }
+}
+
+UInventoryWorldStore* UInventoryWorldStore::get(const UObject* world_context)
+{
+    UWorld* world = world_context != nullptr ? world_context->GetWorld() : nullptr;
+    return world != nullptr ? world->GetSubsystem<UInventoryWorldStore>() : nullptr;
+}
+
+FInventoryBagHandle UInventoryWorldStore::createBag(UBagProperties* properties)
+{
+    INVENTORY_LLM_SCOPE();
+    if (!IsValid(properties))
+    {
+        UE_LOG(LogInventorySystem, Error, TEXT("Can't create store bag. Invalid bag properties."));
+        return {};
+    }
+    streamInLimits(properties);
+
+    int32 index;
+    if (free_indices.Num() > 0) index = free_indices.Pop(false);
+    else
+    {
+        index = bags.AddDefaulted();
+        generations.Add(0);
+    }
+    bags[index].Properties = properties;
+    return {index, generations[index]};
+}
+
+void UInventoryWorldStore::destroyBag(FInventoryBagHandle handle)
+{
+    FStoredBag* bag = findBag(handle);
+    if (bag == nullptr) return;
+    *bag = FStoredBag();
+    ++generations[handle.Index];
+    free_indices.Push(handle.Index);
+}
+
+int32 UInventoryWorldStore::addItems(FInventoryBagHandle handle, UItemData* item_data, int32 count, int32 durability)
+{
+    INVENTORY_LLM_SCOPE();
+    SCOPE_CYCLE_COUNTER(STAT_InventoryStoreAddItems);
+    FStoredBag* bag = findBag(handle);
+    if (bag == nullptr || !IsValid(item_data) || count <= 0)
+    {
+        UE_LOG(LogInventorySystem, Display, TEXT("Can't add items [%s] to store bag [%d]"), IsValid(item_data) ? *item_data->GetPathName() : TEXT("InvalidItem"), handle.Index);
+        return 0;
+    }
+    UToolData* tool_data = Cast<UToolData>(item_data);
+    bool const bIsResource = item_data->Category == EItemCategory::Resource && item_data->IsA<UResourceData>();
+    bool const bIsTool = item_data->Category == EItemCategory::Tool && tool_data != nullptr;
+    if (!bIsResource && !bIsTool)
+    {
+        UE_LOG(LogInventorySystem, Warning, TEXT("Invalid item category or data type [%s] for store bag [%d]"), *item_data->GetPathName(), handle.Index);
+        return 0;
+    }
+    TOptional<FItemBagLimitValues> const bag_limit = getItemLimit(*bag, item_data);
+    if (!bag_limit.IsSet() || bag_limit->MaxQuantity <= 0 || bag_limit->MaxStackSize <= 0)
+    {
+        UE_LOG(LogInventorySystem, Display, TEXT("Can't add item [%s] to store bag [%d]. Missing limits or max quantity = 0."), *item_data->GetPathName(), handle.Index);
+        return 0;
+    }
+
+    FStoredItemType* type = bag->Types.FindByPredicate([item_data](const FStoredItemType& entry) { return entry.ItemData == item_data; });
+    int32 quantity = type != nullptr ? type->Quantity : 0;
+    int32& used_slots = bIsTool ? bag->ToolSlots : bag->ResourceSlots;
+    int32 const max_slots = bIsTool ? bag->Properties->MaxToolsSlots : bag->Properties->MaxResourceSlots;
+
+    // Same order of checks as adding items one by one to a bag component: IDs, quantity, then a new slot when the last one is full.
+    int32 added = 0;
+    while (added < count && bag->ItemCount < bag->Properties->MaxItemId && quantity < bag_limit->MaxQuantity)
+    {
+        if (quantity % bag_limit->MaxStackSize == 0)
+        {
+            if (used_slots >= max_slots) break;
+            ++used_slots;
+        }
+        ++quantity;
+        ++bag->ItemCount;
+        ++added;
+    }
+    if (added == 0)
+    {
+        UE_LOG(LogInventorySystem, Verbose, TEXT("Can't add item [%s] to store bag [%d]. Bag is full."), *item_data->GetPathName(), handle.Index);
+        return 0;
+    }
+
+    if (type == nullptr)
+    {
+        type = &bag->Types[bag->Types.Add({item_data, 0})];
+        // Bag components using the store spawn drop actors on removal.
+        item_data->streamInDropActor();
+    }
+    type->Quantity = quantity;
+    if (bIsTool)
+    {
+        int32 const tool_durability = durability != INDEX_NONE ? durability : tool_data->MaxDurability;
+        bag->Tools.Reserve(bag->Tools.Num() + added);
+        for (int32 i = 0; i < added; ++i) bag->Tools.Add({tool_data, tool_durability});
+    }
+    return added;
+}
+
+int32 UInventoryWorldStore::removeItems(FInventoryBagHandle handle, UItemData* item_data, int32 count)
+{
+    SCOPE_CYCLE_COUNTER(STAT_InventoryStoreRemoveItems);
+    FStoredBag* bag = findBag(handle);
+    if (bag == nullptr || !IsValid(item_data) || count <= 0) return 0;
+    int32 const type_index = bag->Types.IndexOfByPredicate([item_data](const FStoredItemType& entry) { return entry.ItemData == item_data; });
+    if (type_index == INDEX_NONE)
+    {
+        UE_LOG(LogInventorySystem, Display, TEXT("Can't remove item [%s] from store bag [%d]. No item of this type found."), *item_data->GetPathName(), handle.Index);
+        return 0;
+    }
+
+    FStoredItemType& type = bag->Types[type_index];
+    int32 const removed = FMath::Min(count, type.Quantity);
+    // Limits were there when the items were added, they're only missing if the properties changed since.
+    TOptional<FItemBagLimitValues> const bag_limit = getItemLimit(*bag, item_data);
+    int32 const max_stack_size = bag_limit.IsSet() ? FMath::Max(bag_limit->MaxStackSize, 1) : 1;
+    int32& used_slots = item_data->Category == EItemCategory::Tool ? bag->ToolSlots : bag->ResourceSlots;
+    used_slots -= getSlotsForQuantity(type.Quantity, max_stack_size) - getSlotsForQuantity(type.Quantity - removed, max_stack_size);
+    type.Quantity -= removed;
+    bag->ItemCount -= removed;
+
+    if (item_data->Category == EItemCategory::Tool)
+    {
+        int32 left_to_remove = removed;
+        for (int32 i = bag->Tools.Num() - 1; i >= 0 && left_to_remove > 0; --i)
+        {
+            if (bag->Tools[i].ToolData != item_data) continue;
+            bag->Tools.RemoveAt(i, 1, false);
+            --left_to_remove;
+        }
+    }
+    if (type.Quantity == 0) bag->Types.RemoveAtSwap(type_index, 1, false);
+    return removed;
+}
+
+int32 UInventoryWorldStore::getItemQuantity(FInventoryBagHandle handle, UItemData* item_data) const
+{
+    const FStoredBag* bag = findBag(handle);
+    if (bag == nullptr) return 0;
+    const FStoredItemType* type = bag->Types.FindByPredicate([item_data](const FStoredItemType& entry) { return entry.ItemData == item_data; });
+    return type != nullptr ? type->Quantity : 0;
+}
+
+int32 UInventoryWorldStore::getCategoryQuantity(FInventoryBagHandle handle, EResourceCategory category) const
+{
+    const FStoredBag* bag = findBag(handle);
+    if (bag == nullptr) return 0;
+    int32 quantity = 0;
+    for (auto&& type : bag->Types)
+    {
+        const UResourceData* resource_data = Cast<UResourceData>(type.ItemData);
+        if (resource_data != nullptr && resource_data->ResourceCategory == category) quantity += type.Quantity;
+    }
+    return quantity;
+}
+
+int32 UInventoryWorldStore::getToolCategoryQuantity(FInventoryBagHandle handle, EToolCategory category) const
+{
+    const FStoredBag* bag = findBag(handle);
+    if (bag == nullptr) return 0;
+    int32 quantity = 0;
+    for (auto&& type : bag->Types)
+    {
+        const UToolData* tool_data = Cast<UToolData>(type.ItemData);
+        if (tool_data != nullptr && tool_data->ToolCategory == category) quantity += type.Quantity;
+    }
+    return quantity;
+}
+
+int32 UInventoryWorldStore::getTagQuantity(FInventoryBagHandle handle, FGameplayTag tag) const
+{
+    const FStoredBag* bag = findBag(handle);
+    if (bag == nullptr || !tag.IsValid()) return 0;
+    int32 quantity = 0;
+    for (auto&& type : bag->Types)
+    {
+        if (type.ItemData->Tags.HasTag(tag)) quantity += type.Quantity;
+    }
+    return quantity;
+}
+
+TArray<UItemData*> UInventoryWorldStore::getTypesWithTag(FInventoryBagHandle handle, FGameplayTag tag) const
+{
+    TArray<UItemData*> types;
+    const FStoredBag* bag = findBag(handle);
+    if (bag == nullptr || !tag.IsValid()) return types;
+    for (auto&& type : bag->Types)
+    {
+        if (type.ItemData->Tags.HasTag(tag)) types.Add(type.ItemData);
+    }
+    return types;
+}
+
+const FStoredBag* UInventoryWorldStore::findBag(FInventoryBagHandle handle) const
+{
+    if (!generations.IsValidIndex(handle.Index) || generations[handle.Index] != handle.Generation) return nullptr;
+    return &bags[handle.Index];
+}
+
+FStoredBag* UInventoryWorldStore::findBag(FInventoryBagHandle handle)
+{
+    return const_cast<FStoredBag*>(static_cast<const UInventoryWorldStore*>(this)->findBag(handle));
+}
+
+SIZE_T UInventoryWorldStore::getAllocatedSize() const
+{
+    // Free entries still take room in the arrays, so they're counted too.
+    SIZE_T bytes = bags.GetAllocatedSize() + generations.GetAllocatedSize() + free_indices.GetAllocatedSize();
+    for (auto&& bag : bags) bytes += getBagAllocatedSize(bag) - sizeof(FStoredBag);
+    return bytes;
+}
+
+SIZE_T UInventoryWorldStore::getAverageBytesPerBag() const
+{
+    int32 const num_bags = getNumBags();
+    return num_bags > 0 ? getAllocatedSize() / num_bags : 0;
+}
+
+void UInventoryWorldStore::logMemoryPerBag(UWorld* world)
+{
+    SIZE_T component_bytes = 0;
+    int32 num_components = 0;
+    for (TObjectIterator<UInventoryBagComponent> it; it; ++it)
+    {
+        if (it->GetWorld() != world) continue;
+        component_bytes += it->GetClass()->GetStructureSize() + it->GetResourceSizeBytes(EResourceSizeMode::Exclusive);
+        ++num_components;
+    }
+
+    UInventoryWorldStore* store = world != nullptr ? world->GetSubsystem<UInventoryWorldStore>() : nullptr;
+    UE_LOG(LogInventorySystem, Display, TEXT("Bag components: [%d] bags, [%llu] bytes per bag."),
+           num_components, static_cast<uint64>(num_components > 0 ? component_bytes / num_components : 0));
+    UE_LOG(LogInventorySystem, Display, TEXT("World store: [%d] bags, [%llu] bytes per bag."),
+           store != nullptr ? store->getNumBags() : 0, static_cast<uint64>(store != nullptr ? store->getAverageBytesPerBag() : 0));
+}
+
+void UInventoryWorldStore::Deinitialize()
+{
+    for (auto&& handle : limits_stream_handles)
+    {
+        if (handle.Value.IsValid()) handle.Value->CancelHandle();
+    }
+    limits_stream_handles.Reset();
+    bags.Reset();
+    generations.Reset();
+    free_indices.Reset();
+    Super::Deinitialize();
+}
+
+void UInventoryWorldStore::AddReferencedObjects(UObject* in_this, FReferenceCollector& collector)
+{
+    UInventoryWorldStore* store = CastChecked<UInventoryWorldStore>(in_this);
+    for (auto&& bag : store->bags)
+    {
+        collector.AddReferencedObject(bag.Properties, store);
+        for (auto&& type : bag.Types) collector.AddReferencedObject(type.ItemData, store);
+    }
+    collector.AddReferencedObjects(store->limits_stream_handles, store);
+    Super::AddReferencedObjects(in_this, collector);
+}
+
+TOptional<FItemBagLimitValues> UInventoryWorldStore::getItemLimit(const FStoredBag& bag, UItemData* item_data) const
+{
+    return bag.Properties->resolveLimit(item_data);
+}
+
+void UInventoryWorldStore::streamInLimits(UBagProperties* properties)
+{
+    INVENTORY_LLM_SCOPE();
+    if (limits_stream_handles.Contains(properties)) return;
+    if (!UAssetManager::IsValid())
+    {
+        UE_LOG(LogInventorySystem, Error, TEXT("Asset manager unavailable, can't stream in required assets"));
+        return;
+    }
+
+    TArray<FSoftObjectPath> stream_in_assets;
+    for (auto&& limit : properties->Limits) stream_in_assets.Add(limit.Value.ToSoftObjectPath());
+    limits_stream_handles.Add(properties, stream_in_assets.Num() > 0
+                                              ? UAssetManager::GetStreamableManager().RequestAsyncLoad(stream_in_assets, FStreamableDelegate(), FStreamableManager::AsyncLoadHighPriority)
+                                              : nullptr);
+}
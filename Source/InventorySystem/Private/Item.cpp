@@ -1,55 +1,163 @@
-// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
-
-#include "Item.h"
-#include "InventoryBagComponent.h"
-#include "GameFramework/Actor.h"
-
-UItemComponent::UItemComponent()
-{
-    ItemData = CreateDefaultSubobject<UItemData>(TEXT("ItemData"));
-    ItemData->Category = EItemCategory::None;
-}
-
-AActor* UItemComponent::getPickableActor_Implementation()
-{
-    return this->GetOwner();
-}
-
-UItemData* UItemComponent::getItemData_Implementation()
-{
-    return ItemData;
-}
-
-UItemComponent* UItemComponent::getItemComponent_Implementation()
-{
-    return this;
-}
-
-FVector UItemComponent::getPickableLocation_Implementation()
-{
-    return GetOwner()->GetActorLocation();
-}
-
-EPickupBehavior UItemComponent::getPickupBehavior_Implementation()
-{
-    return EPickupBehavior::UseDataOnly;
-}
-
-TScriptInterface<IPickable> UItemComponent::getPickable_Implementation()
-{
-    return this;
-}
-
-void UItemComponent::OnItemPickedUp_Implementation(UInventoryBagComponent* owning_bag)
-{
-    check(owning_bag != nullptr);
-    UE_LOG(LogInventorySystem, Verbose, TEXT("Item [%s] picked up by %s."), *this->GetOwner()->GetName(), *owning_bag->GetName());
-    OwningBag = owning_bag;
-}
-
-void UItemComponent::OnItemDropped_Implementation(UInventoryBagComponent* owning_bag)
-{
-    check(owning_bag != nullptr);
-    UE_LOG(LogInventorySystem, Verbose, TEXT("Item [%s] dropped from %s."), *this->GetOwner()->GetName(), *owning_bag->GetName());
-    OwningBag = nullptr;
-}
+// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
+
+#include "Item.h"
+#include "InventoryBagComponent.h"
+#include "ItemTypeRegistry.h"
+#include "Engine/AssetManager.h"
+#include "Engine/World.h"
+#include "GameFramework/Actor.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformMemory.h"
+#include "UObject/UObjectIterator.h"
+
+namespace
+{
+    int32 countItemData()
+    {
+        int32 count = 0;
+        for (TObjectIterator<UItemData> it; it; ++it) ++count;
+        return count;
+    }
+
+    /** Spawns and destroys a batch of item actors, logging the time, objects and memory each of them costs. */
+    void benchmarkItemSpawn(const TArray<FString>& args, UWorld* world)
+    {
+        UClass* actor_class = args.Num() > 0 ? LoadClass<AActor>(nullptr, *args[0]) : nullptr;
+        if (world == nullptr || actor_class == nullptr)
+        {
+            UE_LOG(LogInventorySystem, Warning, TEXT("Usage: InventorySystem.BenchmarkItemSpawn <actor class path> [count]"));
+            return;
+        }
+        int32 const count = args.Num() > 1 ? FMath::Max(FCString::Atoi(*args[1]), 1) : 1000;
+
+        CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+        int32 const objects_before = GUObjectArray.GetObjectArrayNumMinusAvailable();
+        int32 const item_data_before = countItemData();
+        uint64 const memory_before = FPlatformMemory::GetStats().UsedPhysical;
+
+        FActorSpawnParameters spawn_parameters;
+        spawn_parameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+        TArray<AActor*> actors;
+        actors.Reserve(count);
+        double const start_time = FPlatformTime::Seconds();
+        for (int32 i = 0; i < count; ++i) actors.Add(world->SpawnActor<AActor>(actor_class, FTransform::Identity, spawn_parameters));
+        double const spawn_time = FPlatformTime::Seconds() - start_time;
+
+        int32 const objects = GUObjectArray.GetObjectArrayNumMinusAvailable() - objects_before;
+        int32 const item_data = countItemData() - item_data_before;
+        int64 const memory = static_cast<int64>(FPlatformMemory::GetStats().UsedPhysical) - static_cast<int64>(memory_before);
+        UE_LOG(LogInventorySystem, Display, TEXT("Spawned [%d] [%s]: [%.3f] ms per actor, [%.2f] objects per actor, [%d] item data created, [%lld] bytes per actor"),
+               count, *actor_class->GetName(), spawn_time * 1000.0 / count, static_cast<float>(objects) / count, item_data, memory / count);
+
+        for (AActor* actor : actors) if (actor != nullptr) actor->Destroy();
+    }
+}
+
+static FAutoConsoleCommandWithWorldAndArgs GInventoryBenchmarkItemSpawnCommand(
+    TEXT("InventorySystem.BenchmarkItemSpawn"),
+    TEXT("Spawns count (default 1000) actors of the given class and logs spawn time, objects and memory per actor, then destroys them."),
+    FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&benchmarkItemSpawn));
+
+const FName UItemData::UIBundle{TEXT("UI")};
+const FName UItemData::DropBundle{TEXT("Drop")};
+const FName UItemData::CraftingBundle{TEXT("Crafting")};
+
+void UItemData::PostInitProperties()
+{
+    Super::PostInitProperties();
+    // Only actual item data ends up in bags, class defaults and archetypes don't need an ID.
+    if (!HasAnyFlags(RF_ClassDefaultObject | RF_ArchetypeObject)) type_id = FItemTypeRegistry::get().registerType(this);
+}
+
+void UItemData::BeginDestroy()
+{
+    if (type_id != INDEX_NONE) FItemTypeRegistry::get().unregisterType(type_id);
+    type_id = INDEX_NONE;
+    Super::BeginDestroy();
+}
+
+void UItemData::streamInDropActor() const
+{
+    if (drop_stream_handle.IsValid() || OnDropSpawnedActor.IsNull() || !OnDropSpawnedActor.IsPending() || !UAssetManager::IsValid()) return;
+    drop_stream_handle = UAssetManager::GetStreamableManager().RequestAsyncLoad(OnDropSpawnedActor.ToSoftObjectPath());
+}
+
+UClass* UItemData::loadDropActor() const
+{
+    if (OnDropSpawnedActor.IsNull()) return nullptr;
+    if (drop_stream_handle.IsValid() && drop_stream_handle->IsLoadingInProgress()) drop_stream_handle->WaitUntilComplete();
+    return OnDropSpawnedActor.LoadSynchronous();
+}
+
+const FGameplayTagContainer& UItemData::getTagsWithParents() const
+{
+    if (!bTagsWithParentsBuilt)
+    {
+        tags_with_parents = Tags.GetGameplayTagParents();
+        bTagsWithParentsBuilt = true;
+    }
+    return tags_with_parents;
+}
+
+#if WITH_EDITOR
+void UItemData::PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent)
+{
+    Super::PostEditChangeProperty(PropertyChangedEvent);
+    bTagsWithParentsBuilt = false;
+}
+#endif
+
+void UItemComponent::OnRegister()
+{
+    Super::OnRegister();
+    if (bUseInstanceData && IsValid(ItemData) && ItemData->GetOuter() != this) ItemData = DuplicateObject<UItemData>(ItemData, this);
+}
+
+AActor* UItemComponent::getPickableActor_Implementation()
+{
+    return this->GetOwner();
+}
+
+UItemData* UItemComponent::getItemData_Implementation()
+{
+    return ItemData;
+}
+
+UItemComponent* UItemComponent::getItemComponent_Implementation()
+{
+    return this;
+}
+
+FVector UItemComponent::getPickableLocation_Implementation()
+{
+    return GetOwner()->GetActorLocation();
+}
+
+int32 UItemComponent::getPickableQuantity_Implementation()
+{
+    return 1;
+}
+
+EPickupBehavior UItemComponent::getPickupBehavior_Implementation()
+{
+    return EPickupBehavior::UseDataOnly;
+}
+
+TScriptInterface<IPickable> UItemComponent::getPickable_Implementation()
+{
+    return this;
+}
+
+void UItemComponent::OnItemPickedUp_Implementation(UInventoryBagComponent* owning_bag)
+{
+    check(owning_bag != nullptr);
+    UE_LOG(LogInventorySystem, Verbose, TEXT("Item [%s] picked up by %s."), *this->GetOwner()->GetName(), *owning_bag->GetName());
+    OwningBag = owning_bag;
+}
+
+void UItemComponent::OnItemDropped_Implementation(UInventoryBagComponent* owning_bag)
+{
+    check(owning_bag != nullptr);
+    UE_LOG(LogInventorySystem, Verbose, TEXT("Item [%s] dropped from %s."), *this->GetOwner()->GetName(), *owning_bag->GetName());
+    OwningBag = nullptr;
+}
@@ -0,0 +1,45 @@
+// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
+
+#include "ItemTypeRegistry.h"
+#include "Misc/ScopeLock.h"
+
+FItemTypeRegistry& FItemTypeRegistry::get()
+{
+    static FItemTypeRegistry registry;
+    return registry;
+}
+
+int32 FItemTypeRegistry::registerType(UItemData* item_data)
+{
+    INVENTORY_LLM_SCOPE();
+    check(item_data != nullptr);
+    FScopeLock scope_lock(&lock);
+    // Reuse freed IDs first to keep them dense.
+    if (free_ids.Num() > 0)
+    {
+        int32 const type_id = free_ids.Pop(false);
+        types[type_id] = item_data;
+        return type_id;
+    }
+    return types.Add(item_data);
+}
+
+void FItemTypeRegistry::unregisterType(int32 const type_id)
+{
+    FScopeLock scope_lock(&lock);
+    if (!types.IsValidIndex(type_id) || types[type_id] == nullptr) return;
+    types[type_id] = nullptr;
+    free_ids.Push(type_id);
+}
+
+UItemData* FItemTypeRegistry::findType(int32 const type_id) const
+{
+    FScopeLock scope_lock(&lock);
+    return types.IsValidIndex(type_id) ? types[type_id] : nullptr;
+}
+
+int32 FItemTypeRegistry::getMaxTypeId() const
+{
+    FScopeLock scope_lock(&lock);
+    return types.Num();
+}
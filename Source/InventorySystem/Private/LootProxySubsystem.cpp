@@ -0,0 +1,361 @@
+// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
+
+#include "LootProxySubsystem.h"
+#include "PickupTriggerComponent.h"
+#include "PickupTriggerSubsystem.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Components/StaticMeshComponent.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+
+DECLARE_CYCLE_STAT(TEXT("Loot Proxies Update"), STAT_LootProxyUpdate, STATGROUP_InventorySystem);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Loot Proxies"), STAT_LootProxies, STATGROUP_InventorySystem);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Loot Proxies Promoted"), STAT_LootProxiesPromoted, STATGROUP_InventorySystem);
+
+static TAutoConsoleVariable<float> CVarLootProxyPromoteRadius(
+    TEXT("InventorySystem.LootProxy.PromoteRadius"),
+    1500.f,
+    TEXT("Proxies closer than this to a pickup trigger are turned into their actor."));
+
+static TAutoConsoleVariable<float> CVarLootProxyDemoteRadius(
+    TEXT("InventorySystem.LootProxy.DemoteRadius"),
+    2000.f,
+    TEXT("Promoted actors farther than this from every pickup trigger are turned back into proxies.\n")
+    TEXT("Also the grid cell size, read when the world starts. Keep it above PromoteRadius to avoid flip-flopping."));
+
+static TAutoConsoleVariable<float> CVarLootProxyUpdateInterval(
+    TEXT("InventorySystem.LootProxy.UpdateInterval"),
+    0.25f,
+    TEXT("Seconds between two promote/demote passes."));
+
+static TAutoConsoleVariable<int32> CVarLootProxyMaxPromotions(
+    TEXT("InventorySystem.LootProxy.MaxPromotionsPerUpdate"),
+    32,
+    TEXT("Maximum number of actors spawned by a single pass, the rest wait for the next ones. Negative for no limit."));
+
+void ULootProxyComponent::BeginPlay()
+{
+    Super::BeginPlay();
+    if (bPromotedFromProxy || !GetOwner()->HasAuthority()) return;
+    ULootProxySubsystem* subsystem = ULootProxySubsystem::get(this);
+    if (subsystem == nullptr) return;
+
+    UStaticMesh* mesh = ProxyMesh;
+    if (mesh == nullptr)
+    {
+        UStaticMeshComponent* mesh_component = GetOwner()->FindComponentByClass<UStaticMeshComponent>();
+        mesh = mesh_component != nullptr ? mesh_component->GetStaticMesh() : nullptr;
+    }
+    subsystem->addPromotedActor(GetOwner(), mesh);
+}
+
+ULootProxySubsystem* ULootProxySubsystem::get(const UObject* world_context)
+{
+    UWorld* world = world_context != nullptr ? world_context->GetWorld() : nullptr;
+    return world != nullptr ? world->GetSubsystem<ULootProxySubsystem>() : nullptr;
+}
+
+int32 ULootProxySubsystem::addProxy(TSubclassOf<AActor> actor_class, const FTransform& transform, UStaticMesh* mesh)
+{
+    INVENTORY_LLM_SCOPE();
+    if (actor_class == nullptr)
+    {
+        UE_LOG(LogInventorySystem, Error, TEXT("Can't add a loot proxy without an actor class."));
+        return INDEX_NONE;
+    }
+    int32 const proxy_id = allocateProxy(actor_class, transform, mesh);
+    updateInstance(proxy_id, true);
+    return proxy_id;
+}
+
+int32 ULootProxySubsystem::addPromotedActor(AActor* actor, UStaticMesh* mesh)
+{
+    INVENTORY_LLM_SCOPE();
+    if (!IsValid(actor)) return INDEX_NONE;
+    if (const int32* proxy_id = promoted_actor_proxies.Find(actor)) return *proxy_id;
+    int32 const proxy_id = allocateProxy(actor->GetClass(), actor->GetActorTransform(), mesh);
+    proxies[proxy_id].Actor = actor;
+    promoted_proxies.Add(proxy_id);
+    promoted_actor_proxies.Add(actor, proxy_id);
+    actor->OnDestroyed.AddDynamic(this, &ULootProxySubsystem::handlePromotedActorDestroyed);
+    return proxy_id;
+}
+
+void ULootProxySubsystem::removeProxy(int32 proxy_id)
+{
+    if (!proxies.IsValidIndex(proxy_id) || proxies[proxy_id].ClassIndex == INDEX_NONE) return;
+    if (AActor* actor = proxies[proxy_id].Actor.Get())
+    {
+        actor->OnDestroyed.RemoveDynamic(this, &ULootProxySubsystem::handlePromotedActorDestroyed);
+        actor->Destroy();
+    }
+    releaseProxy(proxy_id);
+}
+
+void ULootProxySubsystem::updateProxies()
+{
+    SCOPE_CYCLE_COUNTER(STAT_LootProxyUpdate);
+    INVENTORY_LLM_SCOPE();
+    ++update_number;
+
+    // Promoted actors can move around, keep their proxy where they are.
+    for (int32 const proxy_id : promoted_proxies)
+    {
+        AActor* actor = proxies[proxy_id].Actor.Get();
+        if (actor == nullptr) continue;
+        proxy_locations[proxy_id] = actor->GetActorLocation();
+        moveToCell(proxy_id, getCell(proxy_locations[proxy_id]));
+    }
+
+    trigger_locations.Reset();
+    if (UPickupTriggerSubsystem* trigger_subsystem = GetWorld()->GetSubsystem<UPickupTriggerSubsystem>())
+    {
+        for (UPickupTriggerComponent* trigger : trigger_subsystem->getTriggers())
+        {
+            if (IsValid(trigger)) trigger_locations.Add(trigger->GetComponentLocation());
+        }
+    }
+
+    float const promote_radius_sq = FMath::Square(CVarLootProxyPromoteRadius.GetValueOnGameThread());
+    float const demote_radius = FMath::Max(CVarLootProxyDemoteRadius.GetValueOnGameThread(), 0.f);
+    float const demote_radius_sq = FMath::Square(demote_radius);
+    int32 promotions_left = CVarLootProxyMaxPromotions.GetValueOnGameThread();
+    for (const FVector& trigger_location : trigger_locations)
+    {
+        FIntPoint const min_cell = getCell(trigger_location - FVector{demote_radius});
+        FIntPoint const max_cell = getCell(trigger_location + FVector{demote_radius});
+        for (int32 x = min_cell.X; x <= max_cell.X; ++x)
+        {
+            for (int32 y = min_cell.Y; y <= max_cell.Y; ++y)
+            {
+                const TArray<int32>* cell_proxies = grid.Find({x, y});
+                if (cell_proxies == nullptr) continue;
+                for (int32 const proxy_id : *cell_proxies)
+                {
+                    float const distance_sq = FVector::DistSquared(trigger_location, proxy_locations[proxy_id]);
+                    if (distance_sq > demote_radius_sq) continue;
+                    FLootProxy& proxy = proxies[proxy_id];
+                    proxy.LastNearbyUpdate = update_number;
+                    if (distance_sq <= promote_radius_sq && !proxy.Actor.IsValid() && promotions_left != 0 && !pending_promotions.Contains(proxy_id))
+                    {
+                        pending_promotions.Add(proxy_id);
+                        --promotions_left;
+                    }
+                }
+            }
+        }
+    }
+    // Spawned actors might add proxies of their own on BeginPlay, so the grid can't be walked while spawning.
+    for (int32 const proxy_id : pending_promotions) promote(proxy_id);
+    pending_promotions.Reset();
+
+    // Actors hidden by gameplay, e.g. picked up and about to be destroyed, stay as they are.
+    for (int32 i = promoted_proxies.Num() - 1; i >= 0; --i)
+    {
+        int32 const proxy_id = promoted_proxies[i];
+        AActor* actor = proxies[proxy_id].Actor.Get();
+        if (actor != nullptr && proxies[proxy_id].LastNearbyUpdate != update_number && !actor->IsHidden()) demote(proxy_id);
+    }
+    // Only the meshes whose instances changed since the last pass get their render state rebuilt.
+    for (TConstSetBitIterator<> it{dirty_meshes}; it; ++it)
+    {
+        if (UInstancedStaticMeshComponent* mesh_component = mesh_components[it.GetIndex()]) mesh_component->MarkRenderStateDirty();
+    }
+    dirty_meshes.Init(false, mesh_components.Num());
+    SET_DWORD_STAT(STAT_LootProxies, getNumProxies());
+    SET_DWORD_STAT(STAT_LootProxiesPromoted, getNumPromoted());
+}
+
+void ULootProxySubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+    Super::Initialize(Collection);
+    cell_size = FMath::Max(CVarLootProxyDemoteRadius.GetValueOnGameThread(), 100.f);
+}
+
+void ULootProxySubsystem::Deinitialize()
+{
+    proxies.Reset();
+    proxy_locations.Reset();
+    free_proxies.Reset();
+    grid.Reset();
+    promoted_proxies.Reset();
+    promoted_actor_proxies.Reset();
+    proxy_classes.Reset();
+    mesh_components.Reset();
+    mesh_indices.Reset();
+    free_instances.Reset();
+    dirty_meshes.Empty();
+    instances_actor = nullptr;
+    Super::Deinitialize();
+}
+
+void ULootProxySubsystem::Tick(float DeltaTime)
+{
+    time_since_update += DeltaTime;
+    if (time_since_update < CVarLootProxyUpdateInterval.GetValueOnGameThread()) return;
+    time_since_update = 0.f;
+    updateProxies();
+}
+
+bool ULootProxySubsystem::IsTickable() const
+{
+    // Keeps ticking after the last proxy is removed until its instance has been hidden.
+    return (getNumProxies() > 0 || dirty_meshes.Contains(true)) && !HasAnyFlags(RF_ClassDefaultObject);
+}
+
+TStatId ULootProxySubsystem::GetStatId() const
+{
+    RETURN_QUICK_DECLARE_CYCLE_STAT(ULootProxySubsystem, STATGROUP_Tickables);
+}
+
+int32 ULootProxySubsystem::allocateProxy(UClass* actor_class, const FTransform& transform, UStaticMesh* mesh)
+{
+    int32 proxy_id;
+    if (free_proxies.Num() > 0) proxy_id = free_proxies.Pop(false);
+    else
+    {
+        proxy_id = proxies.AddDefaulted();
+        proxy_locations.AddUninitialized();
+    }
+    FLootProxy& proxy = proxies[proxy_id];
+    proxy = FLootProxy{};
+    proxy.Transform = transform;
+    proxy.ClassIndex = proxy_classes.AddUnique(actor_class);
+    // Nothing to draw on dedicated servers.
+    proxy.MeshIndex = mesh != nullptr && !IsRunningDedicatedServer() ? findOrAddMesh(mesh) : INDEX_NONE;
+    proxy.Cell = getCell(transform.GetLocation());
+    proxy_locations[proxy_id] = transform.GetLocation();
+    grid.FindOrAdd(proxy.Cell).Add(proxy_id);
+    return proxy_id;
+}
+
+void ULootProxySubsystem::releaseProxy(int32 proxy_id)
+{
+    FLootProxy& proxy = proxies[proxy_id];
+    if (AActor* actor = proxy.Actor.Get()) promoted_actor_proxies.Remove(actor);
+    promoted_proxies.RemoveSwap(proxy_id);
+    if (proxy.InstanceIndex != INDEX_NONE)
+    {
+        updateInstance(proxy_id, false);
+        free_instances[proxy.MeshIndex].Add(proxy.InstanceIndex);
+    }
+    if (TArray<int32>* cell_proxies = grid.Find(proxy.Cell))
+    {
+        cell_proxies->RemoveSwap(proxy_id);
+        if (cell_proxies->Num() == 0) grid.Remove(proxy.Cell);
+    }
+    proxy = FLootProxy{};
+    free_proxies.Add(proxy_id);
+}
+
+FIntPoint ULootProxySubsystem::getCell(const FVector& location) const
+{
+    return {FMath::FloorToInt(location.X / cell_size), FMath::FloorToInt(location.Y / cell_size)};
+}
+
+void ULootProxySubsystem::moveToCell(int32 proxy_id, const FIntPoint& cell)
+{
+    FLootProxy& proxy = proxies[proxy_id];
+    if (proxy.Cell == cell) return;
+    if (TArray<int32>* cell_proxies = grid.Find(proxy.Cell))
+    {
+        cell_proxies->RemoveSwap(proxy_id);
+        if (cell_proxies->Num() == 0) grid.Remove(proxy.Cell);
+    }
+    proxy.Cell = cell;
+    grid.FindOrAdd(cell).Add(proxy_id);
+}
+
+void ULootProxySubsystem::promote(int32 proxy_id)
+{
+    // Spawned actors might add proxies on BeginPlay and grow the proxies array, don't keep a reference to it across the spawn.
+    UClass* const actor_class = proxy_classes[proxies[proxy_id].ClassIndex];
+    FTransform const transform = proxies[proxy_id].Transform;
+    AActor* actor = GetWorld()->SpawnActorDeferred<AActor>(actor_class, transform, nullptr, nullptr, ESpawnActorCollisionHandlingMethod::AlwaysSpawn);
+    if (actor == nullptr) return;
+    if (ULootProxyComponent* proxy_component = actor->FindComponentByClass<ULootProxyComponent>()) proxy_component->bPromotedFromProxy = true;
+    actor->FinishSpawning(transform);
+    if (!IsValid(actor))
+    {
+        // Destroyed right away by its own BeginPlay, drop the proxy rather than spawning it again every pass.
+        releaseProxy(proxy_id);
+        return;
+    }
+
+    FLootProxy& proxy = proxies[proxy_id];
+    proxy.Actor = actor;
+    promoted_proxies.Add(proxy_id);
+    promoted_actor_proxies.Add(actor, proxy_id);
+    actor->OnDestroyed.AddDynamic(this, &ULootProxySubsystem::handlePromotedActorDestroyed);
+    updateInstance(proxy_id, false);
+}
+
+void ULootProxySubsystem::demote(int32 proxy_id)
+{
+    FLootProxy& proxy = proxies[proxy_id];
+    AActor* actor = proxy.Actor.Get();
+    check(actor != nullptr);
+    proxy.Transform = actor->GetActorTransform();
+    proxy.Actor.Reset();
+    promoted_proxies.RemoveSwap(proxy_id);
+    promoted_actor_proxies.Remove(actor);
+    actor->OnDestroyed.RemoveDynamic(this, &ULootProxySubsystem::handlePromotedActorDestroyed);
+    actor->Destroy();
+    updateInstance(proxy_id, true);
+}
+
+void ULootProxySubsystem::updateInstance(int32 proxy_id, bool bVisible)
+{
+    FLootProxy& proxy = proxies[proxy_id];
+    if (proxy.MeshIndex == INDEX_NONE) return;
+    UInstancedStaticMeshComponent* mesh_component = mesh_components[proxy.MeshIndex];
+    FTransform transform = proxy.Transform;
+    if (!bVisible) transform.SetScale3D(FVector::ZeroVector);
+    if (proxy.InstanceIndex != INDEX_NONE)
+    {
+        mesh_component->UpdateInstanceTransform(proxy.InstanceIndex, transform, true, false, true);
+        dirty_meshes[proxy.MeshIndex] = true;
+        return;
+    }
+    if (!bVisible) return;
+    dirty_meshes[proxy.MeshIndex] = true;
+    TArray<int32>& mesh_free_instances = free_instances[proxy.MeshIndex];
+    if (mesh_free_instances.Num() > 0)
+    {
+        proxy.InstanceIndex = mesh_free_instances.Pop(false);
+        mesh_component->UpdateInstanceTransform(proxy.InstanceIndex, transform, true, false, true);
+    }
+    else proxy.InstanceIndex = mesh_component->AddInstanceWorldSpace(transform);
+}
+
+int32 ULootProxySubsystem::findOrAddMesh(UStaticMesh* mesh)
+{
+    if (const int32* mesh_index = mesh_indices.Find(mesh)) return *mesh_index;
+    if (instances_actor == nullptr)
+    {
+        FActorSpawnParameters spawn_parameters;
+        spawn_parameters.ObjectFlags |= RF_Transient;
+        instances_actor = GetWorld()->SpawnActor<AActor>(spawn_parameters);
+    }
+    // Proxies are only drawn: no collision, no overlaps, no navigation.
+    UInstancedStaticMeshComponent* mesh_component = NewObject<UInstancedStaticMeshComponent>(instances_actor);
+    mesh_component->SetStaticMesh(mesh);
+    mesh_component->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+    mesh_component->SetGenerateOverlapEvents(false);
+    mesh_component->SetCanEverAffectNavigation(false);
+    mesh_component->RegisterComponent();
+    instances_actor->AddInstanceComponent(mesh_component);
+
+    int32 const mesh_index = mesh_components.Add(mesh_component);
+    free_instances.AddDefaulted();
+    dirty_meshes.Add(false);
+    mesh_indices.Add(mesh, mesh_index);
+    return mesh_index;
+}
+
+void ULootProxySubsystem::handlePromotedActorDestroyed(AActor* actor)
+{
+    // Destroyed by gameplay, usually picked up: the proxy goes with it.
+    int32 proxy_id;
+    if (promoted_actor_proxies.RemoveAndCopyValue(actor, proxy_id)) releaseProxy(proxy_id);
+}
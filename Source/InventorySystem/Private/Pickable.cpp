@@ -1,6 +1,6 @@
-// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
-
-
-#include "Pickable.h"
-
-// Add default functionality here for any IPickable functions that are not pure virtual.
+// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
+
+
+#include "Pickable.h"
+
+// Add default functionality here for any IPickable functions that are not pure virtual.
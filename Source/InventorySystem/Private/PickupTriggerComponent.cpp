@@ -1,89 +1,235 @@
-// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
-
-#include "PickupTriggerComponent.h"
-
-#include <limits>
-
-bool findPickableFromActor(AActor* actor, FFindPickableResult& out_pickable_result)
-{
-    check(IsValid(actor));
-    if (actor->Implements<UPickable>())
-    {
-        out_pickable_result = {actor, actor};
-        return true; // Direct implementation
-    }
-    auto pickables = actor->GetComponentsByInterface(UPickable::StaticClass()); // Pickable implemented in components maybe.
-    if (pickables.Num() == 0) return false;
-    out_pickable_result = {actor, pickables[0]};
-    return true;
-}
-
-UPickupTriggerComponent::UPickupTriggerComponent()
-{
-    PrimaryComponentTick.bCanEverTick = true;
-    PrimaryComponentTick.TickInterval = 0.2f;
-    SetGenerateOverlapEvents(true);
-}
-
-void UPickupTriggerComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
-{
-    const TScriptInterface<IPickable> new_closest = getClosestPickable();
-    if (new_closest != closest_pickable)
-    {
-        closest_pickable = new_closest;
-        closestPickableUpdated(closest_pickable);
-    }
-}
-
-void UPickupTriggerComponent::BeginPlay()
-{
-    Super::BeginPlay();
-    OnComponentBeginOverlap.AddDynamic(this, &UPickupTriggerComponent::handleTriggerBeginOverlap);
-    OnComponentEndOverlap.AddDynamic(this, &UPickupTriggerComponent::handleTriggerEndOverlap);
-}
-
-void UPickupTriggerComponent::setAutoUpdateClosestPickable(bool bEnabled)
-{
-    bAutoUpdateClosestPickable = bEnabled;
-    PrimaryComponentTick.SetTickFunctionEnable(bEnabled);
-}
-
-TScriptInterface<IPickable> UPickupTriggerComponent::getClosestPickable()
-{
-    if (available_pickables.Num() == 0) return nullptr;
-
-    FVector const location = this->GetComponentLocation();
-    float min_distance_sq = closest_pickable != nullptr ? FVector::DistSquared(closest_pickable->Execute_getPickableLocation(closest_pickable.GetObject()), location) : std::numeric_limits<float>::max();
-    TScriptInterface<IPickable> closest = nullptr;
-    for (auto&& pickable : available_pickables)
-    {
-        float const dist_sq = FVector::DistSquared(location, pickable->Execute_getPickableLocation(pickable.GetObject()));
-        if (dist_sq <= min_distance_sq)
-        {
-            min_distance_sq = dist_sq;
-            closest = pickable;
-        }
-    }
-    return closest;
-}
-
-void UPickupTriggerComponent::closestPickableUpdated_Implementation(const TScriptInterface<IPickable>& pickable)
-{
-    OnClosestPickableUpdated.Broadcast(pickable, this);
-}
-
-void UPickupTriggerComponent::handleTriggerBeginOverlap(UPrimitiveComponent* overlapped_component, AActor* other_actor, UPrimitiveComponent* other_comp, int32 other_body_index, bool b_from_sweep, const FHitResult& sweep_result)
-{
-    FFindPickableResult pickable_result;
-    if (!findPickableFromActor(other_actor, pickable_result)) return;
-    available_pickables.Add(pickable_result.Pickable);
-    OnPickableTriggerEnter.Broadcast(pickable_result.Pickable, this);
-}
-
-void UPickupTriggerComponent::handleTriggerEndOverlap(UPrimitiveComponent* overlapped_component, AActor* other_actor, UPrimitiveComponent* other_comp, int32 other_body_index)
-{
-    FFindPickableResult pickable_result;
-    if (!findPickableFromActor(other_actor, pickable_result)) return;
-    available_pickables.Remove(pickable_result.Pickable);
-    OnPickableTriggerExit.Broadcast(pickable_result.Pickable, this);
-}
+// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
+
+#include "PickupTriggerComponent.h"
+#include "InventoryBagComponent.h"
+#include "PickupTriggerSubsystem.h"
+#include "Resource.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "TimerManager.h"
+
+#include <limits>
+
+DECLARE_CYCLE_STAT(TEXT("Pickup All"), STAT_PickupTriggerPickupAll, STATGROUP_InventorySystem);
+
+static TAutoConsoleVariable<int32> CVarPickupBatchClosestUpdate(
+    TEXT("InventorySystem.Pickup.BatchClosestUpdate"),
+    1,
+    TEXT("When not 0, triggers starting play have their closest pickable updated by UPickupTriggerSubsystem in a single batched pass\n")
+    TEXT("instead of their own tick. Compare both through stat InventorySystem."));
+
+bool findPickableFromActor(AActor* actor, FFindPickableResult& out_pickable_result)
+{
+    check(IsValid(actor));
+    if (actor->Implements<UPickable>())
+    {
+        out_pickable_result = {actor, actor};
+        return true; // Direct implementation
+    }
+    auto pickables = actor->GetComponentsByInterface(UPickable::StaticClass()); // Pickable implemented in components maybe.
+    if (pickables.Num() == 0) return false;
+    out_pickable_result = {actor, pickables[0]};
+    return true;
+}
+
+UPickupTriggerComponent::UPickupTriggerComponent()
+{
+    PrimaryComponentTick.bCanEverTick = true;
+    PrimaryComponentTick.TickInterval = 0.2f;
+    SetGenerateOverlapEvents(true);
+}
+
+void UPickupTriggerComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+    updateClosestPickable(getClosestPickable());
+}
+
+void UPickupTriggerComponent::BeginPlay()
+{
+    Super::BeginPlay();
+    OnComponentBeginOverlap.AddDynamic(this, &UPickupTriggerComponent::handleTriggerBeginOverlap);
+    OnComponentEndOverlap.AddDynamic(this, &UPickupTriggerComponent::handleTriggerEndOverlap);
+    if (UPickupTriggerSubsystem* subsystem = GetWorld()->GetSubsystem<UPickupTriggerSubsystem>())
+    {
+        subsystem->registerTrigger(this);
+        bRegisteredWithSubsystem = true;
+        bUpdatedBySubsystem = CVarPickupBatchClosestUpdate.GetValueOnGameThread() != 0;
+    }
+    PrimaryComponentTick.SetTickFunctionEnable(bAutoUpdateClosestPickable && !bUpdatedBySubsystem);
+}
+
+void UPickupTriggerComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+    // The next tick release might never come, don't leave picked up actors hidden in the world.
+    releasePickedUpActors();
+    if (bRegisteredWithSubsystem)
+    {
+        if (UPickupTriggerSubsystem* subsystem = GetWorld()->GetSubsystem<UPickupTriggerSubsystem>()) subsystem->unregisterTrigger(this);
+        bRegisteredWithSubsystem = false;
+        bUpdatedBySubsystem = false;
+    }
+    Super::EndPlay(EndPlayReason);
+}
+
+void UPickupTriggerComponent::setAutoUpdateClosestPickable(bool bEnabled)
+{
+    bAutoUpdateClosestPickable = bEnabled;
+    PrimaryComponentTick.SetTickFunctionEnable(bEnabled && !bUpdatedBySubsystem);
+}
+
+void UPickupTriggerComponent::updateClosestPickable(const TScriptInterface<IPickable>& new_closest)
+{
+    if (new_closest == closest_pickable) return;
+    closest_pickable = new_closest;
+    closestPickableUpdated(closest_pickable);
+}
+
+TScriptInterface<IPickable> UPickupTriggerComponent::getClosestPickable()
+{
+    if (available_pickables.Num() == 0) return nullptr;
+
+    FVector const location = this->GetComponentLocation();
+    float min_distance_sq = closest_pickable != nullptr ? FVector::DistSquared(closest_pickable->Execute_getPickableLocation(closest_pickable.GetObject()), location) : std::numeric_limits<float>::max();
+    TScriptInterface<IPickable> closest = nullptr;
+    for (auto&& pickable : available_pickables)
+    {
+        float const dist_sq = FVector::DistSquared(location, pickable->Execute_getPickableLocation(pickable.GetObject()));
+        if (dist_sq <= min_distance_sq)
+        {
+            min_distance_sq = dist_sq;
+            closest = pickable;
+        }
+    }
+    return closest;
+}
+
+FPickupAllResult UPickupTriggerComponent::pickupAll(UInventoryBagComponent* bag, const FPickableFilterDelegate& filter, int32 max_count)
+{
+    return pickupAll(bag, [&filter](const TScriptInterface<IPickable>& pickable) { return !filter.IsBound() || filter.Execute(pickable); }, max_count);
+}
+
+FPickupAllResult UPickupTriggerComponent::pickupAll(UInventoryBagComponent* bag, TFunctionRef<bool(const TScriptInterface<IPickable>&)> filter, int32 max_count)
+{
+    SCOPE_CYCLE_COUNTER(STAT_PickupTriggerPickupAll);
+    INVENTORY_LLM_SCOPE();
+    FPickupAllResult result;
+    if (!IsValid(bag) || available_pickables.Num() == 0 || max_count == 0) return result;
+
+    // Closest first, so that limited pickups and full bags keep the nearest items.
+    struct FCandidate
+    {
+        TScriptInterface<IPickable> Pickable;
+        float DistanceSq;
+    };
+    FVector const location = GetComponentLocation();
+    TArray<FCandidate> candidates;
+    candidates.Reserve(available_pickables.Num());
+    for (auto&& pickable : available_pickables)
+    {
+        UObject* pickable_object = pickable.GetObject();
+        if (!IsValid(pickable_object) || !filter(pickable)) continue;
+        candidates.Add({pickable, FVector::DistSquared(location, IPickable::Execute_getPickableLocation(pickable_object))});
+    }
+    candidates.Sort([](const FCandidate& lhs, const FCandidate& rhs) { return lhs.DistanceSq < rhs.DistanceSq; });
+    if (max_count > 0 && candidates.Num() > max_count) candidates.SetNum(max_count, false);
+
+    // Data items are grouped per type for a single bulk add each, in closest first order within the type.
+    TMap<UItemData*, TArray<UObject*, TInlineAllocator<16>>> data_pickables;
+    TSet<UObject*> picked_up;
+    for (auto&& candidate : candidates)
+    {
+        UObject* pickable_object = candidate.Pickable.GetObject();
+        UItemData* item_data = IPickable::Execute_getItemData(pickable_object);
+        EPickupBehavior const behavior = IPickable::Execute_getPickupBehavior(pickable_object);
+        if (behavior == EPickupBehavior::UseItemComponent)
+        {
+            // Read before adding, the component is left standing for a single item once added.
+            int32 const quantity = FMath::Max(IPickable::Execute_getPickableQuantity(pickable_object), 1);
+            if (bag->addItemComponent(IPickable::Execute_getItemComponent(pickable_object)).bAdded)
+            {
+                picked_up.Add(pickable_object);
+                result.PickedUpQuantities.FindOrAdd(item_data) += quantity;
+            }
+            else ++result.NumRejected;
+            continue;
+        }
+        data_pickables.FindOrAdd(item_data).Add(pickable_object);
+    }
+    for (auto&& type_pickables : data_pickables)
+    {
+        int32 total_quantity = 0;
+        for (UObject* pickable_object : type_pickables.Value) total_quantity += FMath::Max(IPickable::Execute_getPickableQuantity(pickable_object), 1);
+        int32 remaining = bag->addItems(type_pickables.Key, total_quantity);
+        if (remaining > 0) result.PickedUpQuantities.FindOrAdd(type_pickables.Key) += remaining;
+        for (UObject* pickable_object : type_pickables.Value)
+        {
+            int32 const quantity = FMath::Max(IPickable::Execute_getPickableQuantity(pickable_object), 1);
+            if (remaining < quantity)
+            {
+                // Partially picked up resources keep what didn't fit.
+                UResourceComponent* resource = Cast<UResourceComponent>(IPickable::Execute_getItemComponent(pickable_object));
+                if (remaining > 0 && resource != nullptr) resource->Quantity -= remaining;
+                remaining = 0;
+                ++result.NumRejected;
+                continue;
+            }
+            remaining -= quantity;
+            picked_up.Add(pickable_object);
+            if (IPickable::Execute_getPickupBehavior(pickable_object) == EPickupBehavior::UseDataAndDestroyActor)
+            {
+                if (AActor* actor = IPickable::Execute_getPickableActor(pickable_object)) picked_up_actors.AddUnique(actor);
+            }
+        }
+    }
+    result.NumPickedUp = picked_up.Num();
+    if (result.NumPickedUp == 0) return result;
+
+    // Drop the picked up pickables before touching their actors, so that end overlap events find nothing left to remove.
+    available_pickables.RemoveAll([&picked_up](const TScriptInterface<IPickable>& pickable) { return picked_up.Contains(pickable.GetObject()); });
+    if (closest_pickable.GetObject() != nullptr && picked_up.Contains(closest_pickable.GetObject()))
+    {
+        updateClosestPickable(getClosestPickable());
+    }
+    for (AActor* actor : picked_up_actors)
+    {
+        if (!IsValid(actor)) continue;
+        actor->SetActorHiddenInGame(true);
+        actor->SetActorEnableCollision(false);
+    }
+    if (picked_up_actors.Num() > 0) GetWorld()->GetTimerManager().SetTimerForNextTick(this, &UPickupTriggerComponent::releasePickedUpActors);
+    UE_LOG(LogInventorySystem, Verbose, TEXT("Picked up [%d] items into bag [%s], [%d] didn't fit."), result.NumPickedUp, *bag->GetPathName(), result.NumRejected);
+    return result;
+}
+
+void UPickupTriggerComponent::releasePickedUpActors()
+{
+    TArray<AActor*> actors = MoveTemp(picked_up_actors);
+    picked_up_actors.Reset();
+    for (AActor* actor : actors)
+    {
+        if (!IsValid(actor)) continue;
+        if (bReleasePickedUpActors) OnPickedUpActorReleased.Broadcast(actor, this);
+        else actor->Destroy();
+    }
+}
+
+void UPickupTriggerComponent::closestPickableUpdated_Implementation(const TScriptInterface<IPickable>& pickable)
+{
+    OnClosestPickableUpdated.Broadcast(pickable, this);
+}
+
+void UPickupTriggerComponent::handleTriggerBeginOverlap(UPrimitiveComponent* overlapped_component, AActor* other_actor, UPrimitiveComponent* other_comp, int32 other_body_index, bool b_from_sweep, const FHitResult& sweep_result)
+{
+    FFindPickableResult pickable_result;
+    if (!findPickableFromActor(other_actor, pickable_result)) return;
+    available_pickables.Add(pickable_result.Pickable);
+    OnPickableTriggerEnter.Broadcast(pickable_result.Pickable, this);
+}
+
+void UPickupTriggerComponent::handleTriggerEndOverlap(UPrimitiveComponent* overlapped_component, AActor* other_actor, UPrimitiveComponent* other_comp, int32 other_body_index)
+{
+    FFindPickableResult pickable_result;
+    if (!findPickableFromActor(other_actor, pickable_result)) return;
+    available_pickables.Remove(pickable_result.Pickable);
+    OnPickableTriggerExit.Broadcast(pickable_result.Pickable, this);
+}
@@ -0,0 +1,146 @@
+// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
+
+#include "PickupTriggerSubsystem.h"
+#include "PickupTriggerComponent.h"
+#include "Async/ParallelFor.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+
+DECLARE_CYCLE_STAT(TEXT("Closest Pickables (Gather)"), STAT_PickupClosestGather, STATGROUP_InventorySystem);
+DECLARE_CYCLE_STAT(TEXT("Closest Pickables (Compute)"), STAT_PickupClosestCompute, STATGROUP_InventorySystem);
+DECLARE_CYCLE_STAT(TEXT("Closest Pickables (Notify)"), STAT_PickupClosestNotify, STATGROUP_InventorySystem);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Closest Pickables Candidates"), STAT_PickupClosestCandidates, STATGROUP_InventorySystem);
+
+static TAutoConsoleVariable<float> CVarPickupClosestUpdateInterval(
+    TEXT("InventorySystem.Pickup.ClosestUpdateInterval"),
+    0.f,
+    TEXT("Seconds between two batched closest pickable updates, 0 (default) to update every frame like unbatched triggers.\n")
+    TEXT("Raising it delays OnClosestPickableUpdated by up to that long."));
+
+static TAutoConsoleVariable<int32> CVarPickupClosestSingleThread(
+    TEXT("InventorySystem.Pickup.ClosestSingleThread"),
+    0,
+    TEXT("When not 0, batched closest pickable updates run on the game thread only."));
+
+/** Triggers handled by each parallel task. Small batches aren't worth a task of their own. */
+static constexpr int32 TriggersPerTask = 16;
+
+void UPickupTriggerSubsystem::registerTrigger(UPickupTriggerComponent* trigger)
+{
+    INVENTORY_LLM_SCOPE();
+    triggers.AddUnique(trigger);
+}
+
+void UPickupTriggerSubsystem::unregisterTrigger(UPickupTriggerComponent* trigger)
+{
+    triggers.RemoveSwap(trigger);
+}
+
+void UPickupTriggerSubsystem::updateClosestPickables()
+{
+    INVENTORY_LLM_SCOPE();
+    {
+        SCOPE_CYCLE_COUNTER(STAT_PickupClosestGather);
+        active_triggers.Reset();
+        trigger_locations.Reset();
+        candidate_offsets.Reset();
+        candidate_xs.Reset();
+        candidate_ys.Reset();
+        candidate_zs.Reset();
+        // Pickable locations come from blueprint native events, so they have to be read here on the game thread.
+        for (UPickupTriggerComponent* trigger : triggers)
+        {
+            if (!IsValid(trigger) || !trigger->bAutoUpdateClosestPickable || !trigger->isUpdatedBySubsystem()) continue;
+            const TArray<TScriptInterface<IPickable>>& pickables = trigger->getAvailablePickables();
+            if (pickables.Num() == 0 && trigger->getCurrentClosestPickable().GetObject() == nullptr) continue;
+            active_triggers.Add(trigger);
+            trigger_locations.Add(trigger->GetComponentLocation());
+            candidate_offsets.Add(candidate_xs.Num());
+            for (auto&& pickable : pickables)
+            {
+                UObject* pickable_object = pickable.GetObject();
+                // Invalid pickables keep their place, pushed out of reach, so candidate indices match the trigger list.
+                FVector const location = IsValid(pickable_object) ? IPickable::Execute_getPickableLocation(pickable_object) : FVector{MAX_flt};
+                candidate_xs.Add(location.X);
+                candidate_ys.Add(location.Y);
+                candidate_zs.Add(location.Z);
+            }
+        }
+        candidate_offsets.Add(candidate_xs.Num());
+        SET_DWORD_STAT(STAT_PickupClosestCandidates, candidate_xs.Num());
+    }
+
+    int32 const num_triggers = active_triggers.Num();
+    if (num_triggers == 0) return;
+    {
+        SCOPE_CYCLE_COUNTER(STAT_PickupClosestCompute);
+        closest_candidates.SetNumUninitialized(num_triggers);
+        int32 const num_tasks = (num_triggers + TriggersPerTask - 1) / TriggersPerTask;
+        // Each task only writes the results of its own triggers, no synchronization needed.
+        ParallelFor(num_tasks, [this, num_triggers](int32 const task_index)
+        {
+            int32 const last_trigger = FMath::Min((task_index + 1) * TriggersPerTask, num_triggers);
+            for (int32 trigger_index = task_index * TriggersPerTask; trigger_index < last_trigger; ++trigger_index)
+            {
+                FVector const location = trigger_locations[trigger_index];
+                int32 const begin = candidate_offsets[trigger_index];
+                int32 const count = candidate_offsets[trigger_index + 1] - begin;
+                const float* RESTRICT xs = candidate_xs.GetData() + begin;
+                const float* RESTRICT ys = candidate_ys.GetData() + begin;
+                const float* RESTRICT zs = candidate_zs.GetData() + begin;
+                float min_distance_sq = MAX_flt;
+                int32 closest = INDEX_NONE;
+                for (int32 i = 0; i < count; ++i)
+                {
+                    float const dx = xs[i] - location.X;
+                    float const dy = ys[i] - location.Y;
+                    float const dz = zs[i] - location.Z;
+                    float const distance_sq = dx * dx + dy * dy + dz * dz;
+                    if (distance_sq < min_distance_sq)
+                    {
+                        min_distance_sq = distance_sq;
+                        closest = i;
+                    }
+                }
+                closest_candidates[trigger_index] = closest;
+            }
+        }, CVarPickupClosestSingleThread.GetValueOnGameThread() != 0 || num_tasks == 1);
+    }
+
+    SCOPE_CYCLE_COUNTER(STAT_PickupClosestNotify);
+    for (int32 trigger_index = 0; trigger_index < num_triggers; ++trigger_index)
+    {
+        UPickupTriggerComponent* trigger = active_triggers[trigger_index];
+        if (!IsValid(trigger)) continue;
+        // Events fired by earlier triggers could have changed this trigger's pickables, skip it until the next update then.
+        const TArray<TScriptInterface<IPickable>>& pickables = trigger->getAvailablePickables();
+        if (pickables.Num() != candidate_offsets[trigger_index + 1] - candidate_offsets[trigger_index]) continue;
+        int32 const closest = closest_candidates[trigger_index];
+        trigger->updateClosestPickable(closest != INDEX_NONE ? pickables[closest] : TScriptInterface<IPickable>{});
+    }
+}
+
+void UPickupTriggerSubsystem::Deinitialize()
+{
+    triggers.Reset();
+    active_triggers.Reset();
+    Super::Deinitialize();
+}
+
+void UPickupTriggerSubsystem::Tick(float DeltaTime)
+{
+    time_since_update += DeltaTime;
+    if (time_since_update < CVarPickupClosestUpdateInterval.GetValueOnGameThread()) return;
+    time_since_update = 0.f;
+    updateClosestPickables();
+}
+
+bool UPickupTriggerSubsystem::IsTickable() const
+{
+    return triggers.Num() > 0 && !HasAnyFlags(RF_ClassDefaultObject);
+}
+
+TStatId UPickupTriggerSubsystem::GetStatId() const
+{
+    RETURN_QUICK_DECLARE_CYCLE_STAT(UPickupTriggerSubsystem, STATGROUP_Tickables);
+}
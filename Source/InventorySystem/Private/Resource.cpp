@@ -1,16 +1,46 @@
-﻿// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
-
-#pragma once
-
-#include "Resource.h"
-
-UResourceComponent::UResourceComponent()
-{
-    ItemData = CreateDefaultSubobject<UResourceData>(TEXT("ResourceData"));
-    ItemData->Category = EItemCategory::Resource;
-}
-
-EPickupBehavior UResourceComponent::getPickupBehavior_Implementation()
-{
-    return EPickupBehavior::UseDataAndDestroyActor;
-}
+﻿// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
+
+#pragma once
+
+#include "Resource.h"
+#include "LootProxySubsystem.h"
+#include "ResourceMergeSubsystem.h"
+#include "Engine/World.h"
+
+UResourceData::UResourceData()
+{
+    Category = EItemCategory::Resource;
+}
+
+void UResourceComponent::BeginPlay()
+{
+    Super::BeginPlay();
+    // Loot proxies only keep the actor class and transform, a merged quantity would be lost on demotion.
+    AActor* owner = GetOwner();
+    if (!bAllowMerge || !owner->HasAuthority() || owner->FindComponentByClass<ULootProxyComponent>() != nullptr) return;
+    if (UResourceMergeSubsystem* subsystem = GetWorld()->GetSubsystem<UResourceMergeSubsystem>())
+    {
+        subsystem->registerResource(this);
+        bRegisteredForMerge = true;
+    }
+}
+
+void UResourceComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+    if (bRegisteredForMerge)
+    {
+        if (UResourceMergeSubsystem* subsystem = GetWorld()->GetSubsystem<UResourceMergeSubsystem>()) subsystem->unregisterResource(this);
+        bRegisteredForMerge = false;
+    }
+    Super::EndPlay(EndPlayReason);
+}
+
+EPickupBehavior UResourceComponent::getPickupBehavior_Implementation()
+{
+    return EPickupBehavior::UseDataAndDestroyActor;
+}
+
+int32 UResourceComponent::getPickableQuantity_Implementation()
+{
+    return Quantity;
+}
@@ -0,0 +1,210 @@
+// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
+
+#include "ResourceMergeSubsystem.h"
+#include "Resource.h"
+#include "Engine/World.h"
+#include "GameFramework/Actor.h"
+#include "HAL/IConsoleManager.h"
+
+DECLARE_CYCLE_STAT(TEXT("Resource Merge"), STAT_ResourceMerge, STATGROUP_InventorySystem);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Resource Merges"), STAT_ResourceMerges, STATGROUP_InventorySystem);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Resource Merge Pickups"), STAT_ResourceMergePickups, STATGROUP_InventorySystem);
+
+static TAutoConsoleVariable<float> CVarResourceMergeRadius(
+    TEXT("InventorySystem.ResourceMerge.Radius"),
+    200.f,
+    TEXT("Pickups of the same resource closer than this get merged. Also the grid cell size, read when the world starts."));
+
+static TAutoConsoleVariable<int32> CVarResourceMergeMaxQuantity(
+    TEXT("InventorySystem.ResourceMerge.MaxQuantity"),
+    100,
+    TEXT("Merged pickups never carry more than this quantity. 0 for no limit."));
+
+static TAutoConsoleVariable<float> CVarResourceMergeSweepInterval(
+    TEXT("InventorySystem.ResourceMerge.SweepInterval"),
+    2.f,
+    TEXT("Seconds between the end of a sweep over all pickups and the start of the next one."));
+
+static TAutoConsoleVariable<int32> CVarResourceMergeMaxChecksPerFrame(
+    TEXT("InventorySystem.ResourceMerge.MaxChecksPerFrame"),
+    64,
+    TEXT("Pickups whose neighbours are looked up in a single frame. Negative for no limit."));
+
+static TAutoConsoleVariable<int32> CVarResourceMergeMaxMergesPerFrame(
+    TEXT("InventorySystem.ResourceMerge.MaxMergesPerFrame"),
+    16,
+    TEXT("Pickups merged away (and destroyed) in a single frame. Negative for no limit."));
+
+namespace
+{
+    /** Spawns a pile of resource pickups, merges them all and logs how many actors are left and how long it took. */
+    void benchmarkResourceMerge(const TArray<FString>& args, UWorld* world)
+    {
+        UClass* actor_class = args.Num() > 0 ? LoadClass<AActor>(nullptr, *args[0]) : nullptr;
+        UResourceMergeSubsystem* subsystem = world != nullptr ? world->GetSubsystem<UResourceMergeSubsystem>() : nullptr;
+        if (subsystem == nullptr || actor_class == nullptr)
+        {
+            UE_LOG(LogInventorySystem, Warning, TEXT("Usage: InventorySystem.ResourceMerge.Benchmark <resource actor class path> [count] [spread]"));
+            return;
+        }
+        int32 const count = args.Num() > 1 ? FMath::Max(FCString::Atoi(*args[1]), 1) : 500;
+        float const spread = args.Num() > 2 ? FCString::Atof(*args[2]) : 1000.f;
+
+        FActorSpawnParameters spawn_parameters;
+        spawn_parameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+        TArray<TWeakObjectPtr<AActor>> actors;
+        actors.Reserve(count);
+        for (int32 i = 0; i < count; ++i)
+        {
+            FVector const location{FMath::FRandRange(-spread, spread), FMath::FRandRange(-spread, spread), 0.f};
+            actors.Add(world->SpawnActor<AActor>(actor_class, FTransform{location}, spawn_parameters));
+        }
+        int32 const resources_before = subsystem->getNumResources();
+
+        double const start_time = FPlatformTime::Seconds();
+        int32 const merged = subsystem->mergeAll();
+        double const merge_time = FPlatformTime::Seconds() - start_time;
+
+        int32 actors_left = 0;
+        for (auto&& actor : actors) if (actor.IsValid() && !actor->IsPendingKillPending()) ++actors_left;
+        UE_LOG(LogInventorySystem, Display, TEXT("Merged [%d] of [%d] spawned [%s] over [%.0f] units in [%.3f] ms: [%d] actors left, [%d] -> [%d] merge candidates in the world."),
+               merged, count, *actor_class->GetName(), spread * 2.f, merge_time * 1000.0, actors_left, resources_before, subsystem->getNumResources());
+        UE_LOG(LogInventorySystem, Display, TEXT("Use stat InventorySystem and stat unit to compare server frame time with time-sliced merging."));
+    }
+}
+
+static FAutoConsoleCommandWithWorldAndArgs GInventoryBenchmarkResourceMergeCommand(
+    TEXT("InventorySystem.ResourceMerge.Benchmark"),
+    TEXT("Spawns count (default 500) resource pickups of the given class within spread (default 1000) of the origin, merges them all and logs the actors left.\n")
+    TEXT("The class needs bAllowMerge set on its resource component."),
+    FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&benchmarkResourceMerge));
+
+void UResourceMergeSubsystem::registerResource(UResourceComponent* resource)
+{
+    INVENTORY_LLM_SCOPE();
+    resources.AddUnique(resource);
+}
+
+void UResourceMergeSubsystem::unregisterResource(UResourceComponent* resource)
+{
+    resources.RemoveSwap(resource);
+}
+
+int32 UResourceMergeSubsystem::mergeAll()
+{
+    int32 total_merged = 0;
+    int32 merged;
+    do
+    {
+        beginSweep();
+        merged = continueSweep(-1, -1);
+        total_merged += merged;
+    }
+    while (merged > 0);
+    return total_merged;
+}
+
+void UResourceMergeSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+    Super::Initialize(Collection);
+    cell_size = FMath::Max(CVarResourceMergeRadius.GetValueOnGameThread(), 10.f);
+}
+
+void UResourceMergeSubsystem::Deinitialize()
+{
+    resources.Reset();
+    sweep_resources.Reset();
+    grid.Reset();
+    Super::Deinitialize();
+}
+
+void UResourceMergeSubsystem::Tick(float DeltaTime)
+{
+    if (sweep_cursor >= sweep_resources.Num())
+    {
+        time_since_sweep += DeltaTime;
+        if (time_since_sweep < CVarResourceMergeSweepInterval.GetValueOnGameThread()) return;
+        time_since_sweep = 0.f;
+        beginSweep();
+    }
+    continueSweep(CVarResourceMergeMaxChecksPerFrame.GetValueOnGameThread(), CVarResourceMergeMaxMergesPerFrame.GetValueOnGameThread());
+}
+
+bool UResourceMergeSubsystem::IsTickable() const
+{
+    return resources.Num() > 1 && !HasAnyFlags(RF_ClassDefaultObject);
+}
+
+TStatId UResourceMergeSubsystem::GetStatId() const
+{
+    RETURN_QUICK_DECLARE_CYCLE_STAT(UResourceMergeSubsystem, STATGROUP_Tickables);
+}
+
+void UResourceMergeSubsystem::beginSweep()
+{
+    INVENTORY_LLM_SCOPE();
+    sweep_resources.Reset();
+    sweep_cursor = 0;
+    for (auto&& cell : grid) cell.Value.Reset(); // Keep the cell allocations, the same cells are usually filled again.
+    for (UResourceComponent* resource : resources)
+    {
+        if (!canMerge(resource)) continue;
+        sweep_resources.Add(resource);
+        grid.FindOrAdd(getCell(resource->GetOwner()->GetActorLocation())).Add(resource);
+    }
+    SET_DWORD_STAT(STAT_ResourceMergePickups, sweep_resources.Num());
+}
+
+int32 UResourceMergeSubsystem::continueSweep(int32 max_checks, int32 max_merges)
+{
+    SCOPE_CYCLE_COUNTER(STAT_ResourceMerge);
+    float const radius_sq = FMath::Square(cell_size);
+    int32 const max_quantity = CVarResourceMergeMaxQuantity.GetValueOnGameThread() > 0 ? CVarResourceMergeMaxQuantity.GetValueOnGameThread() : MAX_int32;
+    int32 merged = 0;
+    for (; sweep_cursor < sweep_resources.Num() && max_checks != 0 && merged != max_merges; ++sweep_cursor, --max_checks)
+    {
+        UResourceComponent* target = sweep_resources[sweep_cursor].Get();
+        if (!canMerge(target) || target->Quantity >= max_quantity) continue;
+        FVector const location = target->GetOwner()->GetActorLocation();
+        FIntVector const cell = getCell(location);
+        // Neighbours are found in the cells around the one the target was in when the sweep began.
+        for (int32 x = cell.X - 1; x <= cell.X + 1 && merged != max_merges; ++x)
+        {
+            for (int32 y = cell.Y - 1; y <= cell.Y + 1 && merged != max_merges; ++y)
+            {
+                for (int32 z = cell.Z - 1; z <= cell.Z + 1 && merged != max_merges; ++z)
+                {
+                    const TArray<TWeakObjectPtr<UResourceComponent>>* cell_resources = grid.Find({x, y, z});
+                    if (cell_resources == nullptr) continue;
+                    for (auto&& weak_source : *cell_resources)
+                    {
+                        UResourceComponent* source = weak_source.Get();
+                        if (source == target || !canMerge(source) || source->ItemData != target->ItemData) continue;
+                        if (target->Quantity + source->Quantity > max_quantity) continue;
+                        if (FVector::DistSquared(location, source->GetOwner()->GetActorLocation()) > radius_sq) continue;
+
+                        target->Quantity += source->Quantity;
+                        source->Quantity = 0;
+                        source->GetOwner()->Destroy();
+                        if (++merged == max_merges) break;
+                    }
+                }
+            }
+        }
+    }
+    INC_DWORD_STAT_BY(STAT_ResourceMerges, merged);
+    return merged;
+}
+
+bool UResourceMergeSubsystem::canMerge(const UResourceComponent* resource) const
+{
+    if (!IsValid(resource) || resource->ItemData == nullptr || resource->Quantity <= 0) return false;
+    // Hidden pickups are usually picked up already and about to be destroyed.
+    AActor* owner = resource->GetOwner();
+    return IsValid(owner) && !owner->IsPendingKillPending() && !owner->IsHidden();
+}
+
+FIntVector UResourceMergeSubsystem::getCell(const FVector& location) const
+{
+    return {FMath::FloorToInt(location.X / cell_size), FMath::FloorToInt(location.Y / cell_size), FMath::FloorToInt(location.Z / cell_size)};
+}
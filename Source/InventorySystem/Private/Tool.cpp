@@ -1,38 +1,43 @@
-﻿// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
-
-#pragma once
-
-#include "Tool.h"
-
-UToolComponent::UToolComponent()
-{
-    ItemData = CreateDefaultSubobject<UToolData>(TEXT("ToolData"));
-    ItemData->Category = EItemCategory::Tool;
-    initToolDurability();
-}
-
-EPickupBehavior UToolComponent::getPickupBehavior_Implementation()
-{
-    return EPickupBehavior::UseItemComponent;
-}
-
-void UToolComponent::initToolDurability()
-{
-    UToolData* tool_data = Cast<UToolData>(ItemData);
-    if (!IsValid(tool_data)) return;
-    Durability = tool_data->MaxDurability;
-}
-
-void UToolComponent::PostLoad()
-{
-    Super::PostLoad();
-    initToolDurability();
-}
-
-#if UE_EDITOR
-void UToolComponent::PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent)
-{
-    Super::PostEditChangeProperty(PropertyChangedEvent);
-    initToolDurability();
-}
-#endif
+﻿// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
+
+#pragma once
+
+#include "Tool.h"
+
+UToolData::UToolData()
+{
+    Category = EItemCategory::Tool;
+}
+
+EPickupBehavior UToolComponent::getPickupBehavior_Implementation()
+{
+    return EPickupBehavior::UseItemComponent;
+}
+
+void UToolComponent::initToolDurability()
+{
+    UToolData* tool_data = Cast<UToolData>(ItemData);
+    if (!IsValid(tool_data)) return;
+    Durability = tool_data->MaxDurability;
+}
+
+void UToolComponent::PostLoad()
+{
+    Super::PostLoad();
+    initToolDurability();
+}
+
+void UToolComponent::OnRegister()
+{
+    // Runs after the item data got duplicated for bUseInstanceData.
+    Super::OnRegister();
+    if (Durability < 0) initToolDurability();
+}
+
+#if UE_EDITOR
+void UToolComponent::PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent)
+{
+    Super::PostEditChangeProperty(PropertyChangedEvent);
+    initToolDurability();
+}
+#endif
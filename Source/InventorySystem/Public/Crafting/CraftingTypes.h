@@ -1,52 +1,80 @@
-﻿// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
-
-#pragma once
-
-#include "Item.h"
-#include "Engine/DataAsset.h"
-
-#include "CraftingTypes.generated.h"
-
-/**
- * Required item type and quantity.
- */
-USTRUCT(BlueprintType)
-struct INVENTORYSYSTEM_API FRecipeRequirement
-{
-    GENERATED_BODY()
-
-    UPROPERTY(EditAnywhere, BlueprintReadOnly, Category="Crafting")
-    UItemData* Item;
-    UPROPERTY(EditAnywhere, BlueprintReadOnly, Category="Crafting")
-    int32 Quantity = 1;
-};
-
-/**
- * Recipe for a single craftable item.
- */
-UCLASS(BlueprintType, Blueprintable)
-class INVENTORYSYSTEM_API UCraftingRecipe : public UPrimaryDataAsset
-{
-    GENERATED_BODY()
-public:
-
-    UPROPERTY(EditAnywhere, BlueprintReadOnly, Category="Crafting")
-    UItemData* CraftedItem;
-    UPROPERTY(EditAnywhere, BlueprintReadOnly, Category="Crafting")
-    int32 QuantityPerCraft = 1;
-    UPROPERTY(EditAnywhere, BlueprintReadOnly, Category="Crafting")
-    TArray<FRecipeRequirement> Requirements;
-};
-
-/**
- * Contains a list of all available craftable recipes.
- */
-UCLASS(BlueprintType, Blueprintable)
-class INVENTORYSYSTEM_API UCraftablesCollection : public UPrimaryDataAsset
-{
-    GENERATED_BODY()
-public:
-
-    UPROPERTY(EditAnywhere, BlueprintReadOnly, Category="Crafting")
-    TArray<UCraftingRecipe*> Craftables;
-};
+﻿// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
+
+#pragma once
+
+#include "Item.h"
+#include "Engine/DataAsset.h"
+#include "Engine/StreamableManager.h"
+
+#include "CraftingTypes.generated.h"
+
+/**
+ * Required item type and quantity.
+ */
+USTRUCT(BlueprintType)
+struct INVENTORYSYSTEM_API FRecipeRequirement
+{
+    GENERATED_BODY()
+
+    UPROPERTY(EditAnywhere, BlueprintReadOnly, Category="Crafting", meta=(AssetBundles="Crafting"))
+    TSoftObjectPtr<UItemData> Item;
+    UPROPERTY(EditAnywhere, BlueprintReadOnly, Category="Crafting")
+    int32 Quantity = 1;
+};
+
+/**
+ * Requirement with its item resolved, for evaluating recipes away from the game thread.
+ * Item is null when the item data is not loaded, in which case no bag can hold it.
+ */
+struct FResolvedRecipeRequirement
+{
+    const UItemData* Item;
+    int32 Quantity;
+};
+
+/**
+ * Recipe for a single craftable item.
+ */
+UCLASS(BlueprintType, Blueprintable)
+class INVENTORYSYSTEM_API UCraftingRecipe : public UPrimaryDataAsset
+{
+    GENERATED_BODY()
+public:
+
+    UPROPERTY(EditAnywhere, BlueprintReadOnly, Category="Crafting", meta=(AssetBundles="UI,Crafting"))
+    TSoftObjectPtr<UItemData> CraftedItem;
+    UPROPERTY(EditAnywhere, BlueprintReadOnly, Category="Crafting")
+    int32 QuantityPerCraft = 1;
+    /** Required items are never loaded by crafting queries: items that aren't loaded can't be in a bag either. */
+    UPROPERTY(EditAnywhere, BlueprintReadOnly, Category="Crafting")
+    TArray<FRecipeRequirement> Requirements;
+
+    /** Resolves the items of the requirements with a positive quantity. Game thread only. */
+    void resolveRequirements(TArray<FResolvedRecipeRequirement>& out_requirements) const;
+};
+
+/**
+ * Contains a list of all available craftable recipes.
+ */
+UCLASS(BlueprintType, Blueprintable)
+class INVENTORYSYSTEM_API UCraftablesCollection : public UPrimaryDataAsset
+{
+    GENERATED_BODY()
+public:
+
+    /** Recipes not loaded yet are treated as not craftable by crafting queries, see streamInCraftables. */
+    UPROPERTY(EditAnywhere, BlueprintReadOnly, Category="Crafting", meta=(AssetBundles="Crafting"))
+    TArray<TSoftObjectPtr<UCraftingRecipe>> Craftables;
+
+    /**
+     * Streams in every recipe of the collection, without their items. Same as loading the Crafting bundle through the asset manager.
+     * Loaded recipes are kept loaded for as long as the collection is.
+     */
+    TSharedPtr<FStreamableHandle> streamInCraftables(FStreamableDelegate on_loaded = FStreamableDelegate());
+    /** Loaded recipe at the given position, nullptr if not loaded yet. */
+    UCraftingRecipe* getLoadedCraftable(int32 index) const { return Craftables.IsValidIndex(index) ? Craftables[index].Get() : nullptr; }
+
+private:
+
+    TSharedPtr<FStreamableHandle> craftables_stream_handle;
+};
@@ -1,57 +1,103 @@
-// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
-
-#pragma once
-
-#include "CoreMinimal.h"
-#include "CraftingTypes.h"
-#include "InventoryBagComponent.h"
-#include "Kismet/BlueprintFunctionLibrary.h"
-#include "CraftingUtils.generated.h"
-
-/**
- * Holds a set of recipes.
- * Needed due to BP functions not directly accepting nested containers.
- */
-USTRUCT(BlueprintType)
-struct FRecipesSet
-{
-    GENERATED_BODY()
-
-    UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category="Crafting")
-    TSet<UCraftingRecipe*> Recipes;
-};
-
-/**
- * Utility functions to work with the crafting system.
- */
-UCLASS()
-class INVENTORYSYSTEM_API UCraftingUtils : public UBlueprintFunctionLibrary
-{
-    GENERATED_BODY()
-
-    /**
-     * Generates a map that lets you find out what recipes are available for each item type based on the given craftables collection.
-     * You'd usually generate this once or any time you update the craftables collection.
-     * @param craftables_collection List of all available recipes for which to generate the mappings.
-     * @return Mappings for each item type to recipes that require it.
-     */
-    UFUNCTION(BlueprintCallable, Category="Crafting")
-    static TMap<UItemData*, FRecipesSet> generateRecipesForItemMappings(UCraftablesCollection* craftables_collection);
-
-    /**
-     * Examines what craftables you can currently create based on the items you have available.
-     * @param available_items Mapping in the form of item type - available quantity.
-     * @param craftables_collection Collection of all possible recipes.
-     * @return Array of currently craftable recipes.
-     */
-    UFUNCTION(BlueprintCallable, Category="Crafting")
-    static TArray<UCraftingRecipe*> getCraftableRecipesForAvailableItems(TMap<UItemData*, int32> available_items, UCraftablesCollection* craftables_collection);
-
-    /**
-     * Helper function to generate the item-quantity map needed for getCraftableRecipesForAvailableItems.
-     * @param in_resources Resources you want to generate the map for.
-     * @return Map of item type -> quantity.
-     */
-    UFUNCTION(BlueprintCallable, Category="Crafting")
-    static TMap<UItemData*, int32> generateAvailableItemsFromResources(const FBagResources& in_resources);
-};
+// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "CraftingTypes.h"
+#include "InventoryBagComponent.h"
+#include "Kismet/BlueprintFunctionLibrary.h"
+#include "CraftingUtils.generated.h"
+
+/**
+ * Holds a set of recipes.
+ * Needed due to BP functions not directly accepting nested containers.
+ */
+USTRUCT(BlueprintType)
+struct FRecipesSet
+{
+    GENERATED_BODY()
+
+    UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category="Crafting")
+    TSet<UCraftingRecipe*> Recipes;
+};
+
+/**
+ * Crafting state of a single bag for every recipe of a craftables collection, indexed by recipe position in the collection.
+ */
+USTRUCT(BlueprintType)
+struct INVENTORYSYSTEM_API FBagCraftability
+{
+    GENERATED_BODY()
+
+    bool isCraftable(int32 const recipe_index) const
+    {
+        return CraftableBits.IsValidIndex(recipe_index / 32) && (CraftableBits[recipe_index / 32] & (1u << (recipe_index % 32))) != 0;
+    }
+
+    /** One bit per recipe, set when the recipe can be crafted at least once. */
+    UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category="Crafting")
+    TArray<int32> CraftableBits;
+    /** How many times each recipe can be crafted. Only filled when requested. */
+    UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category="Crafting")
+    TArray<int32> MaxCrafts;
+};
+
+/**
+ * Utility functions to work with the crafting system.
+ */
+UCLASS()
+class INVENTORYSYSTEM_API UCraftingUtils : public UBlueprintFunctionLibrary
+{
+    GENERATED_BODY()
+
+public:
+
+    /**
+     * Generates a map that lets you find out what recipes are available for each item type based on the given craftables collection.
+     * You'd usually generate this once or any time you update the craftables collection.
+     * @param craftables_collection List of all available recipes for which to generate the mappings.
+     * Recipes must be loaded (see UCraftablesCollection::streamInCraftables), their items don't need to.
+     * @return Mappings for each item type to recipes that require it.
+     */
+    UFUNCTION(BlueprintCallable, Category="Crafting")
+    static TMap<TSoftObjectPtr<UItemData>, FRecipesSet> generateRecipesForItemMappings(UCraftablesCollection* craftables_collection);
+
+    /**
+     * Examines what craftables you can currently create based on the items you have available.
+     * @param available_items Mapping in the form of item type - available quantity.
+     * @param craftables_collection Collection of all possible recipes. Recipes not loaded yet are skipped.
+     * @return Array of currently craftable recipes.
+     */
+    UFUNCTION(BlueprintCallable, Category="Crafting")
+    static TArray<UCraftingRecipe*> getCraftableRecipesForAvailableItems(TMap<UItemData*, int32> available_items, UCraftablesCollection* craftables_collection);
+
+    /**
+     * Helper function to generate the item-quantity map needed for getCraftableRecipesForAvailableItems.
+     * @param in_resources Resources you want to generate the map for.
+     * @return Map of item type -> quantity.
+     */
+    UFUNCTION(BlueprintCallable, Category="Crafting")
+    static TMap<UItemData*, int32> generateAvailableItemsFromResources(const FBagResources& in_resources);
+
+    /**
+     * Evaluates which recipes of a collection each bag can craft, spreading bags across worker threads.
+     * Bags are snapshotted on the calling thread first, so it must be the game thread. Recipes not loaded yet are not craftable.
+     * World store bags can't be snapshotted and are evaluated afterwards on the calling thread, see bUseWorldStore.
+     * @param bags Bags to evaluate. Invalid bags get an empty result.
+     * @param craftables_collection Collection of all possible recipes.
+     * @param bComputeMaxCrafts Whether to also fill in how many times each recipe can be crafted.
+     * @return One result per bag, in the same order.
+     */
+    UFUNCTION(BlueprintCallable, Category="Crafting")
+    static TArray<FBagCraftability> evaluateCraftablesForBags(const TArray<UInventoryBagComponent*>& bags, UCraftablesCollection* craftables_collection, bool bComputeMaxCrafts = false);
+
+    /** Same as evaluateCraftablesForBags, for bags already snapshotted. Recipes are resolved on the calling thread, so it must be the game thread. */
+    static TArray<FBagCraftability> evaluateCraftablesForSnapshots(TArrayView<const FInventoryBagSnapshot> snapshots, UCraftablesCollection* craftables_collection, bool bComputeMaxCrafts = false);
+
+    /** Quantity of an item type held by each bag, in the same order. */
+    UFUNCTION(BlueprintCallable, Category="Crafting")
+    static TArray<int32> getItemQuantityForBags(const TArray<UInventoryBagComponent*>& bags, UItemData* item_data);
+
+    UFUNCTION(BlueprintPure, Category="Crafting")
+    static bool isRecipeCraftable(const FBagCraftability& craftability, int32 recipe_index) { return craftability.isCraftable(recipe_index); }
+};
@@ -1,324 +1,644 @@
-﻿// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
-
-#pragma once
-
-#include "Item.h"
-#include "Tool.h"
-#include "Resource.h"
-#include "Components/ActorComponent.h"
-#include "UObject/ObjectMacros.h"
-#include "InventoryBagComponent.generated.h"
-
-struct FStreamableHandle;
-class UInventoryBagComponent;
-
-/**
- * Defines limits (max quantity etc.) for a single item type in the bag.
- */
-UCLASS(Blueprintable, BlueprintType)
-class UItemBagLimit : public UPrimaryDataAsset
-{
-    GENERATED_BODY()
-public:
-
-    /** Maximum size of a stack of the same type of item for a single slot. */
-    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Inventory")
-    int32 MaxStackSize = 20;
-    /** Total maximum number of items of the same type that can be held in the bag, counted among all stacks. */
-    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Inventory")
-    int32 MaxQuantity = 20;
-};
-
-/**
- * Defines properties of an inventory bag such as
- * maximum number of slots and limits for each item type.
- */
-UCLASS(BlueprintType, Blueprintable)
-class UBagProperties : public UPrimaryDataAsset
-{
-    GENERATED_BODY()
-
-public:
-
-    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Inventory")
-    TMap<TSoftObjectPtr<UItemData>, TSoftObjectPtr<UItemBagLimit>> Limits;
-    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Inventory")
-    int32 MaxResourceSlots = 20;
-    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Inventory")
-    int32 MaxToolsSlots = 10;
-    UPROPERTY(BlueprintReadOnly, EditAnywhere, Category="Inventory")
-    int32 MaxItemId = 1000;
-};
-
-/**
- * Holds information about a tool in the bag.
- */
-USTRUCT(BlueprintType)
-struct FBagToolInfo
-{
-    GENERATED_BODY()
-
-    friend bool operator==(const FBagToolInfo& lhs, const FBagToolInfo& rhs)
-    {
-        return lhs.ToolId == rhs.ToolId;
-    }
-
-    friend bool operator!=(const FBagToolInfo& lhs, const FBagToolInfo& rhs)
-    {
-        return !(lhs == rhs);
-    }
-
-    UPROPERTY(BlueprintReadWrite, EditAnywhere)
-    int32 ToolId;
-    UPROPERTY(BlueprintReadWrite, EditAnywhere)
-    int32 Durability;
-};
-
-/**
- * Holds IDs of all the resources held in this slot.
- */
-USTRUCT(BlueprintType)
-struct FBagResourceSlot
-{
-    GENERATED_BODY()
-
-    friend bool operator==(const FBagResourceSlot& lhs, const FBagResourceSlot& rhs)
-    {
-        return lhs.ResourceIds == rhs.ResourceIds;
-    }
-
-    friend bool operator!=(const FBagResourceSlot& lhs, const FBagResourceSlot& rhs)
-    {
-        return !(lhs == rhs);
-    }
-
-    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Inventory")
-    int32 Id;
-    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Inventory")
-    TArray<int32> ResourceIds;
-};
-
-/**
- * Holds tool info (such as ID and current durability) for all tools held in this slot.
- */
-USTRUCT(BlueprintType)
-struct FBagToolSlot
-{
-    GENERATED_BODY()
-
-    friend bool operator==(const FBagToolSlot& lhs, const FBagToolSlot& rhs)
-    {
-        return lhs.ToolsInfo == rhs.ToolsInfo;
-    }
-
-    friend bool operator!=(const FBagToolSlot& lhs, const FBagToolSlot& rhs)
-    {
-        return !(lhs == rhs);
-    }
-
-    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Inventory")
-    int32 Id;
-    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Inventory")
-    TArray<FBagToolInfo> ToolsInfo;
-};
-
-/**
- * Holds actual slots data used by a single resource type (UResourceData).
- * All resources of a specific data type will be placed inside slots.
- * Each slot holds a maximum of the used item data type's max stack and there's a cap for the
- * total number of items held between all slots.
- */
-USTRUCT(BlueprintType)
-struct FBagResourcesData
-{
-    GENERATED_BODY()
-
-    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Inventory")
-    TArray<FBagResourceSlot> Slots;
-    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Inventory")
-    int32 ResourceQuantity = 0;
-};
-
-/**
-* Holds actual slots data used by a single tool type (UToolData).
-* All tools of a specific data type will be placed inside slots.
-* Each slot holds a maximum of the used item data type's max stack and there's a cap for the
-* total number of items held between all slots.
-*/
-USTRUCT(BlueprintType)
-struct FBagToolsData
-{
-    GENERATED_BODY()
-
-    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Inventory")
-    int32 ToolQuantity = 0;
-    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Inventory")
-    TArray<FBagToolSlot> Slots;
-};
-
-/**
- * Holds all the data for resource items.
- */
-USTRUCT(BlueprintType)
-struct FBagResources
-{
-    GENERATED_BODY()
-
-    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Inventory")
-    TMap<UResourceData*, FBagResourcesData> Data;
-    /** Total number of slots currently in use for all resources. */
-    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Inventory")
-    int32 UsedSlots;
-};
-
-/**
- * Holds all the data for tool items.
- */
-USTRUCT(BlueprintType)
-struct FBagTools
-{
-    GENERATED_BODY()
-
-    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Inventory")
-    TMap<UToolData*, FBagToolsData> Data;
-    /** Total number of slots currently in use for all tools. */
-    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Inventory")
-    int32 UsedSlots;
-};
-
-USTRUCT(BlueprintType)
-struct FInventoryBagAddItemResult
-{
-    GENERATED_BODY()
-
-    UPROPERTY(BlueprintReadWrite)
-    bool bAdded;
-    UPROPERTY(BlueprintReadWrite)
-    int32 AssignedId;
-};
-
-USTRUCT(BlueprintType)
-struct FInventoryBagRemoveItemResult
-{
-    GENERATED_BODY()
-
-    UPROPERTY(BlueprintReadWrite)
-    bool bRemoved;
-    UPROPERTY(BlueprintReadWrite)
-    int32 RemovedId = -1;
-    UPROPERTY(BlueprintReadWrite)
-    AActor* SpawnedActor = nullptr;
-};
-
-DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FInventoryBagUpdatedDelegate, UInventoryBagComponent*, bag);
-
-DECLARE_DYNAMIC_MULTICAST_DELEGATE_FourParams(FInventoryBagResourceSlotUpdatedDelegate, UInventoryBagComponent*, bag, UResourceData*, slot_type, int32, slot_id, FBagResourceSlot, slot);
-
-DECLARE_DYNAMIC_MULTICAST_DELEGATE_FourParams(FInventoryBagToolSlotUpdatedDelegate, UInventoryBagComponent*, bag, UToolData*, slot_type, int32, slot_id, FBagToolSlot, slot);
-
-/**
- * Provides inventory functionality for storing resources and tools.
- */
-UCLASS(BlueprintType, Blueprintable)
-class UInventoryBagComponent : public UActorComponent
-{
-    GENERATED_BODY()
-
-public:
-
-    // EVENTS
-    UPROPERTY(BlueprintCallable, BlueprintAssignable, Category="Inventory")
-    FInventoryBagUpdatedDelegate OnInventoryBagUpdated;
-    UPROPERTY(BlueprintCallable, BlueprintAssignable, Category="Inventory")
-    FInventoryBagResourceSlotUpdatedDelegate OnResourceSlotAdded;
-    UPROPERTY(BlueprintCallable, BlueprintAssignable, Category="Inventory")
-    FInventoryBagResourceSlotUpdatedDelegate OnResourceSlotRemoved;
-    UPROPERTY(BlueprintCallable, BlueprintAssignable, Category="Inventory")
-    FInventoryBagResourceSlotUpdatedDelegate OnResourceSlotUpdated;
-    UPROPERTY(BlueprintCallable, BlueprintAssignable, Category="Inventory")
-    FInventoryBagToolSlotUpdatedDelegate OnToolSlotAdded;
-    UPROPERTY(BlueprintCallable, BlueprintAssignable, Category="Inventory")
-    FInventoryBagToolSlotUpdatedDelegate OnToolSlotRemoved;
-    UPROPERTY(BlueprintCallable, BlueprintAssignable, Category="Inventory")
-    FInventoryBagToolSlotUpdatedDelegate OnToolSlotUpdated;
-
-    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Inventory")
-    UBagProperties* BagProperties;
-    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Inventory")
-    FBagResources Resources;
-    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Inventory")
-    FBagTools Tools;
-
-private:
-
-    TArray<int32> item_ids_pool;
-    TArray<int32> slot_ids_pool;
-    /** Items registered via component can later retrieve their ID through their reference. */
-    UPROPERTY()
-    TMap<UItemComponent*, int32> item_comp_to_id;
-    TSharedPtr<FStreamableHandle> limits_stream_handle;
-
-public:
-
-    UInventoryBagComponent();
-
-    // UItemComponent versions
-    UFUNCTION(BlueprintCallable, Category="Inventory")
-    FInventoryBagAddItemResult addItemComponent(UItemComponent* item);
-    UFUNCTION(BlueprintCallable, Category="Inventory")
-    FInventoryBagRemoveItemResult removeItemComponent(UItemComponent* item, bool bAllowActorSpawn = true);
-    UFUNCTION(BlueprintCallable, Category="Inventory")
-    UItemComponent* getItemComponentFromId(int32 id);
-
-    // UItemData versions
-    UFUNCTION(BlueprintCallable, Category="Inventory")
-    FInventoryBagAddItemResult addItem(UItemData* item_data);
-    UFUNCTION(BlueprintCallable, Category="Inventory")
-    FInventoryBagRemoveItemResult removeItem(UItemData* item_data, bool bAllowActorSpawn = true);
-    UFUNCTION(BlueprintPure, Category="Inventory")
-    int32 getItemQuantity(UItemData* item_data);
-
-    UFUNCTION(BlueprintCallable, Category="Inventory")
-    bool updateToolDurability(UToolComponent* tool, int32 const durability);
-
-    void BeginPlay() override;
-
-private:
-
-    bool tryAddItem(UItemData* item_data, int32 const id, UItemComponent* item_component = nullptr);
-    /**
-     * Tries to remove one item of item_data type.
-     * @param item_data Type of item to remove.
-     * @param remove_id When >= 0 it will try and remove the item with the specified ID (fails if no such ID can be found).
-     *                  Passing -1 will remove one item from the last slot of that item's type and set remove_id to the removed item's ID.
-     * @return Whether the item could be removed.
-     */
-    bool tryRemoveItem(UItemData* item_data, int32& remove_id);
-    bool tryAddResource(UResourceData* resource_data, int32 const id);
-    /**
-    * Tries to remove one resource of resource_data type.
-    * @param resource_data Type of resource to remove.
-    * @param remove_id When >= 0 it will try and remove the resource with the specified ID (fails if no such ID can be found).
-    *                  Passing -1 will remove one resource from the last slot of that resource's type and set remove_id to the removed resource's ID.
-    * @return Whether the item could be removed.
-    */
-    bool tryRemoveResource(UResourceData* resource_data, int32& remove_id);
-    bool tryAddTool(UToolData* tool_data, int32 const id, int32 const durability);
-    /**
-    * Tries to remove one tool of tool_data type.
-    * @param tool_data Type of tool to remove.
-    * @param remove_id When >= 0 it will try and remove the tool with the specified ID (fails if no such ID can be found).
-    *                  Passing -1 will remove one tool from the last slot of that tool's type and set remove_id to the removed tool's ID.
-    * @return Whether the tool could be removed.
-    */
-    bool tryRemoveTool(UToolData* tool_data, int32& remove_id);
-    bool isValidItemData(UItemData* item_data) const;
-    bool hasValidItemLimits(UItemData* item_data) const;
-    bool hasAvailableIds() const;
-
-    /**
-     * Starts the process of streaming in all item data and bag limits that will be used with this bag.
-     */
-    void streamInLimits();
-    void handleLimitsStreamedInCompleted() const;
-};
+﻿// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
+
+#pragma once
+
+#include "Item.h"
+#include "Tool.h"
+#include "Resource.h"
+#include "InventoryBagTypes.h"
+#include "InventoryBagSnapshot.h"
+#include "InventoryBagJournal.h"
+#include "InventoryWorldStore.h"
+#include "Components/ActorComponent.h"
+#include "HAL/CriticalSection.h"
+#include "Misc/Optional.h"
+#include "UObject/ObjectMacros.h"
+#include "InventoryBagComponent.generated.h"
+
+struct FStreamableHandle;
+class UInventoryBagComponent;
+
+/**
+ * Limits (max quantity etc.) for an item type in the bag, stored inline in the bag properties.
+ */
+USTRUCT(BlueprintType)
+struct FItemBagLimitValues
+{
+    GENERATED_BODY()
+
+    /** Maximum size of a stack of the same type of item for a single slot. */
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Inventory")
+    int32 MaxStackSize = 20;
+    /** Total maximum number of items of the same type that can be held in the bag, counted among all stacks. */
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Inventory")
+    int32 MaxQuantity = 20;
+};
+
+/**
+ * Defines limits (max quantity etc.) for a single item type in the bag.
+ * Kept for existing bag properties, prefer the inline limits of UBagProperties which don't need to be streamed in.
+ */
+UCLASS(Blueprintable, BlueprintType)
+class UItemBagLimit : public UPrimaryDataAsset
+{
+    GENERATED_BODY()
+public:
+
+    /** Maximum size of a stack of the same type of item for a single slot. */
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Inventory")
+    int32 MaxStackSize = 20;
+    /** Total maximum number of items of the same type that can be held in the bag, counted among all stacks. */
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Inventory")
+    int32 MaxQuantity = 20;
+};
+
+/**
+ * Limits found for an item type in bag properties.
+ */
+struct FResolvedItemBagLimit
+{
+    /** Type the limits were resolved for, type IDs get reused once their type is destroyed. */
+    TWeakObjectPtr<const UItemData> ItemData;
+    TOptional<FItemBagLimitValues> Limit;
+};
+
+/**
+ * Defines properties of an inventory bag such as
+ * maximum number of slots and limits for each item type.
+ * Limits for a type are looked up in order among ItemLimits, Limits, the limits of its category and DefaultLimit.
+ * Items without limits can't be added to the bag.
+ */
+UCLASS(BlueprintType, Blueprintable)
+class UBagProperties : public UPrimaryDataAsset
+{
+    GENERATED_BODY()
+
+public:
+
+    /** Per item limits. */
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Inventory")
+    TMap<TSoftObjectPtr<UItemData>, FItemBagLimitValues> ItemLimits;
+    /** Per item limit assets, streamed in on BeginPlay. Prefer ItemLimits, which don't need any asset to be loaded. */
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Inventory")
+    TMap<TSoftObjectPtr<UItemData>, TSoftObjectPtr<UItemBagLimit>> Limits;
+    /** Limits for resources without per item limits. */
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Inventory")
+    TMap<EResourceCategory, FItemBagLimitValues> ResourceCategoryLimits;
+    /** Limits for tools without per item limits. */
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Inventory")
+    TMap<EToolCategory, FItemBagLimitValues> ToolCategoryLimits;
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Inventory", meta=(InlineEditConditionToggle))
+    bool bUseDefaultLimit = false;
+    /** Limits for every item type not covered by the other limits. */
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Inventory", meta=(EditCondition="bUseDefaultLimit"))
+    FItemBagLimitValues DefaultLimit;
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Inventory")
+    int32 MaxResourceSlots = 20;
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Inventory")
+    int32 MaxToolsSlots = 10;
+    UPROPERTY(BlueprintReadOnly, EditAnywhere, Category="Inventory")
+    int32 MaxItemId = 1000;
+
+    /**
+     * Limits for an item type, unset if none apply. Resolved once per type and cached, see resetResolvedLimits.
+     * Loads the limit asset synchronously if the type uses one that hasn't been streamed in yet.
+     */
+    TOptional<FItemBagLimitValues> resolveLimit(const UItemData* item_data) const;
+    /** Clears resolved limits. Needed after changing limits at runtime. */
+    UFUNCTION(BlueprintCallable, Category="Inventory")
+    void resetResolvedLimits() { resolved_limits.Reset(); }
+
+#if WITH_EDITOR
+    void PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent) override;
+#endif
+
+private:
+
+    /** Indexed by item type ID, see FItemTypeRegistry. */
+    mutable TArray<FResolvedItemBagLimit> resolved_limits;
+};
+
+USTRUCT(BlueprintType)
+struct FInventoryBagAddItemResult
+{
+    GENERATED_BODY()
+
+    UPROPERTY(BlueprintReadWrite)
+    bool bAdded;
+    UPROPERTY(BlueprintReadWrite)
+    int32 AssignedId;
+};
+
+USTRUCT(BlueprintType)
+struct FInventoryBagRemoveItemResult
+{
+    GENERATED_BODY()
+
+    UPROPERTY(BlueprintReadWrite)
+    bool bRemoved;
+    UPROPERTY(BlueprintReadWrite)
+    int32 RemovedId = -1;
+    UPROPERTY(BlueprintReadWrite)
+    AActor* SpawnedActor = nullptr;
+};
+
+/**
+ * Memory used by a bag component in bytes, split by what it's used for. See UInventoryBagComponent::getMemoryUsage.
+ */
+struct FInventoryBagMemoryUsage
+{
+    SIZE_T getTotal() const { return Object + IdPools + Slots + Types + ItemComponents + StreamHandles + Snapshots + Other; }
+
+    FInventoryBagMemoryUsage& operator+=(const FInventoryBagMemoryUsage& other)
+    {
+        Object += other.Object;
+        IdPools += other.IdPools;
+        Slots += other.Slots;
+        Types += other.Types;
+        ItemComponents += other.ItemComponents;
+        StreamHandles += other.StreamHandles;
+        Snapshots += other.Snapshots;
+        Other += other.Other;
+        return *this;
+    }
+
+    /** The component object itself, with every member stored inline. */
+    SIZE_T Object = 0;
+    /** Free item and slot IDs. */
+    SIZE_T IdPools = 0;
+    /** Slot arrays with the stacks they hold, tool instances and the slot index used by slot queries. */
+    SIZE_T Slots = 0;
+    /** Per type entries and their lookup, per category totals and the types tracked for snapshots. */
+    SIZE_T Types = 0;
+    /** Item components registered with the bag. */
+    SIZE_T ItemComponents = 0;
+    /** Streaming request keeping the bag limits loaded. */
+    SIZE_T StreamHandles = 0;
+    /** Last snapshot and published read view, counting per type data shared between them once. */
+    SIZE_T Snapshots = 0;
+    /** Change journal and arrays kept around for reuse. */
+    SIZE_T Other = 0;
+};
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FInventoryBagUpdatedDelegate, UInventoryBagComponent*, bag);
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_FourParams(FInventoryBagResourceSlotUpdatedDelegate, UInventoryBagComponent*, bag, UResourceData*, slot_type, int32, slot_id, FBagResourceSlot, slot);
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FInventoryBagChangeSetDelegate, UInventoryBagComponent*, bag, const FInventoryBagChangeSet&, changes);
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_FourParams(FInventoryBagToolSlotUpdatedDelegate, UInventoryBagComponent*, bag, UToolData*, slot_type, int32, slot_id, FBagToolSlot, slot);
+
+DECLARE_MULTICAST_DELEGATE_TwoParams(FInventoryBagSlotChangedNativeDelegate, UInventoryBagComponent* /*bag*/, const FInventoryBagSlotChange& /*change*/);
+
+/**
+ * Provides inventory functionality for storing resources and tools.
+ */
+UCLASS(BlueprintType, Blueprintable)
+class UInventoryBagComponent : public UActorComponent
+{
+    GENERATED_BODY()
+
+public:
+
+    // EVENTS
+    UPROPERTY(BlueprintCallable, BlueprintAssignable, Category="Inventory")
+    FInventoryBagUpdatedDelegate OnInventoryBagUpdated;
+    // Slot events copy the whole slot for every listener and are only meant for blueprints, native code should use OnSlotChangedNative.
+    UPROPERTY(BlueprintCallable, BlueprintAssignable, Category="Inventory")
+    FInventoryBagResourceSlotUpdatedDelegate OnResourceSlotAdded;
+    UPROPERTY(BlueprintCallable, BlueprintAssignable, Category="Inventory")
+    FInventoryBagResourceSlotUpdatedDelegate OnResourceSlotRemoved;
+    UPROPERTY(BlueprintCallable, BlueprintAssignable, Category="Inventory")
+    FInventoryBagResourceSlotUpdatedDelegate OnResourceSlotUpdated;
+    UPROPERTY(BlueprintCallable, BlueprintAssignable, Category="Inventory")
+    FInventoryBagToolSlotUpdatedDelegate OnToolSlotAdded;
+    UPROPERTY(BlueprintCallable, BlueprintAssignable, Category="Inventory")
+    FInventoryBagToolSlotUpdatedDelegate OnToolSlotRemoved;
+    UPROPERTY(BlueprintCallable, BlueprintAssignable, Category="Inventory")
+    FInventoryBagToolSlotUpdatedDelegate OnToolSlotUpdated;
+    /** Fired once for batched operations (e.g. transactions) instead of the per slot events. */
+    UPROPERTY(BlueprintCallable, BlueprintAssignable, Category="Inventory")
+    FInventoryBagChangeSetDelegate OnInventoryBagChangeSet;
+    /**
+     * Fired for every slot change, including the ones batched into a change set (after the batch is done).
+     * Only carries the slot ID and counts, read the slot contents by reference through findResourceSlot/findToolSlot if needed.
+     */
+    FInventoryBagSlotChangedNativeDelegate OnSlotChangedNative;
+
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Inventory")
+    UBagProperties* BagProperties;
+    /**
+     * When removing an item leaves a hole in a stack that isn't the last one of its type,
+     * refill it with an item from the last stack. Keeps each type with at most one partially filled slot.
+     * The removal and the moves are then reported together through OnInventoryBagChangeSet, instead of the per slot events.
+     */
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Inventory")
+    bool bCompactStacksOnRemove = true;
+    /**
+     * Publish a read view of the bag after every batch of changes, for other threads to query through getReadView.
+     * Each publish takes a snapshot, so it only copies the types changed since the previous one.
+     */
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Inventory")
+    bool bPublishReadView = false;
+    /**
+     * How many quantity and slot changes the bag keeps for getChangesSince. Consumers falling further behind have to resync.
+     * Each change takes 24 bytes, only allocated once the bag gets modified. Read on BeginPlay.
+     */
+    UPROPERTY(BlueprintReadOnly, EditAnywhere, Category="Inventory", meta=(ClampMin=0))
+    int32 JournalCapacity = 64;
+    /**
+     * Keep the bag contents in the world inventory store instead of the component, which then only forwards to it.
+     * Only the quantity API is available in this mode: addItem, addItems, removeItem, getItemQuantity and category quantities.
+     * Slot level features (item components, slot events, transactions, transfers, snapshots) need the component storage.
+     * Read on BeginPlay.
+     */
+    UPROPERTY(BlueprintReadOnly, EditAnywhere, Category="Inventory")
+    bool bUseWorldStore = false;
+    /**
+     * Reading this from blueprints copies every slot, prefer the paged getResourceSlots for large bags.
+     * Read only, entries are keyed by type IDs that only the bag API keeps consistent.
+     */
+    UPROPERTY(BlueprintReadOnly, VisibleAnywhere, Category="Inventory")
+    FBagResources Resources;
+    /**
+     * Reading this from blueprints copies every slot, prefer the paged getToolSlots for large bags.
+     * Tool durability in the slots is a copy of the one held by the bag, see refreshToolSlots.
+     * Read only, entries are keyed by type IDs that only the bag API keeps consistent.
+     */
+    UPROPERTY(BlueprintReadOnly, VisibleAnywhere, Category="Inventory")
+    FBagTools Tools;
+
+private:
+
+    TArray<int32> item_ids_pool;
+    TArray<int32> slot_ids_pool;
+    /** Items registered via component can later retrieve their ID through their reference. */
+    UPROPERTY()
+    TMap<UItemComponent*, int32> item_comp_to_id;
+    TSharedPtr<FStreamableHandle> limits_stream_handle;
+    /** Types modified since the last snapshot was taken. Only these get rebuilt by the next snapshot. */
+    TSet<UItemData*> snapshot_dirty_types;
+    /** Slots modified since the last snapshot was taken. Only these get copied by the next snapshot, other slots of dirty types are shared. */
+    TSet<int32> snapshot_dirty_slots;
+    /**
+     * Last taken snapshot. Its per type data is shared with the next snapshot for all types not marked dirty, and its slots for all slots not marked dirty.
+     * Kept for the bag's lifetime once a snapshot has been taken, so a bag that was snapshotted (read view, batch crafting) holds
+     * a second copy of its slots. Counted in the Snapshots category of getMemoryUsage.
+     */
+    TSharedPtr<const FInventoryBagSnapshotData, ESPMode::ThreadSafe> last_snapshot;
+    /** Last version handed out to a snapshot. Never reused, even when restoring an older snapshot. */
+    int32 snapshot_version = 0;
+    /**
+     * Running totals per category, indexed by the category value and kept up to date on every quantity change.
+     * Categories are read from the item data when items are added/removed, so they shouldn't change at runtime.
+     */
+    TArray<int32> resource_category_quantities;
+    TArray<int32> tool_category_quantities;
+    /** Running totals and held types per tag, parent tags included. Kept up to date on every quantity change like category totals. */
+    TMap<FGameplayTag, FBagTagQuantity> tag_quantities;
+    /** When set, slot and quantity changes are collected here instead of being broadcast one by one. */
+    FInventoryBagChangeSet* pending_changes = nullptr;
+    /**
+     * Change sets batching single item removals with their compaction, one per nesting level (listeners removing while one is broadcast).
+     * Reused with their allocation, so steady removals don't hit the heap.
+     */
+    TIndirectArray<FInventoryBagChangeSet> remove_batches;
+    int32 remove_batch_depth = 0;
+    /** Every tool in the bag. Owns tool durability, slots only hold a copy of it. */
+    FBagToolInstances tool_instances;
+    /** Tool types whose slots hold outdated durability copies. */
+    TSet<UToolData*> stale_tool_slot_types;
+    /** Guards the read view pointer only. Writers hold it just long enough to swap the pointer. */
+    mutable FRWLock read_view_lock;
+    TSharedPtr<const FInventoryBagSnapshotData, ESPMode::ThreadSafe> read_view;
+    FInventoryBagHandle store_handle;
+    /**
+     * Arrays left over by removed slots and types, reused with their allocation by the next slot or type added.
+     * Keeps steady pickup/drop traffic from hitting the heap, see the Storage Allocations stat.
+     * The stat also counts tag quantities, the journal buffer and batched change sets growing.
+     */
+    TArray<TArray<int32>> recycled_resource_stacks;
+    TArray<TArray<FBagToolInfo>> recycled_tool_stacks;
+    TArray<TArray<FBagResourceSlot>> recycled_resource_slot_lists;
+    TArray<TArray<FBagToolSlot>> recycled_tool_slot_lists;
+    /**
+     * Location of every slot in use, indexed by slot ID. Updated as slots are added or removed,
+     * only rebuilt on the next query after the whole bag changed (restoreSnapshot).
+     */
+    mutable TArray<FBagSlotLocation> slot_locations;
+    /** IDs of the slots in use sorted ascending. This is the stable order used by paged slot queries. */
+    mutable TArray<int32> resource_slot_order;
+    mutable TArray<int32> tool_slot_order;
+    mutable bool slot_index_dirty = true;
+    FInventoryBagJournal journal;
+
+public:
+
+    UInventoryBagComponent();
+
+    // UItemComponent versions
+    /**
+     * Adds an item through its component, which gets the returned ID.
+     * Components standing for more than one item (see IPickable::getPickableQuantity) are only added when all of them fit,
+     * the extra items are added as plain data and the component is left standing for a single one.
+     */
+    UFUNCTION(BlueprintCallable, Category="Inventory")
+    FInventoryBagAddItemResult addItemComponent(UItemComponent* item);
+    UFUNCTION(BlueprintCallable, Category="Inventory")
+    FInventoryBagRemoveItemResult removeItemComponent(UItemComponent* item, bool bAllowActorSpawn = true);
+    UFUNCTION(BlueprintCallable, Category="Inventory")
+    UItemComponent* getItemComponentFromId(int32 id);
+    /** Item components registered with the bag, with the ID of their item. May hold components destroyed since. */
+    const TMap<UItemComponent*, int32>& getItemComponents() const { return item_comp_to_id; }
+
+    // UItemData versions
+    UFUNCTION(BlueprintCallable, Category="Inventory")
+    FInventoryBagAddItemResult addItem(UItemData* item_data);
+    /**
+     * Adds up to count items of a type, stopping at the first one that doesn't fit.
+     * Fires a single change set event instead of one event per item.
+     * @return Number of items actually added.
+     */
+    UFUNCTION(BlueprintCallable, Category="Inventory")
+    int32 addItems(UItemData* item_data, int32 count);
+    UFUNCTION(BlueprintCallable, Category="Inventory")
+    FInventoryBagRemoveItemResult removeItem(UItemData* item_data, bool bAllowActorSpawn = true);
+    /**
+     * Adds what a pickable stands for, following its pickup behavior: its item component, or getPickableQuantity items of its data.
+     * Resources that only partially fit keep what's left in their Quantity. Destroying the pickable actor is up to the caller.
+     * @param bAddedAll Set when everything fit and the pickable can go.
+     * @return Number of items actually added.
+     */
+    UFUNCTION(BlueprintCallable, Category="Inventory")
+    int32 addPickable(TScriptInterface<IPickable> pickable, bool& bAddedAll);
+    UFUNCTION(BlueprintPure, Category="Inventory")
+    int32 getItemQuantity(UItemData* item_data);
+    /** Total quantity of resources of the given category held in the bag. O(1). */
+    UFUNCTION(BlueprintPure, Category="Inventory")
+    int32 getCategoryQuantity(EResourceCategory category) const;
+    /** Total number of tools of the given category held in the bag. O(1). */
+    UFUNCTION(BlueprintPure, Category="Inventory")
+    int32 getToolCategoryQuantity(EToolCategory category) const;
+    UFUNCTION(BlueprintPure, Category="Inventory")
+    bool hasAnyToolOfCategory(EToolCategory category) const { return getToolCategoryQuantity(category) > 0; }
+    /** Total quantity of items tagged with the given tag or one of its children (see UItemData::Tags). O(1). */
+    UFUNCTION(BlueprintPure, Category="Inventory")
+    int32 getQuantityWithTag(FGameplayTag tag) const;
+    /** Held item types tagged with the given tag or one of its children. Only copies the matching types. */
+    UFUNCTION(BlueprintPure, Category="Inventory")
+    TArray<UItemData*> getTypesWithTag(FGameplayTag tag) const;
+    /** Same as getTypesWithTag without copying, invalidated by the next change to the bag. Always empty for world store bags. */
+    TArrayView<UItemData* const> findTypesWithTag(FGameplayTag tag) const;
+
+    /** Slot with the given ID among the slots of a type, nullptr if not found. The pointer is invalidated by the next change to the bag. */
+    const FBagResourceSlot* findResourceSlot(const UResourceData* resource_data, int32 slot_id) const;
+    /** See findResourceSlot. Tool durabilities in the slot are only refreshed when events are fired, see refreshToolSlots. */
+    const FBagToolSlot* findToolSlot(const UToolData* tool_data, int32 slot_id) const;
+    /** Resource slot with the given ID whatever its type, nullptr if not found. O(1). See findResourceSlot. */
+    const FBagResourceSlot* findResourceSlotById(int32 slot_id, UResourceData** out_resource_data = nullptr) const;
+    /** Tool slot with the given ID whatever its type, nullptr if not found. O(1). See findToolSlot. */
+    const FBagToolSlot* findToolSlotById(int32 slot_id, UToolData** out_tool_data = nullptr) const;
+    /**
+     * Visits up to count resource slots starting at offset, by reference and in stable order:
+     * slots are sorted by ID, so a slot keeps its position while other slots come and go. Costs O(count).
+     * The bag must not be modified from the visitor.
+     */
+    void visitResourceSlots(int32 offset, int32 count, TFunctionRef<void(UResourceData* resource_data, const FBagResourceSlot& slot)> visitor) const;
+    /** See visitResourceSlots. */
+    void visitToolSlots(int32 offset, int32 count, TFunctionRef<void(UToolData* tool_data, const FBagToolSlot& slot)> visitor) const;
+
+    UFUNCTION(BlueprintPure, Category="Inventory")
+    int32 getNumResourceSlots() const { return Resources.UsedSlots; }
+    UFUNCTION(BlueprintPure, Category="Inventory")
+    int32 getNumToolSlots() const { return Tools.UsedSlots; }
+    /** Copies a page of resource slots, see visitResourceSlots. Meant for virtualized UI showing a few slots of a large bag. */
+    UFUNCTION(BlueprintPure, Category="Inventory")
+    TArray<FBagResourceSlotEntry> getResourceSlots(int32 offset, int32 count) const;
+    /** Copies a page of tool slots, with up to date tool durability. See visitToolSlots. */
+    UFUNCTION(BlueprintPure, Category="Inventory")
+    TArray<FBagToolSlotEntry> getToolSlots(int32 offset, int32 count) const;
+    /** @return False if no resource slot has the given ID. */
+    UFUNCTION(BlueprintPure, Category="Inventory")
+    bool getResourceSlotById(int32 slot_id, FBagResourceSlotEntry& out_entry) const;
+    /** @return False if no tool slot has the given ID. */
+    UFUNCTION(BlueprintPure, Category="Inventory")
+    bool getToolSlotById(int32 slot_id, FBagToolSlotEntry& out_entry) const;
+
+    UFUNCTION(BlueprintCallable, Category="Inventory")
+    bool updateToolDurability(UToolComponent* tool, int32 const durability);
+    /** Current durability of the tool with the given ID, INDEX_NONE if there's no such tool in the bag. O(1). */
+    UFUNCTION(BlueprintPure, Category="Inventory")
+    int32 getToolDurability(int32 tool_id) const;
+    /**
+     * Subtracts wear from every tool of a category in a single pass over the bag, clamping durability at 0.
+     * Per slot events are not fired. OnInventoryBagUpdated is fired once if anything is bound to it.
+     * @return Number of tools worn.
+     */
+    UFUNCTION(BlueprintCallable, Category="Inventory")
+    int32 applyToolWear(EToolCategory category, int32 wear);
+    /** Same as applyToolWear, for every tool in the bag regardless of its category. */
+    UFUNCTION(BlueprintCallable, Category="Inventory")
+    int32 applyToolWearToAll(int32 wear);
+    /**
+     * Restores every tool in the bag to the max durability of its type. See applyToolWear.
+     * @return Number of tools repaired.
+     */
+    UFUNCTION(BlueprintCallable, Category="Inventory")
+    int32 repairAllTools();
+    /**
+     * Copies the durability held by the bag into the Tools slots.
+     * Only needed when reading Tools directly after bulk durability updates made with nothing bound to OnInventoryBagUpdated.
+     */
+    UFUNCTION(BlueprintCallable, Category="Inventory")
+    void refreshToolSlots();
+
+    // Transactions
+    /**
+     * Applies a list of adds and removes as a whole. See FInventoryBagTransaction.
+     * @return Whether all operations were applied. Nothing is applied on failure.
+     */
+    UFUNCTION(BlueprintCallable, Category="Inventory")
+    bool applyTransaction(const TArray<FInventoryBagTransactionOp>& ops);
+    /** Validates slot, quantity and ID limits for the whole set of operations without modifying the bag. */
+    bool canApplyTransaction(TArrayView<const FInventoryBagTransactionOp> ops) const;
+    bool commitTransaction(TArrayView<const FInventoryBagTransactionOp> ops);
+
+    // Transfers
+    /**
+     * Moves items of a type from one bag to another without spawning or destroying anything.
+     * The target bag assigns new IDs, tool durability and item component registrations are carried over.
+     * Capacity is checked once on the target and each bag fires a single change set event.
+     * @return Whether all the requested items were moved. Nothing is moved on failure.
+     */
+    UFUNCTION(BlueprintCallable, Category="Inventory")
+    static bool transferItems(UInventoryBagComponent* from, UInventoryBagComponent* to, UItemData* item_data, int32 count = 1);
+    /**
+     * Moves the whole stack held by a slot of one bag to another bag. See transferItems.
+     * @return Whether the stack was moved. Nothing is moved on failure.
+     */
+    UFUNCTION(BlueprintCallable, Category="Inventory")
+    static bool transferSlot(UInventoryBagComponent* from, UInventoryBagComponent* to, int32 slot_id);
+
+    // Compaction
+    /**
+     * Merges partially filled stacks of the same type, freeing the slots left empty.
+     * Can be time-sliced by limiting the number of items moved per call. Fires a single change set event.
+     * @param max_moves Maximum number of items to move in this call, negative for no limit.
+     * @return Whether every type is now compacted.
+     */
+    UFUNCTION(BlueprintCallable, Category="Inventory")
+    bool compactStacks(int32 max_moves = -1);
+
+    // Snapshots
+    /**
+     * Takes an immutable snapshot of the current bag contents.
+     * Only slots changed since the previous snapshot are copied, everything else is shared. Changed types cost one reference per slot.
+     * The bag keeps its last snapshot to share from, a second copy of its slots for as long as the bag lives.
+     * Changes made by editing Resources/Tools directly are not tracked. Not available for world store bags, see bUseWorldStore.
+     */
+    UFUNCTION(BlueprintCallable, Category="Inventory")
+    FInventoryBagSnapshot takeSnapshot();
+    /**
+     * Rolls back the bag contents to a snapshot previously taken from this bag.
+     * Item components whose ID is not part of the snapshot are unregistered from the bag.
+     * @return Whether the snapshot could be restored.
+     */
+    UFUNCTION(BlueprintCallable, Category="Inventory")
+    bool restoreSnapshot(const FInventoryBagSnapshot& snapshot);
+    /**
+     * Lists item quantity and slot changes needed to go from one snapshot to another.
+     */
+    UFUNCTION(BlueprintPure, Category="Inventory")
+    static FInventoryBagChangeSet diffSnapshots(const FInventoryBagSnapshot& from, const FInventoryBagSnapshot& to);
+    /**
+     * Latest read view published by the bag, see bPublishReadView. Safe to call from any thread.
+     * The view is immutable and stays valid for as long as it's held, even after newer views get published.
+     * Invalid until the first batch of changes when publishing is enabled, always invalid for world store bags.
+     */
+    FInventoryBagSnapshot getReadView() const;
+
+    /** Sequence of the last change made to the bag, the starting point for getChangesSince. */
+    UFUNCTION(BlueprintPure, Category="Inventory")
+    int64 getLastChangeSequence() const { return journal.getLastSequence(); }
+    /**
+     * Item quantity and slot changes made after the given sequence, merged per type and slot.
+     * Cheap way for consumers that only look at the bag once in a while to catch up, see JournalCapacity.
+     * @return False if the changes are not available anymore: read the whole bag again and restart from getLastChangeSequence.
+     */
+    UFUNCTION(BlueprintCallable, Category="Inventory")
+    bool getChangesSince(int64 sequence, FInventoryBagChangeSet& out_changes) const { return journal.getChangesSince(sequence, out_changes); }
+
+    /** Handle of the bag contents in the world inventory store, unset unless bUseWorldStore is enabled. */
+    UFUNCTION(BlueprintPure, Category="Inventory")
+    FInventoryBagHandle getStoreHandle() const { return store_handle; }
+
+    void BeginPlay() override;
+    void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+    /** Memory currently used by the bag, see InventorySystem.MemoryReport. Snapshots are shared with their holders and not counted. */
+    FInventoryBagMemoryUsage getMemoryUsage() const;
+
+    void GetResourceSizeEx(FResourceSizeEx& CumulativeResourceSize) override;
+    /** Keeps item data referenced only by the journal, snapshots or pending snapshot changes loaded. */
+    static void AddReferencedObjects(UObject* in_this, FReferenceCollector& collector);
+
+private:
+
+    /**
+     * Tries to add one item of item_data type with the given ID.
+     * @param durability Durability for tools. When INDEX_NONE it's taken from the tool component, or the tool data max durability.
+     */
+    bool tryAddItem(UItemData* item_data, int32 const id, UItemComponent* item_component = nullptr, int32 const durability = INDEX_NONE);
+    /**
+     * Tries to remove one item of item_data type.
+     * @param item_data Type of item to remove.
+     * @param remove_id When >= 0 it will try and remove the item with the specified ID (fails if no such ID can be found).
+     *                  Passing -1 will remove one item from the last slot of that item's type and set remove_id to the removed item's ID.
+     * @param out_durability When set, receives the durability of the removed tool.
+     * @return Whether the item could be removed.
+     */
+    bool tryRemoveItem(UItemData* item_data, int32& remove_id, int32* out_durability = nullptr);
+    bool tryAddResource(UResourceData* resource_data, int32 const id);
+    /**
+    * Tries to remove one resource of resource_data type.
+    * @param resource_data Type of resource to remove.
+    * @param remove_id When >= 0 it will try and remove the resource with the specified ID (fails if no such ID can be found).
+    *                  Passing -1 will remove one resource from the last slot of that resource's type and set remove_id to the removed resource's ID.
+    * @return Whether the item could be removed.
+    */
+    bool tryRemoveResource(UResourceData* resource_data, int32& remove_id);
+    bool tryAddTool(UToolData* tool_data, int32 const id, int32 const durability);
+    /**
+    * Tries to remove one tool of tool_data type.
+    * @param tool_data Type of tool to remove.
+    * @param remove_id When >= 0 it will try and remove the tool with the specified ID (fails if no such ID can be found).
+    *                  Passing -1 will remove one tool from the last slot of that tool's type and set remove_id to the removed tool's ID.
+    * @param out_durability When set, receives the durability of the removed tool.
+    * @return Whether the tool could be removed.
+    */
+    bool tryRemoveTool(UToolData* tool_data, int32& remove_id, int32* out_durability = nullptr);
+    bool isValidItemData(UItemData* item_data) const;
+    /** Store holding the bag contents when acting as a facade, null otherwise. */
+    UInventoryWorldStore* getWorldStore() const;
+    /** Spawns the drop actor of an item type, if it has one, and notifies its item component. */
+    AActor* spawnDropActor(UItemData* item_data);
+    /** Logs and returns true when the bag acts as a store facade, for operations that need the component storage. */
+    bool isUnsupportedByStore(const TCHAR* operation) const;
+    bool hasValidItemLimits(UItemData* item_data) const;
+    bool hasAvailableIds() const;
+    TOptional<FItemBagLimitValues> getItemLimit(UItemData* item_data) const;
+    /** Quantity currently held for the given type, without any validation or logging. */
+    int32 getStoredQuantity(UItemData* item_data) const;
+    /**
+     * Checks whether removing and then adding the given quantities of a single type respects its limits.
+     * @param out_slots_delta Number of slots the type would gain (or lose when negative).
+     */
+    bool canApplyQuantityChange(UItemData* item_data, int32 const remove_quantity, int32 const add_quantity, int32& out_slots_delta) const;
+    /** Whether count items of a type can be added to the bag, checking IDs, quantity and slot limits. */
+    bool canReceiveItems(UItemData* item_data, int32 const count) const;
+    /**
+     * Removes one item from the from bag and adds it to the to bag, keeping its durability and item component.
+     * Capacity of the target must have been checked already.
+     * @param remove_id Item to move, -1 moves the last item of that type.
+     */
+    static void moveItem(UInventoryBagComponent* from, UInventoryBagComponent* to, UItemData* item_data, int32 remove_id);
+    /**
+     * Moves items from the last slots of a type into its partially filled slots.
+     * @return Number of items moved.
+     */
+    int32 compactResourceSlots(UResourceData* resource_data, FBagResourcesData& resources_data, int32 const max_moves);
+    int32 compactToolSlots(UToolData* tool_data, FBagToolsData& tools_data, int32 const max_moves);
+    /** Returns an item ID to the pool, dropping any item component registered with it. */
+    void releaseItemId(int32 const id);
+    void markSnapshotDirty(UItemData* item_data, int32 const slot_id);
+    /** Single entry point for quantity changes. Keeps per category totals updated and batches the change when needed. */
+    void notifyQuantityChanged(UItemData* item_data, int32 const old_quantity, int32 const new_quantity);
+    /** Recomputes per category and per tag totals from scratch, for when the bag contents get replaced. */
+    void rebuildQuantityTotals();
+    /** Broadcasts (or batches) a resource slot change. Pass a null slot when it has been removed. */
+    void notifyResourceSlotChanged(UResourceData* resource_data, int32 const slot_id, int32 const old_count, const FBagResourceSlot* slot);
+    /** Broadcasts (or batches) a tool slot change. Pass a null slot when it has been removed. */
+    void notifyToolSlotChanged(UToolData* tool_data, int32 const slot_id, int32 const old_count, FBagToolSlot* slot);
+    /** Copies the current durability of the tools held by a slot into it. */
+    void refreshToolSlot(FBagToolSlot& slot) const;
+    /** Rebuilds slot locations and orders if they were invalidated by a change to the whole bag since the last slot query. */
+    void updateSlotIndex() const;
+    /** Handles a bulk durability update of the types in stale_tool_slot_types, refreshing their slots right away only if someone is listening. */
+    void notifyToolDurabilitiesChanged();
+    void broadcastChangeSet(FInventoryBagChangeSet& changes);
+    /**
+     * Starts collecting the changes of a single item removal along with the compaction following it.
+     * @return The batch to pass to endRemoveBatch, null when there's nothing to batch (no compaction, or already batching).
+     */
+    FInventoryBagChangeSet* beginRemoveBatch();
+    /** Stops collecting changes, broadcasting them if bBroadcast. Fires OnInventoryBagUpdated like broadcastBagUpdated. */
+    void endRemoveBatch(FInventoryBagChangeSet* batch, bool bBroadcast);
+    /** Publishes the read view and fires OnInventoryBagUpdated. Called once at the end of every batch of changes. */
+    void broadcastBagUpdated();
+    void publishReadView();
+
+    /**
+     * Starts the process of streaming in all item data and bag limits that will be used with this bag.
+     */
+    void streamInLimits();
+    void handleLimitsStreamedInCompleted() const;
+};
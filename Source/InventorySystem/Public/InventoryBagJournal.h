@@ -0,0 +1,57 @@
+// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
+
+#pragma once
+
+#include "InventoryBagTypes.h"
+
+/**
+ * Single quantity or slot count change recorded by the journal. SlotId is INDEX_NONE for quantity changes.
+ */
+struct FInventoryBagJournalEntry
+{
+    UItemData* ItemData;
+    int32 SlotId;
+    int32 OldCount;
+    int32 NewCount;
+};
+
+/**
+ * Bounded log of the changes made to a bag, each one numbered by a sequence that only ever increases.
+ * Consumers remember the last sequence they've seen and pull whatever happened after it in one go.
+ * Once older changes have been overwritten, or the bag contents got replaced wholesale, they have to read the whole bag again.
+ * Item data of the changes still available are kept alive by the owning bag through addReferencedObjects,
+ * types that left the bag can't be unloaded while changes about them can still be pulled.
+ */
+struct INVENTORYSYSTEM_API FInventoryBagJournal
+{
+    /** Sets how many changes are kept, 0 to only track the sequence. Drops every change recorded so far. */
+    void setCapacity(int32 in_capacity);
+    int32 getCapacity() const { return capacity; }
+    /** Sequence of the last recorded change, 0 if nothing was recorded yet. */
+    int64 getLastSequence() const { return last_sequence; }
+
+    void recordItemChange(UItemData* item_data, int32 const old_quantity, int32 const new_quantity) { record({item_data, INDEX_NONE, old_quantity, new_quantity}); }
+    void recordSlotChange(UItemData* item_data, int32 const slot_id, int32 const old_count, int32 const new_count) { record({item_data, slot_id, old_count, new_count}); }
+    /** Forgets every change recorded so far, so that anyone behind the current sequence has to resync. */
+    void invalidate() { first_sequence = last_sequence + 1; }
+
+    /**
+     * Collects the changes made after the given sequence, merged per type and slot and without no-ops.
+     * @return False if those changes are not available anymore and the consumer has to resync from the whole bag.
+     */
+    bool getChangesSince(int64 sequence, FInventoryBagChangeSet& out_changes) const;
+    SIZE_T getAllocatedSize() const { return entries.GetAllocatedSize(); }
+    /** Reports the item data of the changes still available. */
+    void addReferencedObjects(FReferenceCollector& collector, const UObject* referencing_object);
+
+private:
+
+    void record(const FInventoryBagJournalEntry& entry);
+
+    /** Ring buffer, the change with sequence S lives at S % capacity. Only allocated once the first change is recorded. */
+    TArray<FInventoryBagJournalEntry> entries;
+    int32 capacity = 0;
+    /** Sequence of the oldest change still available. */
+    int64 first_sequence = 1;
+    int64 last_sequence = 0;
+};
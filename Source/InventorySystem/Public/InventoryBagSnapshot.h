@@ -0,0 +1,100 @@
+// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
+
+#pragma once
+
+#include "InventoryBagTypes.h"
+#include "Crafting/CraftingTypes.h"
+#include "Templates/SharedPointer.h"
+
+#include "InventoryBagSnapshot.generated.h"
+
+/**
+ * Slots held for a single type when a snapshot was taken.
+ * Each slot is shared with the other snapshots of the bag until it changes, so snapshotting a changed type
+ * copies the changed slots and one reference per slot of the type, not every item of the type.
+ */
+template <typename TSlot>
+struct TBagSnapshotSlots
+{
+    int32 Quantity = 0;
+    TArray<TSharedRef<const TSlot, ESPMode::ThreadSafe>> Slots;
+};
+
+using FBagSnapshotResources = TBagSnapshotSlots<FBagResourceSlot>;
+using FBagSnapshotTools = TBagSnapshotSlots<FBagToolSlot>;
+using FBagResourcesDataRef = TSharedRef<const FBagSnapshotResources, ESPMode::ThreadSafe>;
+using FBagToolsDataRef = TSharedRef<const FBagSnapshotTools, ESPMode::ThreadSafe>;
+
+/**
+ * Immutable contents of a bag at a given version.
+ * Per type data is shared between snapshots of the same bag and only rebuilt once that type changes, sharing its unchanged slots,
+ * so holding on to a snapshot costs as much as the slots changed in the bag after it was taken.
+ * Item data keys are reported to GC by whoever holds the data: the bag for its own snapshots, FInventoryBagSnapshot properties
+ * for the others. Snapshots only held natively elsewhere don't keep types that left the bag loaded.
+ */
+struct INVENTORYSYSTEM_API FInventoryBagSnapshotData
+{
+    /** Unique ID of the bag the snapshot was taken from. */
+    uint32 BagId = 0;
+    /** Increases every time the bag takes a snapshot after being modified or restores one, never reused by the same bag. */
+    int32 Version = 0;
+    TMap<UResourceData*, FBagResourcesDataRef> Resources;
+    TMap<UToolData*, FBagToolsDataRef> Tools;
+    int32 ResourceUsedSlots = 0;
+    int32 ToolUsedSlots = 0;
+    /** Per category totals, indexed by the category value. */
+    TArray<int32> ResourceCategoryQuantities;
+    TArray<int32> ToolCategoryQuantities;
+
+    /** Reports the item data keys. The data is immutable, so this is safe while other threads read it. */
+    void addReferencedObjects(FReferenceCollector& collector, const UObject* referencing_object = nullptr) const;
+};
+
+/**
+ * Cheap, immutable view of a bag at some point in time.
+ * Copying a snapshot only copies a shared reference. Queries never touch the bag, so they can run on any thread.
+ */
+USTRUCT(BlueprintType)
+struct INVENTORYSYSTEM_API FInventoryBagSnapshot
+{
+    GENERATED_BODY()
+
+    FInventoryBagSnapshot() = default;
+    explicit FInventoryBagSnapshot(TSharedPtr<const FInventoryBagSnapshotData, ESPMode::ThreadSafe> in_data) : Data(MoveTemp(in_data)) {}
+
+    bool isValid() const { return Data.IsValid(); }
+    int32 getVersion() const { return Data.IsValid() ? Data->Version : -1; }
+    int32 getItemQuantity(const UItemData* item_data) const;
+    const FBagSnapshotResources* findResources(const UResourceData* resource_data) const;
+    const FBagSnapshotTools* findTools(const UToolData* tool_data) const;
+    int32 getCategoryQuantity(EResourceCategory category) const;
+    int32 getToolCategoryQuantity(EToolCategory category) const;
+    /**
+     * How many times a recipe could be crafted with the items in the snapshot. MAX_int32 for recipes without requirements.
+     * Takes requirements resolved on the game thread (see UCraftingRecipe::resolveRequirements), so it can run on any thread.
+     */
+    int32 getMaxCrafts(TArrayView<const FResolvedRecipeRequirement> requirements) const;
+    /** Same as above, resolving the recipe requirements first. Game thread only. */
+    int32 getMaxCrafts(const UCraftingRecipe* recipe) const;
+    bool canCraft(const UCraftingRecipe* recipe) const { return getMaxCrafts(recipe) > 0; }
+
+    /**
+     * Computes item quantity and slot changes needed to go from one snapshot to another.
+     * Types and slots whose data is still shared between the two snapshots are skipped without being inspected.
+     */
+    static FInventoryBagChangeSet diff(const FInventoryBagSnapshot& from, const FInventoryBagSnapshot& to);
+
+    /** Keeps the item data of snapshots held in properties alive. */
+    void AddStructReferencedObjects(FReferenceCollector& collector) const;
+
+    TSharedPtr<const FInventoryBagSnapshotData, ESPMode::ThreadSafe> Data;
+};
+
+template <>
+struct TStructOpsTypeTraits<FInventoryBagSnapshot> : public TStructOpsTypeTraitsBase2<FInventoryBagSnapshot>
+{
+    enum
+    {
+        WithAddStructReferencedObjects = true,
+    };
+};
@@ -0,0 +1,37 @@
+// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
+
+#pragma once
+
+#include "InventoryBagComponent.h"
+
+/**
+ * Records a list of item adds and removes to apply to a bag as a single operation.
+ * Limits are validated for the whole set before the bag is touched, so a failed commit leaves the bag as it was.
+ * All removes are applied before any add. A single change set event is fired on success.
+ * Up to 8 operations are stored inline without allocating.
+ */
+struct INVENTORYSYSTEM_API FInventoryBagTransaction
+{
+    explicit FInventoryBagTransaction(UInventoryBagComponent* in_bag) : bag(in_bag) {}
+
+    FInventoryBagTransaction& add(UItemData* item_data, int32 const quantity = 1)
+    {
+        ops.Add({item_data, quantity});
+        return *this;
+    }
+
+    FInventoryBagTransaction& remove(UItemData* item_data, int32 const quantity = 1)
+    {
+        ops.Add({item_data, -quantity});
+        return *this;
+    }
+
+    bool canCommit() const { return IsValid(bag) && bag->canApplyTransaction(ops); }
+    bool commit() { return IsValid(bag) && bag->commitTransaction(ops); }
+    void reset() { ops.Reset(); }
+
+private:
+
+    UInventoryBagComponent* bag;
+    TArray<FInventoryBagTransactionOp, TInlineAllocator<8>> ops;
+};
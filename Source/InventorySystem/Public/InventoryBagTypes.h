@@ -0,0 +1,431 @@
+// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
+
+#pragma once
+
+#include "Item.h"
+#include "Tool.h"
+#include "Resource.h"
+#include "Algo/BinarySearch.h"
+#include "UObject/ObjectMacros.h"
+
+#include "InventoryBagTypes.generated.h"
+
+/**
+ * Holds information about a tool in the bag.
+ */
+USTRUCT(BlueprintType)
+struct FBagToolInfo
+{
+    GENERATED_BODY()
+
+    friend bool operator==(const FBagToolInfo& lhs, const FBagToolInfo& rhs)
+    {
+        return lhs.ToolId == rhs.ToolId;
+    }
+
+    friend bool operator!=(const FBagToolInfo& lhs, const FBagToolInfo& rhs)
+    {
+        return !(lhs == rhs);
+    }
+
+    UPROPERTY(BlueprintReadWrite, EditAnywhere)
+    int32 ToolId;
+    /** Copy of the durability held by the bag. Refreshed whenever the slot is broadcast or snapshotted. */
+    UPROPERTY(BlueprintReadWrite, EditAnywhere)
+    int32 Durability;
+};
+
+/**
+ * Holds IDs of all the resources held in this slot.
+ */
+USTRUCT(BlueprintType)
+struct FBagResourceSlot
+{
+    GENERATED_BODY()
+
+    friend bool operator==(const FBagResourceSlot& lhs, const FBagResourceSlot& rhs)
+    {
+        return lhs.ResourceIds == rhs.ResourceIds;
+    }
+
+    friend bool operator!=(const FBagResourceSlot& lhs, const FBagResourceSlot& rhs)
+    {
+        return !(lhs == rhs);
+    }
+
+    int32 Num() const { return ResourceIds.Num(); }
+
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Inventory")
+    int32 Id;
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Inventory")
+    TArray<int32> ResourceIds;
+};
+
+/**
+ * Holds tool info (such as ID and current durability) for all tools held in this slot.
+ */
+USTRUCT(BlueprintType)
+struct FBagToolSlot
+{
+    GENERATED_BODY()
+
+    friend bool operator==(const FBagToolSlot& lhs, const FBagToolSlot& rhs)
+    {
+        return lhs.ToolsInfo == rhs.ToolsInfo;
+    }
+
+    friend bool operator!=(const FBagToolSlot& lhs, const FBagToolSlot& rhs)
+    {
+        return !(lhs == rhs);
+    }
+
+    int32 Num() const { return ToolsInfo.Num(); }
+
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Inventory")
+    int32 Id;
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Inventory")
+    TArray<FBagToolInfo> ToolsInfo;
+};
+
+/**
+ * A resource slot along with its type, as returned by the paged slot queries.
+ */
+USTRUCT(BlueprintType)
+struct FBagResourceSlotEntry
+{
+    GENERATED_BODY()
+
+    UPROPERTY(BlueprintReadOnly, Category="Inventory")
+    UResourceData* ResourceData = nullptr;
+    UPROPERTY(BlueprintReadOnly, Category="Inventory")
+    FBagResourceSlot Slot;
+};
+
+/**
+ * A tool slot along with its type, as returned by the paged slot queries.
+ */
+USTRUCT(BlueprintType)
+struct FBagToolSlotEntry
+{
+    GENERATED_BODY()
+
+    UPROPERTY(BlueprintReadOnly, Category="Inventory")
+    UToolData* ToolData = nullptr;
+    UPROPERTY(BlueprintReadOnly, Category="Inventory")
+    FBagToolSlot Slot;
+};
+
+/**
+ * Where a slot lives in the bag: its type and its index among the slots of that type.
+ */
+struct FBagSlotLocation
+{
+    UItemData* ItemData = nullptr;
+    int32 SlotIndex = INDEX_NONE;
+};
+
+/**
+ * Quantity held by a bag for a single gameplay tag, counting every type tagged with it or one of its children.
+ */
+struct FBagTagQuantity
+{
+    int32 Quantity = 0;
+    /** Held types with the tag, in the order they entered the bag. */
+    TArray<UItemData*, TInlineAllocator<4>> Types;
+};
+
+/**
+ * Finds per type entries of a bag, kept sorted by item type registry ID (see FItemTypeRegistry).
+ * Bags usually hold a few types, which are searched linearly. A hash is only built above HashThreshold types,
+ * then kept up to date on inserts and removals until the bag is back to HashThreshold / 2 types.
+ */
+struct FBagTypeIndex
+{
+    static constexpr int32 HashThreshold = 16;
+
+    template <typename TEntry>
+    int32 find(const TArray<TEntry>& entries, int32 const type_id) const
+    {
+        if (type_id == INDEX_NONE) return INDEX_NONE;
+        if (IndexByTypeId.Num() > 0)
+        {
+            const int32* index = IndexByTypeId.Find(type_id);
+            return index != nullptr ? *index : INDEX_NONE;
+        }
+        for (int32 i = 0; i < entries.Num() && entries[i].TypeId <= type_id; ++i)
+        {
+            if (entries[i].TypeId == type_id) return i;
+        }
+        return INDEX_NONE;
+    }
+
+    template <typename TEntry>
+    TEntry& insert(TArray<TEntry>& entries, TEntry&& entry)
+    {
+        int32 const index = Algo::LowerBoundBy(entries, entry.TypeId, [](const TEntry& existing) { return existing.TypeId; });
+        entries.Insert(MoveTemp(entry), index);
+        if (IndexByTypeId.Num() > 0)
+        {
+            // Entries after the insertion point moved up by one.
+            for (TPair<int32, int32>& pair : IndexByTypeId) if (pair.Value >= index) ++pair.Value;
+            IndexByTypeId.Add(entries[index].TypeId, index);
+        }
+        else if (entries.Num() > HashThreshold) rebuild(entries);
+        return entries[index];
+    }
+
+    template <typename TEntry>
+    void removeAt(TArray<TEntry>& entries, int32 const index)
+    {
+        int32 const type_id = entries[index].TypeId;
+        entries.RemoveAt(index, 1, false);
+        if (IndexByTypeId.Num() == 0) return;
+        if (entries.Num() <= HashThreshold / 2)
+        {
+            IndexByTypeId.Reset();
+            return;
+        }
+        // Entries after the removal point moved down by one.
+        IndexByTypeId.Remove(type_id);
+        for (TPair<int32, int32>& pair : IndexByTypeId) if (pair.Value > index) --pair.Value;
+    }
+
+    template <typename TEntry>
+    void rebuild(const TArray<TEntry>& entries)
+    {
+        IndexByTypeId.Reset();
+        if (entries.Num() <= HashThreshold) return;
+        for (int32 i = 0; i < entries.Num(); ++i) IndexByTypeId.Add(entries[i].TypeId, i);
+    }
+
+    SIZE_T getAllocatedSize() const { return IndexByTypeId.GetAllocatedSize(); }
+
+    TMap<int32, int32> IndexByTypeId;
+};
+
+/**
+ * Holds actual slots data used by a single resource type (UResourceData).
+ * All resources of a specific data type will be placed inside slots.
+ * Each slot holds a maximum of the used item data type's max stack and there's a cap for the
+ * total number of items held between all slots.
+ */
+USTRUCT(BlueprintType)
+struct FBagResourcesData
+{
+    GENERATED_BODY()
+
+    UPROPERTY(BlueprintReadOnly, VisibleAnywhere, Category="Inventory")
+    UResourceData* ResourceData = nullptr;
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Inventory")
+    TArray<FBagResourceSlot> Slots;
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Inventory")
+    int32 ResourceQuantity = 0;
+    /** All slots before this index are full. Lets adds find a slot with free space without scanning every slot. */
+    int32 FirstFreeSlot = 0;
+    /** Registry ID of ResourceData, bags keep their resource entries sorted by it. */
+    int32 TypeId = INDEX_NONE;
+};
+
+/**
+* Holds actual slots data used by a single tool type (UToolData).
+* All tools of a specific data type will be placed inside slots.
+* Each slot holds a maximum of the used item data type's max stack and there's a cap for the
+* total number of items held between all slots.
+*/
+USTRUCT(BlueprintType)
+struct FBagToolsData
+{
+    GENERATED_BODY()
+
+    UPROPERTY(BlueprintReadOnly, VisibleAnywhere, Category="Inventory")
+    UToolData* ToolData = nullptr;
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Inventory")
+    int32 ToolQuantity = 0;
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Inventory")
+    TArray<FBagToolSlot> Slots;
+    /** All slots before this index are full. Lets adds find a slot with free space without scanning every slot. */
+    int32 FirstFreeSlot = 0;
+    /** Registry ID of ToolData, bags keep their tool entries sorted by it. */
+    int32 TypeId = INDEX_NONE;
+};
+
+/**
+ * Holds all the data for resource items.
+ */
+USTRUCT(BlueprintType)
+struct INVENTORYSYSTEM_API FBagResources
+{
+    GENERATED_BODY()
+
+    FBagResourcesData* find(const UResourceData* resource_data);
+    const FBagResourcesData* find(const UResourceData* resource_data) const;
+    bool contains(const UResourceData* resource_data) const { return find(resource_data) != nullptr; }
+    /** Adds an empty entry for a resource type not held yet. */
+    FBagResourcesData& add(UResourceData* resource_data);
+    /** Adds a copy of an entry for a resource type not held yet. */
+    FBagResourcesData& add(const FBagResourcesData& resources_data);
+    void remove(const UResourceData* resource_data);
+    void reset();
+    /** Re-derives type IDs, sort order and lookup of entries that were loaded or copied in without going through add. */
+    void rebuild();
+    /** Memory used by the type lookup, on top of Types. */
+    SIZE_T getIndexAllocatedSize() const { return index.getAllocatedSize(); }
+
+    /** Held resource types, sorted by type ID. Only modify them through add/remove. */
+    UPROPERTY(BlueprintReadOnly, VisibleAnywhere, Category="Inventory")
+    TArray<FBagResourcesData> Types;
+    /** Total number of slots currently in use for all resources. */
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Inventory")
+    int32 UsedSlots;
+
+private:
+
+    FBagTypeIndex index;
+};
+
+/**
+ * Holds all the data for tool items.
+ */
+USTRUCT(BlueprintType)
+struct INVENTORYSYSTEM_API FBagTools
+{
+    GENERATED_BODY()
+
+    FBagToolsData* find(const UToolData* tool_data);
+    const FBagToolsData* find(const UToolData* tool_data) const;
+    bool contains(const UToolData* tool_data) const { return find(tool_data) != nullptr; }
+    /** Adds an empty entry for a tool type not held yet. */
+    FBagToolsData& add(UToolData* tool_data);
+    /** Adds a copy of an entry for a tool type not held yet. */
+    FBagToolsData& add(const FBagToolsData& tools_data);
+    void remove(const UToolData* tool_data);
+    void reset();
+    /** Re-derives type IDs, sort order and lookup of entries that were loaded or copied in without going through add. */
+    void rebuild();
+    /** Memory used by the type lookup, on top of Types. */
+    SIZE_T getIndexAllocatedSize() const { return index.getAllocatedSize(); }
+
+    /** Held tool types, sorted by type ID. Only modify them through add/remove. */
+    UPROPERTY(BlueprintReadOnly, VisibleAnywhere, Category="Inventory")
+    TArray<FBagToolsData> Types;
+    /** Total number of slots currently in use for all tools. */
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Inventory")
+    int32 UsedSlots;
+
+private:
+
+    FBagTypeIndex index;
+};
+
+/**
+ * Structure of arrays holding every tool instance in a bag, one entry per tool, in no particular order.
+ * This is where tool durability lives: FBagToolInfo::Durability in the tool slots only mirrors it.
+ * Columns are contiguous so that bulk durability updates can run over the whole bag in a single pass.
+ */
+struct INVENTORYSYSTEM_API FBagToolInstances
+{
+    /** Drops all instances and sizes the ID lookup for IDs in [0, max_item_id). */
+    void reset(int32 const max_item_id);
+    void add(int32 const id, UToolData* tool_data, int32 const durability, int32 const slot_id);
+    /**
+     * Removes a tool, moving the last instance in its place.
+     * @return Durability of the removed tool.
+     */
+    int32 remove(int32 const id);
+    /** @return Column index of the tool with the given ID, INDEX_NONE if it's not in the bag. */
+    int32 find(int32 const id) const { return IndexById.IsValidIndex(id) ? IndexById[id] : INDEX_NONE; }
+    int32 num() const { return Ids.Num(); }
+    SIZE_T getAllocatedSize() const;
+    /**
+     * Subtracts wear from the durability of every tool of a category, clamping at 0.
+     * @param category Category value to match, INDEX_NONE to wear every tool.
+     * @param out_worn_types Gets the types of the tools matching the category added.
+     * @return Number of tools matching the category.
+     */
+    int32 applyWear(int32 const category, int32 const wear, TSet<UToolData*>& out_worn_types);
+    /** Restores every tool to the max durability of its type. */
+    void repairAll();
+
+    TArray<int32> Ids;
+    TArray<int32> Durabilities;
+    /** Max durability of the tool type, cached per instance so that repairs are a plain copy. */
+    TArray<int32> MaxDurabilities;
+    /** EToolCategory of the tool type, widened to match the other columns in vector code. */
+    TArray<int32> Categories;
+    /** Slot holding the tool. Only used to find the slot to notify on single tool updates. */
+    TArray<int32> SlotIds;
+    TArray<UToolData*> Types;
+    /** Column index per tool ID, INDEX_NONE for IDs not used by a tool. */
+    TArray<int32> IndexById;
+};
+
+/**
+ * Describes how the total quantity of a single item type changed.
+ */
+USTRUCT(BlueprintType)
+struct FInventoryBagItemChange
+{
+    GENERATED_BODY()
+
+    UPROPERTY(BlueprintReadOnly, Category="Inventory")
+    UItemData* ItemData = nullptr;
+    UPROPERTY(BlueprintReadOnly, Category="Inventory")
+    int32 OldQuantity = 0;
+    UPROPERTY(BlueprintReadOnly, Category="Inventory")
+    int32 NewQuantity = 0;
+};
+
+/**
+ * Describes how the stack held by a single slot changed.
+ * An OldCount of 0 means the slot was added, a NewCount of 0 means the slot was removed.
+ */
+USTRUCT(BlueprintType)
+struct FInventoryBagSlotChange
+{
+    GENERATED_BODY()
+
+    UPROPERTY(BlueprintReadOnly, Category="Inventory")
+    UItemData* ItemData = nullptr;
+    UPROPERTY(BlueprintReadOnly, Category="Inventory")
+    int32 SlotId = -1;
+    UPROPERTY(BlueprintReadOnly, Category="Inventory")
+    int32 OldCount = 0;
+    UPROPERTY(BlueprintReadOnly, Category="Inventory")
+    int32 NewCount = 0;
+};
+
+/**
+ * Set of item and slot changes between two states of a bag.
+ */
+USTRUCT(BlueprintType)
+struct FInventoryBagChangeSet
+{
+    GENERATED_BODY()
+
+    bool isEmpty() const { return Items.Num() == 0 && Slots.Num() == 0; }
+    /** Records a quantity change, merging it with any change already recorded for the same type. */
+    void addItemChange(UItemData* item_data, int32 const old_quantity, int32 const new_quantity);
+    /** Records a slot change, merging it with any change already recorded for the same type and slot. */
+    void addSlotChange(UItemData* item_data, int32 const slot_id, int32 const old_count, int32 const new_count);
+    /** Drops merged changes that ended up where they started. */
+    void removeNoOps();
+
+    UPROPERTY(BlueprintReadOnly, Category="Inventory")
+    TArray<FInventoryBagItemChange> Items;
+    UPROPERTY(BlueprintReadOnly, Category="Inventory")
+    TArray<FInventoryBagSlotChange> Slots;
+};
+
+/**
+ * Single operation of a bag transaction. Positive quantities add items, negative ones remove them.
+ */
+USTRUCT(BlueprintType)
+struct FInventoryBagTransactionOp
+{
+    GENERATED_BODY()
+
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Inventory")
+    UItemData* ItemData = nullptr;
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Inventory")
+    int32 Quantity = 0;
+};
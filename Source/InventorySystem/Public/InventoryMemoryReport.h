@@ -0,0 +1,28 @@
+// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
+
+#pragma once
+
+#include "InventoryBagComponent.h"
+
+/**
+ * Memory used by the inventories of a world: every bag component, largest first, and the world inventory store.
+ * Logged by InventorySystem.MemoryReport and the InventoryMemoryReport commandlet.
+ */
+struct INVENTORYSYSTEM_API FInventoryMemoryReport
+{
+    struct FBagEntry
+    {
+        FString BagName;
+        FInventoryBagMemoryUsage Usage;
+    };
+
+    static FInventoryMemoryReport gather(UWorld* world);
+    /** Logs totals and per bag averages for each kind of memory, followed by the top_count largest bags. */
+    void log(int32 top_count) const;
+
+    /** Sorted by total memory, largest first. */
+    TArray<FBagEntry> Bags;
+    FInventoryBagMemoryUsage Total;
+    int32 StoreBags = 0;
+    SIZE_T StoreBytes = 0;
+};
@@ -0,0 +1,23 @@
+// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
+
+#pragma once
+
+#include "Commandlets/Commandlet.h"
+
+#include "InventoryMemoryReportCommandlet.generated.h"
+
+/**
+ * Loads a map, begins play on it and logs the memory used by its inventories, see FInventoryMemoryReport.
+ * Usage: -run=InventoryMemoryReport -Map=<map package> [-Top=<largest bags to list>]
+ */
+UCLASS()
+class UInventoryMemoryReportCommandlet : public UCommandlet
+{
+    GENERATED_BODY()
+
+public:
+
+    UInventoryMemoryReportCommandlet();
+
+    int32 Main(const FString& Params) override;
+};
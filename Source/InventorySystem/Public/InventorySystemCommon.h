@@ -1,7 +1,26 @@
-﻿// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
-
-#pragma once
-
-#include "CoreMinimal.h"
-
-DECLARE_LOG_CATEGORY_EXTERN(LogInventorySystem, All, Verbose);
+﻿// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/LowLevelMemTracker.h"
+#include "Stats/Stats.h"
+
+DECLARE_LOG_CATEGORY_EXTERN(LogInventorySystem, All, Verbose);
+DECLARE_STATS_GROUP(TEXT("InventorySystem"), STATGROUP_InventorySystem, STATCAT_Advanced);
+/** Heap allocations made by bag storage (slots, types, tag quantities, journal, change sets). Should stay flat once bags are warmed up. */
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Storage Allocations"), STAT_InventoryBagStorageAllocations, STATGROUP_InventorySystem, INVENTORYSYSTEM_API);
+
+/**
+ * Project LLM tag, relative to ELLMTag::ProjectTagStart, that tracks inventory allocations (see -llm and stat LLMFULL).
+ * Override it in the game Target.cs/Build.cs if the game already uses this slot for one of its own tags.
+ */
+#ifndef INVENTORY_SYSTEM_LLM_PROJECT_TAG
+#define INVENTORY_SYSTEM_LLM_PROJECT_TAG 0
+#endif
+
+#if ENABLE_LOW_LEVEL_MEM_TRACKER
+#define INVENTORY_LLM_TAG static_cast<ELLMTag>(static_cast<int32>(ELLMTag::ProjectTagStart) + INVENTORY_SYSTEM_LLM_PROJECT_TAG)
+#endif
+/** Tags allocations made in the current scope as InventorySystem. Compiles out when LLM is disabled. */
+#define INVENTORY_LLM_SCOPE() LLM_SCOPE(INVENTORY_LLM_TAG)
@@ -0,0 +1,122 @@
+// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
+
+#pragma once
+
+#include "InventorySystemCommon.h"
+#include "Serialization/Archive.h"
+#include "Templates/UniquePtr.h"
+#include "UObject/ObjectKey.h"
+
+class UInventoryBagComponent;
+class UItemComponent;
+class UItemData;
+class UToolComponent;
+class UCraftablesCollection;
+struct FInventoryBagTransactionOp;
+
+/**
+ * Operations stored in an inventory trace.
+ * Each record starts with the op and the microseconds elapsed since the previous record, both packed.
+ * Objects are referenced by index, assigned by DefineObject records the first time each object is met.
+ * Bags and item components get IDs of their own, never reused within a trace even once the object is gone.
+ * Bags are defined along with what they hold when first met, so traces started mid-session replay against the same contents.
+ */
+enum class EInventoryTraceOp : uint8
+{
+    /** Object index, object path. */
+    DefineObject,
+    /** Bag ID, bag properties object index. */
+    DefineBag,
+    /** Bag ID, item object index, count. */
+    AddItems,
+    /** Bag ID, item object index. */
+    RemoveItem,
+    /** Bag ID, item object index, component ID, tool durability (0 for other items). */
+    AddItemComponent,
+    /** Bag ID, component ID. */
+    RemoveItemComponent,
+    /** Bag ID, component ID, durability. */
+    UpdateToolDurability,
+    /** Craftables collection object index, bag count, bag IDs. */
+    EvaluateCraftables,
+    /** Bag ID. The ID isn't used anymore after this. */
+    DestroyBag,
+    /** Bag ID, op count, then item object index and quantity (negative for removes) for each op. */
+    CommitTransaction,
+    /** Source bag ID, target bag ID, item object index, count. */
+    TransferItems,
+    /** Source bag ID, target bag ID, slot ID. */
+    TransferSlot,
+    /** Bag ID, tool category (INDEX_NONE for every tool), wear. */
+    ApplyToolWear,
+    /** Bag ID. */
+    RepairAllTools,
+    /** Bag ID, max moves. */
+    CompactStacks,
+    /**
+     * Bag ID, record count. The next record count AddItems / AddItemComponent records restore what the bag held when first met.
+     * They are replayed without being measured.
+     */
+    SeedBag,
+};
+
+/**
+ * Records bag operations to a compact binary trace file, to be replayed with the InventoryTraceReplay commandlet.
+ * Off unless started with InventorySystem.Trace.Start. Game thread only, like the bag operations it records.
+ * Operations whose effect can't be replayed, like snapshot restores, stop the recording. Traces still running on exit are closed then.
+ */
+class INVENTORYSYSTEM_API FInventoryTraceRecorder
+{
+public:
+
+    static constexpr uint32 Magic = 0x52545649; // "IVTR"
+    static constexpr uint32 Version = 3;
+
+    static FInventoryTraceRecorder& get();
+
+    bool isRecording() const { return writer.IsValid(); }
+    bool start(const FString& file_path);
+    void stop();
+
+    void recordAddItems(const UInventoryBagComponent* bag, const UItemData* item_data, int32 count);
+    void recordRemoveItem(const UInventoryBagComponent* bag, const UItemData* item_data);
+    void recordAddItemComponent(const UInventoryBagComponent* bag, const UItemComponent* item);
+    void recordRemoveItemComponent(const UInventoryBagComponent* bag, const UItemComponent* item);
+    void recordUpdateToolDurability(const UInventoryBagComponent* bag, const UToolComponent* tool, int32 durability);
+    void recordEvaluateCraftables(const UCraftablesCollection* craftables_collection, const TArray<UInventoryBagComponent*>& bags);
+    void recordDestroyBag(const UInventoryBagComponent* bag);
+    void recordCommitTransaction(const UInventoryBagComponent* bag, TArrayView<const FInventoryBagTransactionOp> ops);
+    void recordTransferItems(const UInventoryBagComponent* from, const UInventoryBagComponent* to, const UItemData* item_data, int32 count);
+    void recordTransferSlot(const UInventoryBagComponent* from, const UInventoryBagComponent* to, int32 slot_id);
+    /** @param category Tool category value, INDEX_NONE for every tool. */
+    void recordApplyToolWear(const UInventoryBagComponent* bag, int32 category, int32 wear);
+    void recordRepairAllTools(const UInventoryBagComponent* bag);
+    void recordCompactStacks(const UInventoryBagComponent* bag, int32 max_moves);
+    /** Stops recording, for operations that would make the replayed bags drift from the recorded ones. */
+    void stopOnUnsupported(const TCHAR* operation);
+
+private:
+
+    /** Writes the op header, defining the bag first if it's the first time it's met. */
+    void beginRecord(EInventoryTraceOp op);
+    uint32 getBagId(const UInventoryBagComponent* bag);
+    /** Writes the SeedBag records restoring what a bag holds right now. */
+    void recordBagContents(const UInventoryBagComponent* bag, uint32 bag_id);
+    uint32 getComponentId(const UItemComponent* item);
+    uint32 getObjectIndex(const UObject* object);
+    void writePacked(uint32 value);
+    void writeInt(int32 value);
+    void flush();
+
+    TUniquePtr<FArchive> writer;
+    /** Records are gathered here and written out in large chunks. */
+    TArray<uint8> buffer;
+    /** Keyed by object key rather than pointer, so that objects created where a collected one used to be don't alias it. */
+    TMap<FObjectKey, uint32> object_indices;
+    TMap<FObjectKey, uint32> bag_ids;
+    TMap<FObjectKey, uint32> component_ids;
+    uint32 next_bag_id = 0;
+    uint32 next_component_id = 0;
+    uint64 last_record_cycles = 0;
+    FDelegateHandle pre_exit_handle;
+};
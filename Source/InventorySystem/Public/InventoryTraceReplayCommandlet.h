@@ -0,0 +1,25 @@
+// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
+
+#pragma once
+
+#include "Commandlets/Commandlet.h"
+
+#include "InventoryTraceReplayCommandlet.generated.h"
+
+/**
+ * Replays an inventory trace recorded with InventorySystem.Trace.Start against the current build, as fast as possible,
+ * and logs throughput and latency percentiles for each operation.
+ * Bags are recreated with the bag properties they were recorded with, in a world of their own.
+ * Usage: -run=InventoryTraceReplay -Trace=<trace file> [-Repeat=<times>]
+ */
+UCLASS()
+class UInventoryTraceReplayCommandlet : public UCommandlet
+{
+    GENERATED_BODY()
+
+public:
+
+    UInventoryTraceReplayCommandlet();
+
+    int32 Main(const FString& Params) override;
+};
@@ -0,0 +1,152 @@
+// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
+
+#pragma once
+
+#include "Item.h"
+#include "Tool.h"
+#include "Resource.h"
+#include "Misc/Optional.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "UObject/ObjectMacros.h"
+
+#include "InventoryWorldStore.generated.h"
+
+struct FStreamableHandle;
+class UBagProperties;
+struct FItemBagLimitValues;
+
+/**
+ * Lightweight reference to a bag held by the world inventory store.
+ * Handles of destroyed bags are detected through the generation and never alias a newer bag.
+ */
+USTRUCT(BlueprintType)
+struct INVENTORYSYSTEM_API FInventoryBagHandle
+{
+    GENERATED_BODY()
+
+    friend bool operator==(const FInventoryBagHandle& lhs, const FInventoryBagHandle& rhs)
+    {
+        return lhs.Index == rhs.Index && lhs.Generation == rhs.Generation;
+    }
+
+    friend bool operator!=(const FInventoryBagHandle& lhs, const FInventoryBagHandle& rhs)
+    {
+        return !(lhs == rhs);
+    }
+
+    bool isSet() const { return Index != INDEX_NONE; }
+
+    UPROPERTY()
+    int32 Index = INDEX_NONE;
+    UPROPERTY()
+    int32 Generation = 0;
+};
+
+/**
+ * Quantity held by a store bag for a single item type.
+ */
+struct FStoredItemType
+{
+    UItemData* ItemData;
+    int32 Quantity;
+};
+
+/**
+ * A single tool held by a store bag.
+ */
+struct FStoredTool
+{
+    UToolData* ToolData;
+    int32 Durability;
+};
+
+/**
+ * Contents of a bag held by the world inventory store.
+ * Stacks are always kept compacted, so the slots used by a type follow from its quantity and max stack size
+ * and only per type quantities need to be stored. Items get no individual IDs, only their count is limited by MaxItemId.
+ */
+struct FStoredBag
+{
+    UBagProperties* Properties = nullptr;
+    /** Held types, resources and tools mixed. Bags usually hold a handful of types, searched linearly. */
+    TArray<FStoredItemType, TInlineAllocator<4>> Types;
+    /** Every tool held, oldest first. */
+    TArray<FStoredTool> Tools;
+    int32 ItemCount = 0;
+    int32 ResourceSlots = 0;
+    int32 ToolSlots = 0;
+};
+
+/**
+ * Holds bag contents for the whole world in dense pooled arrays, for bags that don't need a full UInventoryBagComponent
+ * such as storage crates or NPC pockets. Add/remove follow the same slot, quantity and ID limits as the bag component
+ * with bCompactStacksOnRemove enabled. Bag components can also keep their contents here, see bUseWorldStore.
+ */
+UCLASS()
+class INVENTORYSYSTEM_API UInventoryWorldStore : public UWorldSubsystem
+{
+    GENERATED_BODY()
+
+public:
+
+    static UInventoryWorldStore* get(const UObject* world_context);
+
+    /** Creates an empty bag using the given properties for its limits. Starts streaming in the limits if needed. */
+    UFUNCTION(BlueprintCallable, Category="Inventory")
+    FInventoryBagHandle createBag(UBagProperties* properties);
+    UFUNCTION(BlueprintCallable, Category="Inventory")
+    void destroyBag(FInventoryBagHandle handle);
+    UFUNCTION(BlueprintPure, Category="Inventory")
+    bool isValidBag(FInventoryBagHandle handle) const { return findBag(handle) != nullptr; }
+
+    /**
+     * Adds up to count items of a type, stopping at the first one that doesn't fit.
+     * @param durability Durability of added tools, INDEX_NONE for the tool data max durability.
+     * @return Number of items actually added.
+     */
+    UFUNCTION(BlueprintCallable, Category="Inventory")
+    int32 addItems(FInventoryBagHandle handle, UItemData* item_data, int32 count = 1, int32 durability = -1);
+    /**
+     * Removes up to count items of a type. Tools are removed newest first.
+     * @return Number of items actually removed.
+     */
+    UFUNCTION(BlueprintCallable, Category="Inventory")
+    int32 removeItems(FInventoryBagHandle handle, UItemData* item_data, int32 count = 1);
+    UFUNCTION(BlueprintPure, Category="Inventory")
+    int32 getItemQuantity(FInventoryBagHandle handle, UItemData* item_data) const;
+    UFUNCTION(BlueprintPure, Category="Inventory")
+    int32 getCategoryQuantity(FInventoryBagHandle handle, EResourceCategory category) const;
+    UFUNCTION(BlueprintPure, Category="Inventory")
+    int32 getToolCategoryQuantity(FInventoryBagHandle handle, EToolCategory category) const;
+    /** Quantity of items tagged with the given tag or one of its children. Goes through the held types, like category queries. */
+    UFUNCTION(BlueprintPure, Category="Inventory")
+    int32 getTagQuantity(FInventoryBagHandle handle, FGameplayTag tag) const;
+    UFUNCTION(BlueprintPure, Category="Inventory")
+    TArray<UItemData*> getTypesWithTag(FInventoryBagHandle handle, FGameplayTag tag) const;
+
+    const FStoredBag* findBag(FInventoryBagHandle handle) const;
+    int32 getNumBags() const { return bags.Num() - free_indices.Num(); }
+    /** Heap and inline memory used by the store bags, free entries included. */
+    SIZE_T getAllocatedSize() const;
+    /** Same as getAllocatedSize, divided by the number of live bags. */
+    SIZE_T getAverageBytesPerBag() const;
+    /** Logs average memory per store bag and per bag component in the world, see InventorySystem.MemoryPerBag. */
+    static void logMemoryPerBag(UWorld* world);
+
+    void Deinitialize() override;
+    static void AddReferencedObjects(UObject* in_this, FReferenceCollector& collector);
+
+private:
+
+    FStoredBag* findBag(FInventoryBagHandle handle);
+    /** Limits for a type, see UBagProperties::resolveLimit. */
+    TOptional<FItemBagLimitValues> getItemLimit(const FStoredBag& bag, UItemData* item_data) const;
+    void streamInLimits(UBagProperties* properties);
+
+    TArray<FStoredBag> bags;
+    /** Generation of each bag index, bumped every time the bag at that index is destroyed. */
+    TArray<int32> generations;
+    TArray<int32> free_indices;
+    /** One streaming request per bag properties asset with limit assets, shared by all the bags using it. */
+    TMap<UBagProperties*, TSharedPtr<FStreamableHandle>> limits_stream_handles;
+};
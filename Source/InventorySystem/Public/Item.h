@@ -1,67 +1,117 @@
-﻿// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
-
-#pragma once
-
-#include "InventorySystemCommon.h"
-#include "Pickable.h"
-#include "Components/ActorComponent.h"
-#include "Engine/DataAsset.h"
-
-#include "Item.generated.h"
-
-class UInventoryBagComponent;
-
-UENUM(BlueprintType)
-enum class EItemCategory : uint8
-{
-    None,
-    Resource,
-    Tool
-};
-
-/**
- * Base class for item data.
- * Subclass this to provide your own custom item data.
- */
-UCLASS(BlueprintType, Blueprintable)
-class INVENTORYSYSTEM_API UItemData : public UPrimaryDataAsset
-{
-    GENERATED_BODY()
-
-public:
-
-    UPROPERTY(BlueprintReadWrite, EditAnywhere)
-    EItemCategory Category = EItemCategory::None;
-    /** Actor that will be spawned when an item of this type is dropped from inventory. No actor will be spawned if unset.*/
-    UPROPERTY(BlueprintReadWrite, EditAnywhere)
-    TSubclassOf<AActor> OnDropSpawnedActor;
-};
-
-/**
- * Adding this component to an actor makes it an Item usable by the Inventory System.
- * Subclass from this to provide your own functionality and item data.
- */
-UCLASS(BlueprintType, Blueprintable, ClassGroup="Item", meta = (BlueprintSpawnableComponent))
-class INVENTORYSYSTEM_API UItemComponent : public UActorComponent, public IPickable
-{
-    GENERATED_BODY()
-public:
-
-    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Inventory")
-    UItemData* ItemData;
-
-    UPROPERTY(BlueprintReadWrite, VisibleAnywhere, Category="Inventory")
-    UInventoryBagComponent* OwningBag;
-
-public:
-    UItemComponent();
-
-    virtual AActor* getPickableActor_Implementation() override;
-    virtual UItemData* getItemData_Implementation() override;
-    virtual UItemComponent* getItemComponent_Implementation() override;
-    virtual FVector getPickableLocation_Implementation() override;
-    virtual EPickupBehavior getPickupBehavior_Implementation() override;
-    virtual TScriptInterface<IPickable> getPickable_Implementation() override;
-    virtual void OnItemPickedUp_Implementation(UInventoryBagComponent* owning_bag) override;
-    virtual void OnItemDropped_Implementation(UInventoryBagComponent* owning_bag) override;
-};
+﻿// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
+
+#pragma once
+
+#include "InventorySystemCommon.h"
+#include "Pickable.h"
+#include "Components/ActorComponent.h"
+#include "GameplayTagContainer.h"
+#include "Engine/DataAsset.h"
+
+#include "Item.generated.h"
+
+class UInventoryBagComponent;
+class UTexture2D;
+struct FStreamableHandle;
+
+UENUM(BlueprintType)
+enum class EItemCategory : uint8
+{
+    None,
+    Resource,
+    Tool
+};
+
+/**
+ * Base class for item data.
+ * Subclass this to provide your own custom item data.
+ */
+UCLASS(BlueprintType, Blueprintable)
+class INVENTORYSYSTEM_API UItemData : public UPrimaryDataAsset
+{
+    GENERATED_BODY()
+
+public:
+
+    /** Asset bundles for UI, drop and crafting references of item and crafting data. See UAssetManager. */
+    static const FName UIBundle;
+    static const FName DropBundle;
+    static const FName CraftingBundle;
+
+    UPROPERTY(BlueprintReadWrite, EditAnywhere)
+    EItemCategory Category = EItemCategory::None;
+    UPROPERTY(BlueprintReadOnly, EditAnywhere, meta=(AssetBundles="UI"))
+    TSoftObjectPtr<UTexture2D> Icon;
+    /**
+     * Actor that will be spawned when an item of this type is dropped from inventory. No actor will be spawned if unset.
+     * Streamed in once the item type enters a bag, see streamInDropActor.
+     */
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, meta=(AssetBundles="Drop"))
+    TSoftClassPtr<AActor> OnDropSpawnedActor;
+    /**
+     * Kinds of item this type belongs to, e.g. Food.Cooked. Bags index their contents by these tags and their parents,
+     * see UInventoryBagComponent::getQuantityWithTag. Shouldn't change while items of this type are in a bag.
+     */
+    UPROPERTY(BlueprintReadOnly, EditAnywhere)
+    FGameplayTagContainer Tags;
+
+    /** Dense ID given by FItemTypeRegistry while this item data is loaded. Never save it, it changes between runs. */
+    int32 getTypeId() const { return type_id; }
+    /** Starts streaming in the drop actor class, kept loaded for as long as this item data is. Does nothing if already requested. */
+    void streamInDropActor() const;
+    /** Drop actor class, loaded right away if streamInDropActor hasn't been called or isn't done yet. nullptr if unset. */
+    UClass* loadDropActor() const;
+    /** Tags along with all their parent tags. Built on first use. */
+    const FGameplayTagContainer& getTagsWithParents() const;
+
+    void PostInitProperties() override;
+    void BeginDestroy() override;
+#if WITH_EDITOR
+    void PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent) override;
+#endif
+
+private:
+
+    int32 type_id = INDEX_NONE;
+    mutable FGameplayTagContainer tags_with_parents;
+    mutable bool bTagsWithParentsBuilt = false;
+    mutable TSharedPtr<FStreamableHandle> drop_stream_handle;
+};
+
+/**
+ * Adding this component to an actor makes it an Item usable by the Inventory System.
+ * Subclass from this to provide your own functionality and item data.
+ */
+UCLASS(BlueprintType, Blueprintable, ClassGroup="Item", meta = (BlueprintSpawnableComponent))
+class INVENTORYSYSTEM_API UItemComponent : public UActorComponent, public IPickable
+{
+    GENERATED_BODY()
+public:
+
+    /** Data shared by every item of this type, usually a data asset. See bUseInstanceData. */
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Inventory")
+    UItemData* ItemData = nullptr;
+    /**
+     * Give this item its own copy of ItemData when registered, to tweak data per instance.
+     * The copy is an item type of its own for bags, limits and recipes. Costs an extra object per item, so it's off by default.
+     */
+    UPROPERTY(BlueprintReadOnly, EditAnywhere, Category="Inventory", AdvancedDisplay)
+    bool bUseInstanceData = false;
+
+    UPROPERTY(BlueprintReadWrite, VisibleAnywhere, Category="Inventory")
+    UInventoryBagComponent* OwningBag;
+
+public:
+
+    void OnRegister() override;
+
+    virtual AActor* getPickableActor_Implementation() override;
+    virtual UItemData* getItemData_Implementation() override;
+    virtual UItemComponent* getItemComponent_Implementation() override;
+    virtual FVector getPickableLocation_Implementation() override;
+    virtual int32 getPickableQuantity_Implementation() override;
+    virtual EPickupBehavior getPickupBehavior_Implementation() override;
+    virtual TScriptInterface<IPickable> getPickable_Implementation() override;
+    virtual void OnItemPickedUp_Implementation(UInventoryBagComponent* owning_bag) override;
+    virtual void OnItemDropped_Implementation(UInventoryBagComponent* owning_bag) override;
+};
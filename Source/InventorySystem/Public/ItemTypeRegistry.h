@@ -0,0 +1,34 @@
+// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
+
+#pragma once
+
+#include "InventorySystemCommon.h"
+#include "HAL/CriticalSection.h"
+
+class UItemData;
+
+/**
+ * Gives every loaded item data asset a dense, small integer ID.
+ * IDs are assigned when the asset is created or loaded and given back when it's destroyed, so they're only stable
+ * for the lifetime of the asset and must never be saved. Bags use them to keep their per type data small and sorted.
+ * Registration can happen on the async loading thread, so all access is guarded.
+ */
+class INVENTORYSYSTEM_API FItemTypeRegistry
+{
+public:
+
+    static FItemTypeRegistry& get();
+
+    int32 registerType(UItemData* item_data);
+    void unregisterType(int32 const type_id);
+    /** @return Item data registered with the given ID, null if the ID is not in use. */
+    UItemData* findType(int32 const type_id) const;
+    /** Upper bound of the IDs currently in use. */
+    int32 getMaxTypeId() const;
+
+private:
+
+    mutable FCriticalSection lock;
+    TArray<UItemData*> types;
+    TArray<int32> free_ids;
+};
@@ -0,0 +1,133 @@
+// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
+
+#pragma once
+
+#include "InventorySystemCommon.h"
+#include "Components/ActorComponent.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+
+#include "LootProxySubsystem.generated.h"
+
+class UInstancedStaticMeshComponent;
+class UStaticMesh;
+
+/**
+ * Lets the owning pickup actor be replaced by a loot proxy while no pickup trigger is nearby, see ULootProxySubsystem.
+ * Only the actor class and transform are kept by the proxy: use it for pickups that don't carry any state of their own,
+ * like resource nodes and dropped resources.
+ */
+UCLASS(BlueprintType, ClassGroup="Item", meta = (BlueprintSpawnableComponent))
+class INVENTORYSYSTEM_API ULootProxyComponent : public UActorComponent
+{
+    GENERATED_BODY()
+
+public:
+
+    /** Mesh drawn for the proxy. When unset, the mesh of the first static mesh component of the owner is used. */
+    UPROPERTY(BlueprintReadOnly, EditAnywhere, Category="Inventory")
+    UStaticMesh* ProxyMesh = nullptr;
+
+    void BeginPlay() override;
+
+    /** Set on actors spawned from a proxy, which are already tracked by the subsystem. */
+    bool bPromotedFromProxy = false;
+};
+
+/**
+ * Holds distant pickups as lightweight proxies: a transform in a compact array plus an instance in an instanced mesh,
+ * with no actor, collision or tick. Proxies within PromoteRadius of a pickup trigger are promoted to their actual actor
+ * so that triggers can overlap them, promoted actors with no trigger within DemoteRadius are turned back into proxies.
+ * Proxies are found through a 2D grid hash with DemoteRadius sized cells. Runs wherever the pickups have authority.
+ * Instances are only drawn when not running as a dedicated server, proxies aren't replicated.
+ */
+UCLASS()
+class INVENTORYSYSTEM_API ULootProxySubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+    GENERATED_BODY()
+
+public:
+
+    static ULootProxySubsystem* get(const UObject* world_context);
+
+    /**
+     * Adds a proxy for an actor that doesn't exist yet, spawned once a trigger gets close.
+     * @return ID of the new proxy.
+     */
+    UFUNCTION(BlueprintCallable, Category="Inventory")
+    int32 addProxy(TSubclassOf<AActor> actor_class, const FTransform& transform, UStaticMesh* mesh);
+    /** Starts tracking an existing actor as a promoted proxy. It's turned into a proxy on the next update if no trigger is nearby. */
+    int32 addPromotedActor(AActor* actor, UStaticMesh* mesh);
+    /** Removes a proxy, destroying its actor if promoted. */
+    UFUNCTION(BlueprintCallable, Category="Inventory")
+    void removeProxy(int32 proxy_id);
+
+    int32 getNumProxies() const { return proxies.Num() - free_proxies.Num(); }
+    int32 getNumPromoted() const { return promoted_proxies.Num(); }
+    /** Runs a promote/demote pass right away. */
+    void updateProxies();
+
+    void Initialize(FSubsystemCollectionBase& Collection) override;
+    void Deinitialize() override;
+
+    void Tick(float DeltaTime) override;
+    bool IsTickable() const override;
+    TStatId GetStatId() const override;
+    UWorld* GetTickableGameObjectWorld() const override { return GetWorld(); }
+
+private:
+
+    /** Cold proxy data, hot locations are kept apart in proxy_locations. */
+    struct FLootProxy
+    {
+        FTransform Transform;
+        /** Index in proxy_classes, INDEX_NONE for free entries. */
+        int32 ClassIndex = INDEX_NONE;
+        /** Index in mesh_components, INDEX_NONE when not drawn. */
+        int32 MeshIndex = INDEX_NONE;
+        /** Instance in the mesh component. Kept while promoted, hidden with a zero scale, so indices never move. */
+        int32 InstanceIndex = INDEX_NONE;
+        FIntPoint Cell;
+        /** Set while promoted. */
+        TWeakObjectPtr<AActor> Actor;
+        /** Last update that found a trigger within DemoteRadius. */
+        uint32 LastNearbyUpdate = 0;
+    };
+
+    int32 allocateProxy(UClass* actor_class, const FTransform& transform, UStaticMesh* mesh);
+    void releaseProxy(int32 proxy_id);
+    FIntPoint getCell(const FVector& location) const;
+    void moveToCell(int32 proxy_id, const FIntPoint& cell);
+    void promote(int32 proxy_id);
+    void demote(int32 proxy_id);
+    /** Shows or hides the instance of a proxy, allocating it the first time. */
+    void updateInstance(int32 proxy_id, bool bVisible);
+    int32 findOrAddMesh(UStaticMesh* mesh);
+    UFUNCTION()
+    void handlePromotedActorDestroyed(AActor* actor);
+
+    TArray<FLootProxy> proxies;
+    TArray<FVector> proxy_locations;
+    TArray<int32> free_proxies;
+    /** Proxy IDs per grid cell. */
+    TMap<FIntPoint, TArray<int32>> grid;
+    float cell_size = 1.f;
+    TArray<int32> promoted_proxies;
+    TMap<AActor*, int32> promoted_actor_proxies;
+    UPROPERTY()
+    TArray<UClass*> proxy_classes;
+    UPROPERTY()
+    TArray<UInstancedStaticMeshComponent*> mesh_components;
+    TMap<UStaticMesh*, int32> mesh_indices;
+    /** Free instances of each mesh component, left by removed proxies. */
+    TArray<TArray<int32>> free_instances;
+    /** Mesh components with instances changed since the last update, indexed like mesh_components. */
+    TBitArray<> dirty_meshes;
+    /** Owner of the instanced mesh components. */
+    UPROPERTY()
+    AActor* instances_actor = nullptr;
+    TArray<FVector> trigger_locations;
+    TArray<int32> pending_promotions;
+    uint32 update_number = 0;
+    float time_since_update = 0.f;
+};
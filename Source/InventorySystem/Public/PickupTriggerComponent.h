@@ -1,73 +1,136 @@
-// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
-
-#pragma once
-
-#include "CoreMinimal.h"
-#include "Pickable.h"
-#include "Components/BoxComponent.h"
-#include "Components/CapsuleComponent.h"
-#include "PickupTriggerComponent.generated.h"
-
-class UPickupTriggerComponent;
-
-DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FPickableEventDelegate, TScriptInterface<IPickable>, pickable, UPickupTriggerComponent*, trigger);
-
-USTRUCT(BlueprintType)
-struct FFindPickableResult
-{
-    GENERATED_BODY()
-
-    UPROPERTY(BlueprintReadWrite, VisibleAnywhere)
-    AActor* Actor;
-    UPROPERTY(BlueprintReadWrite, VisibleAnywhere)
-    TScriptInterface<IPickable> Pickable;
-};
-
-/**
- * Keeps track of any pickable items entering the area of this component.
- * Provides events for when new pickables enter/exit the trigger and utility functions to find the closest one.
- */
-UCLASS(Blueprintable, BlueprintType, ClassGroup=(Inventory,Pickup), meta = (BlueprintSpawnableComponent))
-class INVENTORYSYSTEM_API UPickupTriggerComponent : public UBoxComponent
-{
-    GENERATED_BODY()
-
-public:
-
-    UPROPERTY(BlueprintReadOnly, EditAnywhere)
-    bool bAutoUpdateClosestPickable = true;
-    UPROPERTY(BlueprintCallable, BlueprintAssignable)
-    FPickableEventDelegate OnClosestPickableUpdated;
-    UPROPERTY(BlueprintCallable, BlueprintAssignable)
-    FPickableEventDelegate OnPickableTriggerEnter;
-    UPROPERTY(BlueprintCallable, BlueprintAssignable)
-    FPickableEventDelegate OnPickableTriggerExit;
-
-protected:
-
-    UPROPERTY(BlueprintReadWrite, VisibleAnywhere)
-    TArray<TScriptInterface<IPickable>> available_pickables;
-    UPROPERTY(BlueprintReadWrite, VisibleAnywhere)
-    TScriptInterface<IPickable> closest_pickable;
-
-public:
-
-    UPickupTriggerComponent();
-    virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
-    virtual void BeginPlay() override;
-    void setAutoUpdateClosestPickable(bool bEnabled);
-    /**
-     * @return Closest pickable to the trigger, or nullptr if no pickable is available.
-     */
-    UFUNCTION(BlueprintCallable)
-    TScriptInterface<IPickable> getClosestPickable();
-
-protected:
-
-    UFUNCTION(BlueprintCallable, BlueprintNativeEvent)
-    void closestPickableUpdated(const TScriptInterface<IPickable>& pickable);
-    UFUNCTION()
-    void handleTriggerBeginOverlap(UPrimitiveComponent* overlapped_component, AActor* other_actor, UPrimitiveComponent* other_comp, int32 other_body_index, bool b_from_sweep, const FHitResult& sweep_result);
-    UFUNCTION()
-    void handleTriggerEndOverlap(UPrimitiveComponent* overlapped_component, AActor* other_actor, UPrimitiveComponent* other_comp, int32 other_body_index);
-};
+// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Pickable.h"
+#include "Components/BoxComponent.h"
+#include "Components/CapsuleComponent.h"
+#include "PickupTriggerComponent.generated.h"
+
+class UPickupTriggerComponent;
+class UInventoryBagComponent;
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FPickableEventDelegate, TScriptInterface<IPickable>, pickable, UPickupTriggerComponent*, trigger);
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FPickedUpActorReleasedDelegate, AActor*, actor, UPickupTriggerComponent*, trigger);
+
+DECLARE_DYNAMIC_DELEGATE_RetVal_OneParam(bool, FPickableFilterDelegate, const TScriptInterface<IPickable>&, pickable);
+
+USTRUCT(BlueprintType)
+struct FFindPickableResult
+{
+    GENERATED_BODY()
+
+    UPROPERTY(BlueprintReadWrite, VisibleAnywhere)
+    AActor* Actor;
+    UPROPERTY(BlueprintReadWrite, VisibleAnywhere)
+    TScriptInterface<IPickable> Pickable;
+};
+
+/**
+ * Outcome of UPickupTriggerComponent::pickupAll.
+ */
+USTRUCT(BlueprintType)
+struct FPickupAllResult
+{
+    GENERATED_BODY()
+
+    /** Pickables added to the bag. */
+    UPROPERTY(BlueprintReadOnly, VisibleAnywhere)
+    int32 NumPickedUp = 0;
+    /** Pickables that passed the filter but didn't fit in the bag. They're left in the world. */
+    UPROPERTY(BlueprintReadOnly, VisibleAnywhere)
+    int32 NumRejected = 0;
+    /** Quantity added to the bag for each item type. */
+    UPROPERTY(BlueprintReadOnly, VisibleAnywhere)
+    TMap<UItemData*, int32> PickedUpQuantities;
+};
+
+/**
+ * Keeps track of any pickable items entering the area of this component.
+ * Provides events for when new pickables enter/exit the trigger and utility functions to find the closest one.
+ */
+UCLASS(Blueprintable, BlueprintType, ClassGroup=(Inventory,Pickup), meta = (BlueprintSpawnableComponent))
+class INVENTORYSYSTEM_API UPickupTriggerComponent : public UBoxComponent
+{
+    GENERATED_BODY()
+
+public:
+
+    UPROPERTY(BlueprintReadOnly, EditAnywhere)
+    bool bAutoUpdateClosestPickable = true;
+    UPROPERTY(BlueprintCallable, BlueprintAssignable)
+    FPickableEventDelegate OnClosestPickableUpdated;
+    UPROPERTY(BlueprintCallable, BlueprintAssignable)
+    FPickableEventDelegate OnPickableTriggerEnter;
+    UPROPERTY(BlueprintCallable, BlueprintAssignable)
+    FPickableEventDelegate OnPickableTriggerExit;
+    /**
+     * Actors picked up by pickupAll with UseDataAndDestroyActor behavior are hidden right away and destroyed on the next frame.
+     * When this is enabled they're handed over to OnPickedUpActorReleased instead, e.g. to return them to a pool.
+     */
+    UPROPERTY(BlueprintReadWrite, EditAnywhere)
+    bool bReleasePickedUpActors = false;
+    /** Fired on the next frame for every actor picked up by pickupAll, when bReleasePickedUpActors is enabled. */
+    UPROPERTY(BlueprintCallable, BlueprintAssignable)
+    FPickedUpActorReleasedDelegate OnPickedUpActorReleased;
+
+protected:
+
+    UPROPERTY(BlueprintReadWrite, VisibleAnywhere)
+    TArray<TScriptInterface<IPickable>> available_pickables;
+    UPROPERTY(BlueprintReadWrite, VisibleAnywhere)
+    TScriptInterface<IPickable> closest_pickable;
+
+public:
+
+    UPickupTriggerComponent();
+    virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+    virtual void BeginPlay() override;
+    virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+    void setAutoUpdateClosestPickable(bool bEnabled);
+    const TArray<TScriptInterface<IPickable>>& getAvailablePickables() const { return available_pickables; }
+    /** Closest pickable found by the last update, unlike getClosestPickable which searches again. */
+    const TScriptInterface<IPickable>& getCurrentClosestPickable() const { return closest_pickable; }
+    /** Whether the closest pickable is updated by UPickupTriggerSubsystem instead of this component tick. */
+    bool isUpdatedBySubsystem() const { return bUpdatedBySubsystem; }
+    /** Stores the new closest pickable, firing closestPickableUpdated if it changed. */
+    void updateClosestPickable(const TScriptInterface<IPickable>& new_closest);
+    /**
+     * @return Closest pickable to the trigger, or nullptr if no pickable is available.
+     */
+    UFUNCTION(BlueprintCallable)
+    TScriptInterface<IPickable> getClosestPickable();
+    /**
+     * Picks up every available pickable accepted by the filter into the bag, closest first.
+     * Data items are grouped by type and added with a single bulk add per type for their summed quantities (see getPickableQuantity).
+     * Resources that only partially fit keep the rest of their quantity. Item components are added one by one.
+     * Picked up actors are hidden right away and destroyed (or released, see bReleasePickedUpActors) on the next frame.
+     * @param filter Pickables for which it returns false are skipped. All pickables are accepted when unbound.
+     * @param max_count Maximum number of pickables to pick up, negative for no limit.
+     */
+    UFUNCTION(BlueprintCallable)
+    FPickupAllResult pickupAll(UInventoryBagComponent* bag, const FPickableFilterDelegate& filter, int32 max_count = -1);
+    FPickupAllResult pickupAll(UInventoryBagComponent* bag, TFunctionRef<bool(const TScriptInterface<IPickable>&)> filter, int32 max_count = -1);
+
+protected:
+
+    UFUNCTION(BlueprintCallable, BlueprintNativeEvent)
+    void closestPickableUpdated(const TScriptInterface<IPickable>& pickable);
+    UFUNCTION()
+    void handleTriggerBeginOverlap(UPrimitiveComponent* overlapped_component, AActor* other_actor, UPrimitiveComponent* other_comp, int32 other_body_index, bool b_from_sweep, const FHitResult& sweep_result);
+    UFUNCTION()
+    void handleTriggerEndOverlap(UPrimitiveComponent* overlapped_component, AActor* other_actor, UPrimitiveComponent* other_comp, int32 other_body_index);
+
+private:
+
+    /** Destroys or releases the actors picked up during this frame. */
+    void releasePickedUpActors();
+
+    bool bUpdatedBySubsystem = false;
+    bool bRegisteredWithSubsystem = false;
+    /** Actors picked up by pickupAll waiting for the next frame. */
+    UPROPERTY()
+    TArray<AActor*> picked_up_actors;
+};
@@ -0,0 +1,58 @@
+// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
+
+#pragma once
+
+#include "InventorySystemCommon.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+
+#include "PickupTriggerSubsystem.generated.h"
+
+class UPickupTriggerComponent;
+
+/**
+ * Updates the closest pickable of every pickup trigger in the world in a single pass, instead of one tick per trigger.
+ * Trigger and pickable locations are gathered into flat arrays on the game thread, closest pickables are then
+ * computed for all triggers in parallel and events only fire for triggers whose closest pickable changed.
+ * Every trigger registers itself on BeginPlay. Closest pickables are only updated here for triggers that don't tick on their own,
+ * see InventorySystem.Pickup.BatchClosestUpdate.
+ */
+UCLASS()
+class INVENTORYSYSTEM_API UPickupTriggerSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+    GENERATED_BODY()
+
+public:
+
+    void registerTrigger(UPickupTriggerComponent* trigger);
+    void unregisterTrigger(UPickupTriggerComponent* trigger);
+    int32 getNumTriggers() const { return triggers.Num(); }
+    const TArray<UPickupTriggerComponent*>& getTriggers() const { return triggers; }
+    /** Runs a closest pickable update for all registered triggers right away. */
+    void updateClosestPickables();
+
+    void Deinitialize() override;
+
+    void Tick(float DeltaTime) override;
+    bool IsTickable() const override;
+    TStatId GetStatId() const override;
+    UWorld* GetTickableGameObjectWorld() const override { return GetWorld(); }
+
+private:
+
+    UPROPERTY()
+    TArray<UPickupTriggerComponent*> triggers;
+    /** Triggers taking part in the current update, those with auto update enabled and at least one pickable. */
+    TArray<UPickupTriggerComponent*> active_triggers;
+    /** Trigger locations, one entry per active trigger. */
+    TArray<FVector> trigger_locations;
+    /** Candidates of active trigger i are at [candidate_offsets[i], candidate_offsets[i + 1]). */
+    TArray<int32> candidate_offsets;
+    /** Candidate pickable locations for all triggers, split per coordinate so the distance loop runs over contiguous floats. */
+    TArray<float> candidate_xs;
+    TArray<float> candidate_ys;
+    TArray<float> candidate_zs;
+    /** Closest candidate index, relative to the trigger offset, INDEX_NONE when none is valid. One per active trigger. */
+    TArray<int32> closest_candidates;
+    float time_since_update = 0.f;
+};
@@ -1,45 +1,69 @@
-﻿// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
-
-#pragma once
-
-#include "Item.h"
-#include "Resource.generated.h"
-
-/**
-* Lists all supported kinds of resource.
-* This should be customized per project based on the resources you actually have.
-**/
-UENUM(BlueprintType, Blueprintable)
-enum class EResourceCategory : uint8
-{
-    None,
-    Generic,
-    Crafting,
-    Wood,
-    Rock,
-    Metal,
-    Fiber,
-    Food,
-    Health,
-};
-
-UCLASS(BlueprintType)
-class INVENTORYSYSTEM_API UResourceData : public UItemData
-{
-    GENERATED_BODY()
-
-public:
-
-    UPROPERTY(BlueprintReadWrite, EditAnywhere)
-    EResourceCategory ResourceCategory = EResourceCategory::None;
-};
-
-UCLASS(BlueprintType)
-class INVENTORYSYSTEM_API UResourceComponent : public UItemComponent
-{
-    GENERATED_BODY()
-
-public:
-    UResourceComponent();
-    virtual EPickupBehavior getPickupBehavior_Implementation() override;
-};
+﻿// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
+
+#pragma once
+
+#include "Item.h"
+#include "Resource.generated.h"
+
+/**
+* Lists all supported kinds of resource.
+* This should be customized per project based on the resources you actually have.
+**/
+UENUM(BlueprintType, Blueprintable)
+enum class EResourceCategory : uint8
+{
+    None,
+    Generic,
+    Crafting,
+    Wood,
+    Rock,
+    Metal,
+    Fiber,
+    Food,
+    Health,
+};
+
+UCLASS(BlueprintType)
+class INVENTORYSYSTEM_API UResourceData : public UItemData
+{
+    GENERATED_BODY()
+
+public:
+
+    UResourceData();
+
+    UPROPERTY(BlueprintReadWrite, EditAnywhere)
+    EResourceCategory ResourceCategory = EResourceCategory::None;
+};
+
+UCLASS(BlueprintType)
+class INVENTORYSYSTEM_API UResourceComponent : public UItemComponent
+{
+    GENERATED_BODY()
+
+public:
+
+    /**
+     * Number of resources this pickup stands for, raised when nearby pickups get merged into it (see UResourceMergeSubsystem).
+     * Code picking it up must add this many items to the bag: UInventoryBagComponent::addPickable, addItemComponent
+     * and UPickupTriggerComponent::pickupAll do, a plain addItem of the item data doesn't.
+     */
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Inventory", SaveGame, meta=(ClampMin=1))
+    int32 Quantity = 1;
+    /**
+     * Let UResourceMergeSubsystem merge nearby pickups of the same resource into this one. Read on BeginPlay.
+     * Only enable it for pickups that are always picked up through a path honouring Quantity, see above.
+     */
+    UPROPERTY(BlueprintReadOnly, EditAnywhere, Category="Inventory")
+    bool bAllowMerge = false;
+
+    void BeginPlay() override;
+    void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+    virtual EPickupBehavior getPickupBehavior_Implementation() override;
+    virtual int32 getPickableQuantity_Implementation() override;
+
+private:
+
+    bool bRegisteredForMerge = false;
+};
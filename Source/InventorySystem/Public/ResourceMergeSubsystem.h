@@ -0,0 +1,65 @@
+// Copyright SygiFox 2020 - Simone Di Gravio dig@sygifox.com
+
+#pragma once
+
+#include "InventorySystemCommon.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+
+#include "ResourceMergeSubsystem.generated.h"
+
+class UResourceComponent;
+
+/**
+ * Merges dropped resource pickups of the same resource lying close to each other into a single pickup carrying
+ * their summed quantity, so that busy areas don't fill up with identical actors each costing a tick, overlaps and a channel.
+ * Works in sweeps over every registered pickup, time-sliced with a per frame budget. See the InventorySystem.ResourceMerge cvars.
+ * Resource components register themselves on BeginPlay, see UResourceComponent::bAllowMerge.
+ */
+UCLASS()
+class INVENTORYSYSTEM_API UResourceMergeSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+    GENERATED_BODY()
+
+public:
+
+    void registerResource(UResourceComponent* resource);
+    void unregisterResource(UResourceComponent* resource);
+    int32 getNumResources() const { return resources.Num(); }
+    /**
+     * Keeps merging until a whole sweep merges nothing, ignoring the per frame budget.
+     * @return Number of pickups merged away.
+     */
+    int32 mergeAll();
+
+    void Initialize(FSubsystemCollectionBase& Collection) override;
+    void Deinitialize() override;
+
+    void Tick(float DeltaTime) override;
+    bool IsTickable() const override;
+    TStatId GetStatId() const override;
+    UWorld* GetTickableGameObjectWorld() const override { return GetWorld(); }
+
+private:
+
+    /** Takes the pickups to go through and buckets them into the grid. */
+    void beginSweep();
+    /**
+     * Goes on with the current sweep within the given budgets, negative for no limit.
+     * @return Number of pickups merged away.
+     */
+    int32 continueSweep(int32 max_checks, int32 max_merges);
+    /** Whether a resource can take part in a merge right now. */
+    bool canMerge(const UResourceComponent* resource) const;
+    FIntVector getCell(const FVector& location) const;
+
+    UPROPERTY()
+    TArray<UResourceComponent*> resources;
+    /** Pickups registered when the current sweep began, in sweep order. */
+    TArray<TWeakObjectPtr<UResourceComponent>> sweep_resources;
+    int32 sweep_cursor = 0;
+    /** Pickups of the current sweep bucketed by their location when it began, in MergeRadius sized cells. */
+    TMap<FIntVector, TArray<TWeakObjectPtr<UResourceComponent>>> grid;
+    float cell_size = 1.f;
+    float time_since_sweep = 0.f;
+};